@@ -0,0 +1,98 @@
+#include "AsyncModelLoader.h"
+
+namespace Helpers
+{
+	size_t AsyncModelLoader::Submit(const std::string& filename, const LoadOptions& options)
+	{
+		size_t ticket;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			ticket = m_nextTicket++;
+			m_outstanding.insert(ticket);
+		}
+
+		m_pool.Submit([this, ticket, filename, options]() {
+			LoadedModel result;
+			result.ticket = ticket;
+			result.filename = filename;
+			result.loader = std::make_unique<ModelLoader>();
+			result.ok = result.loader->LoadFromFile(filename, options);
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_completed.push_back(std::move(result));
+			}
+			m_finished.notify_all();
+		});
+
+		return ticket;
+	}
+
+	size_t AsyncModelLoader::NumOutstanding()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_outstanding.size();
+	}
+
+	LoadedModel AsyncModelLoader::Remove(std::vector<LoadedModel>::iterator it)
+	{
+		LoadedModel result{ std::move(*it) };
+		m_completed.erase(it);
+		m_outstanding.erase(result.ticket);
+
+		// Anyone waiting in Collect for this ticket has to give up, and CollectAny callers may have run out
+		m_finished.notify_all();
+		return result;
+	}
+
+	bool AsyncModelLoader::TryCollect(LoadedModel& result)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_completed.empty())
+			return false;
+
+		result = Remove(m_completed.begin());
+		return true;
+	}
+
+	LoadedModel AsyncModelLoader::CollectAny()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		// Another thread may take the last outstanding load while this one waits
+		m_finished.wait(lock, [this] { return !m_completed.empty() || m_outstanding.empty(); });
+		if (m_completed.empty())
+		{
+			std::cout << "AsyncModelLoader::CollectAny called with nothing outstanding" << std::endl;
+			return LoadedModel();
+		}
+
+		return Remove(m_completed.begin());
+	}
+
+	LoadedModel AsyncModelLoader::Collect(size_t ticket)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (ticket >= m_nextTicket)
+		{
+			std::cout << "AsyncModelLoader::Collect unknown ticket " << ticket << std::endl;
+			return LoadedModel();
+		}
+
+		auto finished = [&] {
+			return std::find_if(m_completed.begin(), m_completed.end(),
+				[ticket](const LoadedModel& model) { return model.ticket == ticket; });
+		};
+
+		// Stops waiting if TryCollect or CollectAny takes the ticket first
+		m_finished.wait(lock, [&] { return !m_outstanding.count(ticket) || finished() != m_completed.end(); });
+
+		auto it = finished();
+		if (it == m_completed.end())
+		{
+			std::cout << "AsyncModelLoader::Collect ticket " << ticket << " was already collected" << std::endl;
+			return LoadedModel();
+		}
+		return Remove(it);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+// Loads models on worker threads and hands the finished CPU side data back to the GL thread
+
+#include "ExternalLibraryHeaders.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include <unordered_set>
+
+namespace Helpers
+{
+	// A model parsed on a worker thread, ready for upload
+	struct LoadedModel
+	{
+		size_t ticket{ 0 };
+		std::string filename;
+		std::unique_ptr<ModelLoader> loader;
+		bool ok{ false };
+	};
+
+	// Each submitted file gets its own ModelLoader and ASSIMP importer on a worker thread so a model made of
+	// many files loads in parallel. Only the CPU side is done here, uploading is left to the caller.
+	class AsyncModelLoader
+	{
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_finished;
+		std::vector<LoadedModel> m_completed;
+		size_t m_nextTicket{ 0 };
+
+		// Tickets submitted and not yet collected
+		std::unordered_set<size_t> m_outstanding;
+
+		// Takes a completed load out of m_completed, must hold the lock
+		LoadedModel Remove(std::vector<LoadedModel>::iterator it);
+
+		// Declared last so workers are joined before the members they use are destroyed
+		ThreadPool m_pool;
+	public:
+		// 0 threads means one per hardware core
+		explicit AsyncModelLoader(unsigned int numThreads = 0) : m_pool(numThreads) {}
+
+		// Queue a file for loading, returns a ticket that identifies it
+		size_t Submit(const std::string& filename, const LoadOptions& options = LoadOptions());
+
+		// Submitted and not yet collected
+		size_t NumOutstanding();
+
+		// Retrieve any finished load without blocking, returns false if none are ready
+		bool TryCollect(LoadedModel& result);
+
+		// Block until any load finishes, in completion order. Returns an empty result if nothing is outstanding.
+		LoadedModel CollectAny();
+
+		// Block until a specific load finishes. Returns an empty result if the ticket is unknown or was collected
+		// already, including by TryCollect or CollectAny while this was waiting.
+		LoadedModel Collect(size_t ticket);
+	};
+}
@@ -1,9 +1,27 @@
-#version 330
+#version 460
 
 //vertex shader for cube
 
-uniform mat4 combined_xform;
-uniform mat4 model_xform;
+// Written once per frame, see FrameConstants in Renderer.h
+layout (std140, binding=0) uniform FrameConstants
+{
+	mat4 view_xform;
+	mat4 projection_xform;
+	mat4 combined_xform;
+	mat4 sky_combined_xform;
+	vec4 camera_position;
+	vec4 time;	// x is seconds since start, y the frame's delta
+};
+
+// Per draw, from the ring buffer. See DrawConstants in Renderer.h
+layout (std140, binding=1) uniform DrawConstants
+{
+	mat4 model_xform;
+
+	// Vertex data may be quantised, see VertexFormat.h. position_scale.w is 1 for octahedral normals.
+	vec4 position_offset;
+	vec4 position_scale;
+};
 
 layout (location=0) in vec3 vertex_position;
 layout (location=1) in vec3 vertex_colour;
@@ -0,0 +1,61 @@
+#version 460
+
+// Vertex shader for draws issued with glMultiDrawElementsIndirect, see IndirectBatcher.h
+
+// Written once per frame, see FrameConstants in Renderer.h
+layout (std140, binding=0) uniform FrameConstants
+{
+	mat4 view_xform;
+	mat4 projection_xform;
+	mat4 combined_xform;
+	mat4 sky_combined_xform;
+	vec4 camera_position;
+	vec4 time;	// x is seconds since start, y the frame's delta
+};
+
+// gl_DrawID starts again at 0 for each multi-draw, this is where the batch's parameters start
+uniform int first_draw;
+
+struct DrawParams
+{
+	mat4 model_xform;
+	vec4 position_offset;	// w is unused
+	vec4 position_scale;	// w is 1 for octahedral normals
+};
+
+layout (std430, binding=0) readonly buffer DrawParamsBuffer
+{
+	DrawParams draw_params[];
+};
+
+layout (location=0) in vec3 vertex_position;
+layout (location=1) in vec3 vertex_normals;
+layout (location=2) in vec2 texCoords;
+
+out vec3 varying_normals;
+out vec3 varying_position;
+out vec2 varying_texCoord;
+
+// Inverse of EncodeOctahedral in VertexFormat.cpp
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+void main(void)
+{	
+	DrawParams params = draw_params[first_draw + gl_DrawID];
+
+	vec3 position = params.position_offset.xyz + params.position_scale.xyz * vertex_position;
+
+	varying_position = position;
+
+	varying_normals = params.position_scale.w > 0.5 ? DecodeOctahedral(vertex_normals.xy) : vertex_normals;
+
+	varying_texCoord = texCoords;
+
+	gl_Position = combined_xform * params.model_xform * vec4(position, 1.0);
+}
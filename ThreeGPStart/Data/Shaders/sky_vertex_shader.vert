@@ -1,7 +1,25 @@
-#version 330
+#version 460
 
-uniform mat4 combined_xform;
-uniform mat4 model_xform;
+// Written once per frame, see FrameConstants in Renderer.h
+layout (std140, binding=0) uniform FrameConstants
+{
+	mat4 view_xform;
+	mat4 projection_xform;
+	mat4 combined_xform;
+	mat4 sky_combined_xform;
+	vec4 camera_position;
+	vec4 time;	// x is seconds since start, y the frame's delta
+};
+
+// Per draw, from the ring buffer. See DrawConstants in Renderer.h
+layout (std140, binding=1) uniform DrawConstants
+{
+	mat4 model_xform;
+
+	// Vertex data may be quantised, see VertexFormat.h. position_scale.w is 1 for octahedral normals.
+	vec4 position_offset;
+	vec4 position_scale;
+};
 
 
 layout (location=0) in vec3 vertex_position;
@@ -11,11 +29,22 @@ layout (location=2) in vec2 texCoords;
 out vec3 varying_normals;
 out vec2 varying_texCoord;
 
+// Inverse of EncodeOctahedral in VertexFormat.cpp
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
 void main(void)
 {	
-	varying_normals = vertex_normals;
+	vec3 position = position_offset.xyz + position_scale.xyz * vertex_position;
+
+	varying_normals = position_scale.w > 0.5 ? DecodeOctahedral(vertex_normals.xy) : vertex_normals;
 
 	varying_texCoord = texCoords;
 
-	gl_Position = combined_xform * model_xform * vec4(vertex_position, 1.0);
+	gl_Position = sky_combined_xform * model_xform * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,16 @@
+#version 460
+
+// Fragment shader for the cube map sky, same brightness as sky_fragment_shader.frag
+
+layout (binding=0) uniform samplerCube sky_tex;
+
+in vec3 varying_direction;
+
+out vec4 fragment_colour;
+
+void main(void)
+{
+	vec3 tex_colour = texture(sky_tex, normalize(varying_direction)).rgb;
+
+	fragment_colour = vec4(tex_colour * 0.7, 1.0);
+}
\ No newline at end of file
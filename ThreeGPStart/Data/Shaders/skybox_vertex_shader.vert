@@ -0,0 +1,29 @@
+#version 460
+
+// Vertex shader for the cube map sky, one triangle covering the screen with no vertex buffer
+
+// Written once per frame, see FrameConstants in Renderer.h
+layout (std140, binding=0) uniform FrameConstants
+{
+	mat4 view_xform;
+	mat4 projection_xform;
+	mat4 combined_xform;
+	mat4 sky_combined_xform;
+	vec4 camera_position;
+	vec4 time;	// x is seconds since start, y the frame's delta
+};
+
+out vec3 varying_direction;
+
+void main(void)
+{	
+	// Corners at (-1,-1), (3,-1) and (-1,3) cover the whole of clip space
+	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+
+	// On the far plane so anything already drawn hides it with GL_LEQUAL
+	gl_Position = vec4(position, 1.0, 1.0);
+
+	// Back through the rotation only view to a world direction
+	vec4 world = inverse(sky_combined_xform) * vec4(position, 1.0, 1.0);
+	varying_direction = world.xyz / world.w;
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#version 460
+
+// Written once per frame, see TerrainConstants in Terrain.h
+layout (std140, binding=2) uniform TerrainConstants
+{
+	vec4 terrain_origin;	// w is the spacing
+	vec4 height_params;	// height scale, height offset, 1 / samples along a stored tile's side, 1 / texture repeat cells
+	vec4 overview;	// 1 / samples along the overview's side, cells between overview samples
+};
+
+uniform sampler2D sampler_tex;
+
+in vec3 varying_position;
+in vec3 varying_normal;
+in vec2 varying_cell;
+
+out vec4 fragment_colour;
+
+void main(void)
+{
+	vec3 normals = normalize(varying_normal);
+
+	vec3 tex_colour = texture(sampler_tex, varying_cell * height_params.w).rgb;
+
+	vec3 point_light_pos = vec3(100, 20, -400);
+
+	vec3 light_direction = vec3(0, -0.5, -5);
+	vec3 point_light_direction = point_light_pos - varying_position;
+
+	vec3 dir_light = normalize(-light_direction);
+	vec3 point_light = normalize(point_light_direction);
+
+	float dir_intensity = max(0, dot(dir_light, normals));
+	float point_intesnity = max(0, dot(point_light, normals));
+
+	vec3 ambient_light = vec3(0.05);
+
+	vec3 result = ambient_light + tex_colour * (dir_intensity + point_intesnity);
+
+	fragment_colour = vec4(result, 1.0);
+}
@@ -0,0 +1,104 @@
+#version 460
+
+// Vertex shader for the quadtree terrain, see Terrain.h. Every instance is the same flat patch placed over one
+// quadrant of a node, displaced by its tile's layer of the height texture array and lit from neighbouring heights.
+
+// Written once per frame, see FrameConstants in Renderer.h
+layout (std140, binding=0) uniform FrameConstants
+{
+	mat4 view_xform;
+	mat4 projection_xform;
+	mat4 combined_xform;
+	mat4 sky_combined_xform;
+	vec4 camera_position;
+	vec4 time;	// x is seconds since start, y the frame's delta
+};
+
+// See TerrainInstance in Terrain.h
+struct TerrainInstance
+{
+	vec4 node;	// first cell x, first cell z, size in cells, level
+	vec4 morph;	// distance the morph into the next level starts and ends at, 1 / (end - start), quadrant
+	vec4 tile;	// first cell x and z of the node's tile, texture array layer or -1 for the overview
+};
+
+// Terrain::kMaxInstancesPerDraw
+const int kMaxInstancesPerDraw = 256;
+
+// Per draw, from the ring buffer
+layout (std140, binding=1) uniform TerrainInstances
+{
+	TerrainInstance instances[kMaxInstancesPerDraw];
+};
+
+// Written once per frame, see TerrainConstants in Terrain.h
+layout (std140, binding=2) uniform TerrainConstants
+{
+	vec4 terrain_origin;	// w is the spacing
+	vec4 height_params;	// height scale, height offset, 1 / samples along a stored tile's side, 1 / texture repeat cells
+	vec4 overview;	// 1 / samples along the overview's side, cells between overview samples
+};
+
+uniform sampler2DArray sampler_height;
+uniform sampler2D sampler_overview;
+
+// Cells within the patch along x and z
+layout (location=0) in vec3 vertex_position;
+
+out vec3 varying_position;
+out vec3 varying_normal;
+out vec2 varying_cell;
+
+// Terrain::kPatchCells
+const float kPatchCells = 32.0;
+
+// TerrainTileFile::kTileRing
+const float kTileRing = 8.0;
+
+float Height(vec2 cell, vec4 tile)
+{
+	// Sample centres sit on texel centres, inside the extra ring
+	float sample_value;
+	if (tile.z < 0.0)
+		sample_value = textureLod(sampler_overview, (cell / overview.y + 1.5) * overview.x, 0.0).r;
+	else
+		sample_value = textureLod(sampler_height, vec3((cell - tile.xy + kTileRing + 0.5) * height_params.z, tile.z), 0.0).r;
+	return terrain_origin.y + height_params.y + height_params.x * sample_value;
+}
+
+void main(void)
+{
+	TerrainInstance instance = instances[gl_InstanceID];
+	vec4 node = instance.node;
+	vec4 morph = instance.morph;
+	vec4 tile = instance.tile;
+
+	// The patch covers one quadrant, quadrant 1 is along x and 2 along z
+	int quadrant = int(morph.w);
+	vec2 patch_position = vertex_position.xz + vec2(quadrant & 1, quadrant >> 1) * (kPatchCells * 0.5);
+
+	float cells_per_vertex = node.z / kPatchCells;
+	vec2 cell = node.xy + patch_position * cells_per_vertex;
+
+	// Odd vertices slide onto their even neighbours towards the end of the node's range, leaving the next level's grid
+	vec3 unmorphed = vec3(terrain_origin.x + cell.x * terrain_origin.w, Height(cell, tile), terrain_origin.z - cell.y * terrain_origin.w);
+	float morph_k = clamp((length(unmorphed - camera_position.xyz) - morph.x) * morph.z, 0.0, 1.0);
+	vec2 odd = fract(patch_position * 0.5) * 2.0;
+	cell -= odd * morph_k * cells_per_vertex;
+
+	varying_position = vec3(terrain_origin.x + cell.x * terrain_origin.w, Height(cell, tile), terrain_origin.z - cell.y * terrain_origin.w);
+
+	// Central differences of the heights, rows run along -z so the row gradient changes sign. They span one vertex,
+	// widening to the next level's spacing as the vertex morphs, so a distant node does not shimmer with detail it
+	// cannot show and meets the coarser level's lighting. A root's vertices are overview.y cells apart.
+	float normal_step = cells_per_vertex * (1.0 + morph_k);
+	float left = Height(cell - vec2(normal_step, 0.0), tile);
+	float right = Height(cell + vec2(normal_step, 0.0), tile);
+	float below = Height(cell - vec2(0.0, normal_step), tile);
+	float above = Height(cell + vec2(0.0, normal_step), tile);
+	varying_normal = normalize(vec3(left - right, 2.0 * normal_step * terrain_origin.w, above - below));
+
+	varying_cell = cell;
+
+	gl_Position = combined_xform * vec4(varying_position, 1.0);
+}
@@ -0,0 +1,102 @@
+#include "Frustum.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <emmintrin.h>
+#define FRUSTUM_USE_SSE
+#endif
+
+namespace Helpers
+{
+	void Frustum::Extract(const glm::mat4& viewProjection)
+	{
+		// glm is column major so row r is (m[0][r], m[1][r], m[2][r], m[3][r])
+		const glm::mat4 m{ glm::transpose(viewProjection) };
+
+		m_planes[0] = m[3] + m[0];	// Left
+		m_planes[1] = m[3] - m[0];	// Right
+		m_planes[2] = m[3] + m[1];	// Bottom
+		m_planes[3] = m[3] - m[1];	// Top
+		m_planes[4] = m[3] + m[2];	// Near
+		m_planes[5] = m[3] - m[2];	// Far
+
+		// Normalised so the plane equation gives a distance that can be compared with a radius
+		for (glm::vec4& plane : m_planes)
+			plane /= glm::length(glm::vec3(plane));
+	}
+
+	bool Frustum::TestSphere(const glm::vec3& centre, float radius) const
+	{
+		for (const glm::vec4& plane : m_planes)
+		{
+			if (glm::dot(glm::vec3(plane), centre) + plane.w < -radius)
+				return false;
+		}
+		return true;
+	}
+
+	bool Frustum::TestBox(const glm::vec3& minExtents, const glm::vec3& maxExtents) const
+	{
+		for (const glm::vec4& plane : m_planes)
+		{
+			const glm::vec3 furthest{ plane.x >= 0 ? maxExtents.x : minExtents.x, plane.y >= 0 ? maxExtents.y : minExtents.y,
+				plane.z >= 0 ? maxExtents.z : minExtents.z };
+			if (glm::dot(glm::vec3(plane), furthest) + plane.w < 0)
+				return false;
+		}
+		return true;
+	}
+
+	size_t Frustum::TestSpheres(const BoundingSpheres& spheres, std::vector<unsigned char>& visible) const
+	{
+		const size_t count{ spheres.Size() };
+		visible.resize(count);
+
+		size_t numVisible{ 0 };
+		size_t i{ 0 };
+
+#ifdef FRUSTUM_USE_SSE
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm_set1_ps(m_planes[p].x);
+			planeY[p] = _mm_set1_ps(m_planes[p].y);
+			planeZ[p] = _mm_set1_ps(m_planes[p].z);
+			planeW[p] = _mm_set1_ps(m_planes[p].w);
+		}
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 x{ _mm_loadu_ps(&spheres.x[i]) };
+			const __m128 y{ _mm_loadu_ps(&spheres.y[i]) };
+			const __m128 z{ _mm_loadu_ps(&spheres.z[i]) };
+			const __m128 negRadius{ _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i])) };
+
+			// A lane stays set while its sphere is not fully outside any plane so far
+			__m128 inside{ _mm_castsi128_ps(_mm_set1_epi32(-1)) };
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 distance{ _mm_add_ps(_mm_mul_ps(planeX[p], x), planeW[p]) };
+				distance = _mm_add_ps(distance, _mm_mul_ps(planeY[p], y));
+				distance = _mm_add_ps(distance, _mm_mul_ps(planeZ[p], z));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+			}
+
+			const int mask{ _mm_movemask_ps(inside) };
+			for (int lane = 0; lane < 4; lane++)
+			{
+				visible[i + lane] = (mask >> lane) & 1;
+				numVisible += visible[i + lane];
+			}
+		}
+#endif
+
+		// Whatever does not fill a group of four
+		for (; i < count; i++)
+		{
+			visible[i] = TestSphere(glm::vec3(spheres.x[i], spheres.y[i], spheres.z[i]), spheres.radius[i]) ? 1 : 0;
+			numVisible += visible[i];
+		}
+
+		return numVisible;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+// View frustum planes and batched visibility tests against them
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Bounding spheres laid out one component per array so four can be tested at once
+	struct BoundingSpheres
+	{
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> radius;
+
+		void Clear() { x.clear(); y.clear(); z.clear(); radius.clear(); }
+		void Add(const glm::vec3& centre, float r) { x.push_back(centre.x); y.push_back(centre.y); z.push_back(centre.z); radius.push_back(r); }
+		size_t Size() const { return x.size(); }
+	};
+
+	// The six planes of a view projection, normals point inwards
+	class Frustum
+	{
+	private:
+		glm::vec4 m_planes[6];
+	public:
+		// Planes come straight out of the rows of the combined matrix
+		void Extract(const glm::mat4& viewProjection);
+
+		// False only if the sphere is entirely outside a plane
+		bool TestSphere(const glm::vec3& centre, float radius) const;
+
+		// False only if the box is entirely outside a plane, tests the corner furthest along each plane's normal
+		bool TestBox(const glm::vec3& minExtents, const glm::vec3& maxExtents) const;
+
+		// Writes 1 to visible for each sphere that intersects the frustum and 0 otherwise, four spheres per SSE step.
+		// Returns the number visible.
+		size_t TestSpheres(const BoundingSpheres& spheres, std::vector<unsigned char>& visible) const;
+	};
+}
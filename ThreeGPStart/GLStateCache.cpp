@@ -0,0 +1,226 @@
+#include "GLStateCache.h"
+
+namespace Helpers
+{
+	const char* GLCallName(GLCall call)
+	{
+		switch (call)
+		{
+		case GLCall::Enable:
+			return "glEnable / glDisable";
+		case GLCall::DepthMask:
+			return "glDepthMask";
+		case GLCall::DepthFunc:
+			return "glDepthFunc";
+		case GLCall::PolygonMode:
+			return "glPolygonMode";
+		case GLCall::UseProgram:
+			return "glUseProgram";
+		case GLCall::ActiveTexture:
+			return "glActiveTexture";
+		case GLCall::BindTexture:
+			return "glBindTexture(s)";
+		case GLCall::BindVertexArray:
+			return "glBindVertexArray";
+		case GLCall::BindBuffer:
+			return "glBindBufferRange / Base";
+		default:
+			return "Unknown";
+		}
+	}
+
+	bool GLStateCache::Check(GLCall call, bool changed)
+	{
+		GLCallCounter& counter = m_counters[(int)call];
+		counter.requested++;
+		if (changed)
+			counter.issued++;
+		return changed;
+	}
+
+	void GLStateCache::Invalidate()
+	{
+		m_capabilities.clear();
+		m_depthMask = -1;
+		m_depthFunc = GL_NONE;
+		m_polygonMode = GL_NONE;
+		m_programKnown = false;
+		m_activeUnitKnown = false;
+		m_vertexArrayKnown = false;
+
+		for (TextureUnit& unit : m_textureUnits)
+			unit = TextureUnit();
+		for (BufferRange& binding : m_uniformBindings)
+			binding = BufferRange();
+		for (BufferRange& binding : m_storageBindings)
+			binding = BufferRange();
+	}
+
+	void GLStateCache::ResetCounters()
+	{
+		for (GLCallCounter& counter : m_counters)
+			counter = GLCallCounter();
+	}
+
+	void GLStateCache::SetCapability(GLenum capability, bool enabled)
+	{
+		auto it = m_capabilities.find(capability);
+		if (!Check(GLCall::Enable, it == m_capabilities.end() || it->second != enabled))
+			return;
+
+		m_capabilities[capability] = enabled;
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+	}
+
+	void GLStateCache::DepthMask(GLboolean enabled)
+	{
+		if (!Check(GLCall::DepthMask, m_depthMask != (int)enabled))
+			return;
+
+		m_depthMask = enabled;
+		glDepthMask(enabled);
+	}
+
+	void GLStateCache::DepthFunc(GLenum func)
+	{
+		if (!Check(GLCall::DepthFunc, m_depthFunc != func))
+			return;
+
+		m_depthFunc = func;
+		glDepthFunc(func);
+	}
+
+	void GLStateCache::PolygonMode(GLenum mode)
+	{
+		if (!Check(GLCall::PolygonMode, m_polygonMode != mode))
+			return;
+
+		m_polygonMode = mode;
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+	}
+
+	void GLStateCache::UseProgram(GLuint program)
+	{
+		if (!Check(GLCall::UseProgram, !m_programKnown || m_program != program))
+			return;
+
+		m_program = program;
+		m_programKnown = true;
+		glUseProgram(program);
+	}
+
+	void GLStateCache::ActiveTexture(GLuint unit)
+	{
+		if (!Check(GLCall::ActiveTexture, !m_activeUnitKnown || m_activeUnit != unit))
+			return;
+
+		m_activeUnit = unit;
+		m_activeUnitKnown = true;
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+
+	void GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture)
+	{
+		bool changed{ true };
+		if (unit < kMaxTextureUnits)
+		{
+			TextureUnit& state = m_textureUnits[unit];
+			if (target == GL_TEXTURE_2D)
+			{
+				changed = !state.known2D || state.texture2D != texture;
+				state.texture2D = texture;
+				state.known2D = true;
+			}
+			else if (target == GL_TEXTURE_CUBE_MAP)
+			{
+				changed = !state.knownCube || state.textureCube != texture;
+				state.textureCube = texture;
+				state.knownCube = true;
+			}
+			else if (target == GL_TEXTURE_2D_ARRAY)
+			{
+				changed = !state.known2DArray || state.texture2DArray != texture;
+				state.texture2DArray = texture;
+				state.known2DArray = true;
+			}
+		}
+
+		if (!Check(GLCall::BindTexture, changed))
+			return;
+
+		ActiveTexture(unit);
+		glBindTexture(target, texture);
+	}
+
+	void GLStateCache::BindTextures(GLuint first, GLsizei count, const GLuint* textures)
+	{
+		bool changed{ false };
+		for (GLsizei t = 0; t < count; t++)
+		{
+			const GLuint unit{ first + t };
+			if (unit >= kMaxTextureUnits)
+			{
+				changed = true;
+				continue;
+			}
+
+			TextureUnit& state = m_textureUnits[unit];
+			changed |= !state.known2D || state.texture2D != textures[t];
+			state.texture2D = textures[t];
+			state.known2D = true;
+		}
+
+		// Does not change the active unit
+		if (Check(GLCall::BindTexture, changed))
+			glBindTextures(first, count, textures);
+	}
+
+	void GLStateCache::BindVertexArray(GLuint vertexArray)
+	{
+		if (!Check(GLCall::BindVertexArray, !m_vertexArrayKnown || m_vertexArray != vertexArray))
+			return;
+
+		m_vertexArray = vertexArray;
+		m_vertexArrayKnown = true;
+		glBindVertexArray(vertexArray);
+	}
+
+	GLStateCache::BufferRange* GLStateCache::FindBinding(GLenum target, GLuint index)
+	{
+		if (index >= kMaxBufferBindings)
+			return nullptr;
+		if (target == GL_UNIFORM_BUFFER)
+			return &m_uniformBindings[index];
+		if (target == GL_SHADER_STORAGE_BUFFER)
+			return &m_storageBindings[index];
+		return nullptr;
+	}
+
+	void GLStateCache::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+	{
+		BufferRange* binding{ FindBinding(target, index) };
+		const bool changed{ !binding || !binding->known || binding->buffer != buffer || binding->offset != offset || binding->size != size };
+		if (!Check(GLCall::BindBuffer, changed))
+			return;
+
+		if (binding)
+			*binding = BufferRange{ buffer, offset, size, true };
+		glBindBufferRange(target, index, buffer, offset, size);
+	}
+
+	void GLStateCache::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+	{
+		// A size of 0 stands for the whole buffer
+		BufferRange* binding{ FindBinding(target, index) };
+		const bool changed{ !binding || !binding->known || binding->buffer != buffer || binding->offset != 0 || binding->size != 0 };
+		if (!Check(GLCall::BindBuffer, changed))
+			return;
+
+		if (binding)
+			*binding = BufferRange{ buffer, 0, 0, true };
+		glBindBufferBase(target, index, buffer);
+	}
+}
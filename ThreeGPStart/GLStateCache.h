@@ -0,0 +1,111 @@
+#pragma once
+// Thin layer over the GL state the renderer changes, drops calls that would not change anything and counts the rest
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Kinds of call the cache filters
+	enum class GLCall
+	{
+		Enable,
+		DepthMask,
+		DepthFunc,
+		PolygonMode,
+		UseProgram,
+		ActiveTexture,
+		BindTexture,
+		BindVertexArray,
+		BindBuffer,
+		Count
+	};
+
+	const char* GLCallName(GLCall call);
+
+	// Calls made through the cache this frame and how many reached the driver
+	struct GLCallCounter
+	{
+		size_t requested{ 0 };
+		size_t issued{ 0 };
+	};
+
+	// Anything that changes this state without going through the cache must call Invalidate afterwards, e.g. after
+	// loading textures. ImGui's backend restores what it changes so does not need to.
+	class GLStateCache
+	{
+	public:
+		static constexpr GLuint kMaxTextureUnits{ 32 };
+		static constexpr GLuint kMaxBufferBindings{ 16 };
+	private:
+		// Capabilities seen so far, anything else is unknown and always issued
+		std::map<GLenum, bool> m_capabilities;
+
+		// -1 where the state is unknown
+		int m_depthMask{ -1 };
+		GLenum m_depthFunc{ GL_NONE };
+		GLenum m_polygonMode{ GL_NONE };
+		GLuint m_program{ 0 };
+		bool m_programKnown{ false };
+		GLuint m_activeUnit{ 0 };
+		bool m_activeUnitKnown{ false };
+		GLuint m_vertexArray{ 0 };
+		bool m_vertexArrayKnown{ false };
+
+		// Per unit, 2D, cube map and 2D array targets
+		struct TextureUnit
+		{
+			GLuint texture2D{ 0 };
+			GLuint textureCube{ 0 };
+			GLuint texture2DArray{ 0 };
+			bool known2D{ false };
+			bool knownCube{ false };
+			bool known2DArray{ false };
+		};
+		TextureUnit m_textureUnits[kMaxTextureUnits];
+
+		// Indexed uniform and storage buffer bindings
+		struct BufferRange
+		{
+			GLuint buffer{ 0 };
+			GLintptr offset{ 0 };
+			GLsizeiptr size{ 0 };
+			bool known{ false };
+		};
+		BufferRange m_uniformBindings[kMaxBufferBindings];
+		BufferRange m_storageBindings[kMaxBufferBindings];
+
+		GLCallCounter m_counters[(int)GLCall::Count];
+
+		// Counts the request and returns true if it must be issued
+		bool Check(GLCall call, bool changed);
+
+		BufferRange* FindBinding(GLenum target, GLuint index);
+	public:
+		// Forget everything, the next call of each kind is always issued
+		void Invalidate();
+
+		// Zeroes the counters, state is kept across frames
+		void ResetCounters();
+
+		void SetCapability(GLenum capability, bool enabled);
+		void DepthMask(GLboolean enabled);
+		void DepthFunc(GLenum func);
+		void PolygonMode(GLenum mode);
+		void UseProgram(GLuint program);
+		void ActiveTexture(GLuint unit);
+
+		// Makes unit active only if the binding has to change
+		void BindTexture(GLuint unit, GLenum target, GLuint texture);
+
+		// 2D textures to consecutive units from first, issued as one glBindTextures if any differ
+		void BindTextures(GLuint first, GLsizei count, const GLuint* textures);
+
+		void BindVertexArray(GLuint vertexArray);
+
+		// GL_UNIFORM_BUFFER and GL_SHADER_STORAGE_BUFFER indexed bindings
+		void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+		void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+		const GLCallCounter& Counter(GLCall call) const { return m_counters[(int)call]; }
+	};
+}
@@ -0,0 +1,202 @@
+#include "GeometryArena.h"
+
+namespace Helpers
+{
+	namespace
+	{
+		constexpr size_t kIndexAlignment{ 4 };
+	}
+
+	void RangeAllocator::Reset(size_t capacity)
+	{
+		m_free.clear();
+		m_capacity = capacity;
+		m_used = 0;
+		if (capacity)
+			m_free[0] = capacity;
+	}
+
+	size_t RangeAllocator::Allocate(size_t size)
+	{
+		// An empty range takes no space so is valid anywhere, Free ignores it
+		if (size == 0)
+			return 0;
+
+		for (auto it = m_free.begin(); it != m_free.end(); ++it)
+		{
+			if (it->second < size)
+				continue;
+
+			const size_t offset{ it->first };
+			const size_t remaining{ it->second - size };
+			m_free.erase(it);
+			if (remaining)
+				m_free[offset + size] = remaining;
+
+			m_used += size;
+			return offset;
+		}
+
+		return kInvalidOffset;
+	}
+
+	void RangeAllocator::Free(size_t offset, size_t size)
+	{
+		if (size == 0)
+			return;
+
+		auto inserted = m_free.emplace(offset, size).first;
+		m_used -= size;
+
+		// Merge with the following range
+		auto next = std::next(inserted);
+		if (next != m_free.end() && inserted->first + inserted->second == next->first)
+		{
+			inserted->second += next->second;
+			m_free.erase(next);
+		}
+
+		// And the preceding one
+		if (inserted != m_free.begin())
+		{
+			auto previous = std::prev(inserted);
+			if (previous->first + previous->second == inserted->first)
+			{
+				previous->second += inserted->second;
+				m_free.erase(inserted);
+			}
+		}
+	}
+
+	size_t RangeAllocator::LargestFreeRange() const
+	{
+		size_t largest{ 0 };
+		for (const auto& range : m_free)
+			largest = std::max(largest, range.second);
+		return largest;
+	}
+
+	GeometryArena::~GeometryArena()
+	{
+		glDeleteVertexArrays(kNumFormats, m_vaos);
+		glDeleteBuffers(kNumFormats, m_vertexBuffers);
+		glDeleteBuffers(1, &m_indexBuffer);
+	}
+
+	bool GeometryArena::Initialise(size_t vertexBytesPerFormat, size_t indexBytes)
+	{
+		// Immutable storage, only ever written with glBufferSubData
+		glGenBuffers(1, &m_indexBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_indexBuffer);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, indexBytes, nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		m_indexRanges.Reset(indexBytes);
+		m_indexPadding = 0;
+
+		glGenBuffers(kNumFormats, m_vertexBuffers);
+		glGenVertexArrays(kNumFormats, m_vaos);
+
+		for (int f = 0; f < kNumFormats; f++)
+		{
+			const VertexFormat format{ (VertexFormat)f };
+
+			// Whole vertices only so every allocation starts on a stride boundary and can be used as a base vertex
+			const size_t numVertices{ vertexBytesPerFormat / VertexStride(format) };
+
+			glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffers[f]);
+			glBufferStorage(GL_ARRAY_BUFFER, numVertices * VertexStride(format), nullptr, GL_DYNAMIC_STORAGE_BIT);
+			m_vertexRanges[f].Reset(numVertices);
+
+			glBindVertexArray(m_vaos[f]);
+			SetupVertexAttributes(format);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+			glBindVertexArray(0);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// Any details have already gone to the debug callback
+		return glGetError() == GL_NO_ERROR;
+	}
+
+	bool GeometryArena::Allocate(const PackedVertices& vertices, GLenum indexType, const std::vector<unsigned char>& indices,
+		GeometryAllocation& allocation)
+	{
+		const int f{ (int)vertices.format };
+		const GLsizei stride{ VertexStride(vertices.format) };
+
+		const size_t firstVertex{ m_vertexRanges[f].Allocate(vertices.numVertices) };
+		if (firstVertex == RangeAllocator::kInvalidOffset)
+		{
+			std::cout << "GeometryArena: out of " << VertexFormatName(vertices.format) << " vertex space for "
+				<< vertices.numVertices << " vertices" << std::endl;
+			return false;
+		}
+
+		const size_t indexBlock{ (indices.size() + kIndexAlignment - 1) / kIndexAlignment * kIndexAlignment };
+		const size_t indexOffset{ m_indexRanges.Allocate(indexBlock) };
+		if (indexOffset == RangeAllocator::kInvalidOffset)
+		{
+			std::cout << "GeometryArena: out of index space for " << indices.size() << " bytes" << std::endl;
+			m_vertexRanges[f].Free(firstVertex, vertices.numVertices);
+			return false;
+		}
+		m_indexPadding += indexBlock - indices.size();
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffers[f]);
+		glBufferSubData(GL_ARRAY_BUFFER, firstVertex * stride, vertices.data.size(), vertices.data.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// Binding the element buffer outside a VAO would change whichever VAO is bound, use the copy target instead
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_indexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, indices.size(), indices.data());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		allocation.format = vertices.format;
+		allocation.baseVertex = (GLint)firstVertex;
+		allocation.numVertices = (GLuint)vertices.numVertices;
+		allocation.indexByteOffset = indexOffset;
+		allocation.indexBytes = indices.size();
+		allocation.indexType = indexType;
+		allocation.valid = true;
+
+		return true;
+	}
+
+	void GeometryArena::Free(GeometryAllocation& allocation)
+	{
+		if (!allocation.valid)
+			return;
+
+		const size_t indexBlock{ (allocation.indexBytes + kIndexAlignment - 1) / kIndexAlignment * kIndexAlignment };
+		m_indexRanges.Free(allocation.indexByteOffset, indexBlock);
+		m_indexPadding -= indexBlock - allocation.indexBytes;
+
+		m_vertexRanges[(int)allocation.format].Free(allocation.baseVertex, allocation.numVertices);
+
+		allocation.valid = false;
+	}
+
+	GeometryArenaStats GeometryArena::VertexStats(VertexFormat format) const
+	{
+		const RangeAllocator& ranges = m_vertexRanges[(int)format];
+		const size_t stride{ (size_t)VertexStride(format) };
+
+		GeometryArenaStats stats;
+		stats.capacityBytes = ranges.Capacity() * stride;
+		stats.usedBytes = ranges.Used() * stride;
+		stats.numFreeRanges = ranges.NumFreeRanges();
+		stats.largestFreeBytes = ranges.LargestFreeRange() * stride;
+		return stats;
+	}
+
+	GeometryArenaStats GeometryArena::IndexStats() const
+	{
+		GeometryArenaStats stats;
+		stats.capacityBytes = m_indexRanges.Capacity();
+		stats.usedBytes = m_indexRanges.Used();
+		stats.paddingBytes = m_indexPadding;
+		stats.numFreeRanges = m_indexRanges.NumFreeRanges();
+		stats.largestFreeBytes = m_indexRanges.LargestFreeRange();
+		return stats;
+	}
+}
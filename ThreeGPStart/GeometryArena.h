@@ -0,0 +1,99 @@
+#pragma once
+// Large shared GPU buffers that all static geometry is sub-allocated from
+
+#include "ExternalLibraryHeaders.h"
+#include "VertexFormat.h"
+
+namespace Helpers
+{
+	// First fit allocator over a range of units, freed ranges are merged with their neighbours
+	class RangeAllocator
+	{
+	private:
+		// Free ranges keyed by offset
+		std::map<size_t, size_t> m_free;
+		size_t m_capacity{ 0 };
+		size_t m_used{ 0 };
+	public:
+		static constexpr size_t kInvalidOffset{ SIZE_MAX };
+
+		void Reset(size_t capacity);
+
+		// Returns kInvalidOffset if there is no free range big enough. A size of 0 always succeeds, at offset 0.
+		size_t Allocate(size_t size);
+		void Free(size_t offset, size_t size);
+
+		size_t Capacity() const { return m_capacity; }
+		size_t Used() const { return m_used; }
+		size_t NumFreeRanges() const { return m_free.size(); }
+		size_t LargestFreeRange() const;
+	};
+
+	// Where a mesh lives inside the arena. Draw with glDrawElementsBaseVertex using the arena VAO for the format.
+	struct GeometryAllocation
+	{
+		VertexFormat format{ VertexFormat::Float };
+
+		// In vertices from the start of the format's vertex buffer
+		GLint baseVertex{ 0 };
+		GLuint numVertices{ 0 };
+
+		// In bytes from the start of the index buffer
+		size_t indexByteOffset{ 0 };
+		size_t indexBytes{ 0 };
+		GLenum indexType{ GL_UNSIGNED_INT };
+
+		bool valid{ false };
+	};
+
+	// Usage of one of the arena buffers
+	struct GeometryArenaStats
+	{
+		size_t capacityBytes{ 0 };
+		size_t usedBytes{ 0 };
+
+		// Alignment padding inside allocations
+		size_t paddingBytes{ 0 };
+
+		size_t numFreeRanges{ 0 };
+		size_t largestFreeBytes{ 0 };
+	};
+
+	// One immutable vertex buffer and VAO per vertex format plus one shared index buffer.
+	// Index ranges are 4 byte aligned so 8, 16 and 32 bit indices can be mixed.
+	class GeometryArena
+	{
+	private:
+		static constexpr int kNumFormats{ 2 };
+
+		GLuint m_vertexBuffers[kNumFormats]{};
+		GLuint m_vaos[kNumFormats]{};
+		RangeAllocator m_vertexRanges[kNumFormats];
+
+		GLuint m_indexBuffer{ 0 };
+		RangeAllocator m_indexRanges;
+		size_t m_indexPadding{ 0 };
+	public:
+		GeometryArena() = default;
+		~GeometryArena();
+
+		GeometryArena(const GeometryArena&) = delete;
+		GeometryArena& operator=(const GeometryArena&) = delete;
+
+		// Create the buffers, sizes are per vertex format and for all indices. Returns false on error.
+		bool Initialise(size_t vertexBytesPerFormat, size_t indexBytes);
+
+		// Copy a mesh into the arena, indices are relative to its own vertices. Returns false if it does not fit.
+		bool Allocate(const PackedVertices& vertices, GLenum indexType, const std::vector<unsigned char>& indices,
+			GeometryAllocation& allocation);
+
+		// Return a mesh's ranges to the arena e.g. when its model is unloaded
+		void Free(GeometryAllocation& allocation);
+
+		// Vertex array object with the format's vertex buffer and the index buffer bound
+		GLuint Vao(VertexFormat format) const { return m_vaos[(int)format]; }
+
+		GeometryArenaStats VertexStats(VertexFormat format) const;
+		GeometryArenaStats IndexStats() const;
+	};
+}
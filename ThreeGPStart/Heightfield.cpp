@@ -0,0 +1,242 @@
+#include "Heightfield.h"
+#include "ImageLoader.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <emmintrin.h>
+#define HEIGHTFIELD_USE_SSE
+#endif
+
+namespace Helpers
+{
+	namespace
+	{
+		// Texels either side of a sample that the filters read, the first is one before the one below the sample
+		constexpr int kNumTaps{ 4 };
+
+		// First texel and the weight of each tap for sample index of numSamples spread corner to corner over size texels
+		void FilterTaps(int index, int numSamples, int size, HeightfieldFilter filter, int& first, float (&weights)[kNumTaps])
+		{
+			// Doubles so the last sample lands exactly on the last texel however large the grid
+			const double position{ numSamples > 1 ? (double)index * (size - 1) / (numSamples - 1) : 0.0 };
+			int texel{ (int)position };
+			float t{ (float)(position - texel) };
+			if (texel >= size - 1)
+			{
+				texel = size - 1;
+				t = 0.0f;
+			}
+			first = texel - 1;
+
+			switch (filter)
+			{
+			case HeightfieldFilter::Nearest:
+				weights[0] = 0.0f;
+				weights[1] = t < 0.5f ? 1.0f : 0.0f;
+				weights[2] = t < 0.5f ? 0.0f : 1.0f;
+				weights[3] = 0.0f;
+				break;
+			case HeightfieldFilter::Bilinear:
+				weights[0] = 0.0f;
+				weights[1] = 1.0f - t;
+				weights[2] = t;
+				weights[3] = 0.0f;
+				break;
+			case HeightfieldFilter::Bicubic:
+				// Catmull-Rom, passes through every texel and the weights always add up to one
+				weights[0] = t * (-0.5f + t * (1.0f - 0.5f * t));
+				weights[1] = 1.0f + t * t * (-2.5f + 1.5f * t);
+				weights[2] = t * (0.5f + t * (2.0f - 1.5f * t));
+				weights[3] = t * t * (-0.5f + 0.5f * t);
+				break;
+			}
+		}
+	}
+
+	const char* HeightfieldFilterName(HeightfieldFilter filter)
+	{
+		switch (filter)
+		{
+		case HeightfieldFilter::Nearest: return "Nearest";
+		case HeightfieldFilter::Bilinear: return "Bilinear";
+		case HeightfieldFilter::Bicubic: return "Bicubic";
+		}
+		return "Unknown";
+	}
+
+	bool Heightfield::Load(const std::string& filepath)
+	{
+		ImageLoader image;
+		if (!image.Load(filepath))
+			return false;
+
+		m_width = image.Width();
+		m_depth = image.Height();
+		const size_t numTexels{ (size_t)m_width * m_depth };
+
+		if (const UINT16* grey = image.GetGreyData16())
+		{
+			m_bitsPerSample = 16;
+			m_samples16.assign(grey, grey + numTexels);
+			m_samples8.clear();
+		}
+		else
+		{
+			// Heightmaps are grey so the red channel is all of it
+			m_bitsPerSample = 8;
+			m_samples8.resize(numTexels);
+			const BYTE* data{ image.GetData() };
+			for (size_t i = 0; i < numTexels; i++)
+				m_samples8[i] = data[i * 4];
+			m_samples16.clear();
+		}
+		m_samples8.shrink_to_fit();
+		m_samples16.shrink_to_fit();
+		return true;
+	}
+
+	float Heightfield::Texel(int x, int z) const
+	{
+		const size_t i{ (size_t)std::clamp(z, 0, m_depth - 1) * m_width + std::clamp(x, 0, m_width - 1) };
+		return m_bitsPerSample == 16 ? m_samples16[i] / 65535.0f : m_samples8[i] / 255.0f;
+	}
+
+	void Heightfield::ConvertRow(int z, float* row) const
+	{
+		int x{ 0 };
+		if (m_bitsPerSample == 16)
+		{
+			const uint16_t* samples{ m_samples16.data() + (size_t)z * m_width };
+#ifdef HEIGHTFIELD_USE_SSE
+			const __m128 scale{ _mm_set1_ps(1.0f / 65535.0f) };
+			const __m128i zero{ _mm_setzero_si128() };
+			for (; x + 8 <= m_width; x += 8)
+			{
+				const __m128i values{ _mm_loadu_si128((const __m128i*)(samples + x)) };
+				_mm_storeu_ps(row + x, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero)), scale));
+				_mm_storeu_ps(row + x + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero)), scale));
+			}
+#endif
+			for (; x < m_width; x++)
+				row[x] = samples[x] / 65535.0f;
+		}
+		else
+		{
+			const uint8_t* samples{ m_samples8.data() + (size_t)z * m_width };
+#ifdef HEIGHTFIELD_USE_SSE
+			const __m128 scale{ _mm_set1_ps(1.0f / 255.0f) };
+			const __m128i zero{ _mm_setzero_si128() };
+			for (; x + 8 <= m_width; x += 8)
+			{
+				const __m128i values{ _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(samples + x)), zero) };
+				_mm_storeu_ps(row + x, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero)), scale));
+				_mm_storeu_ps(row + x + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero)), scale));
+			}
+#endif
+			for (; x < m_width; x++)
+				row[x] = samples[x] / 255.0f;
+		}
+	}
+
+	void Heightfield::Resample(int gridWidth, int gridDepth, HeightfieldFilter filter, const HeightfieldRegion& region, float* out) const
+	{
+		if (region.Empty() || m_width == 0 || m_depth == 0)
+			return;
+
+		const int outWidth{ region.Width() };
+
+		// Taps of every output column, one array per tap so four columns load at once
+		std::vector<int> columnFirst(outWidth);
+		std::vector<float> columnWeights[kNumTaps];
+		for (std::vector<float>& weights : columnWeights)
+			weights.resize(outWidth);
+
+		for (int i = 0; i < outWidth; i++)
+		{
+			float weights[kNumTaps];
+			FilterTaps(std::clamp(region.firstX + i, 0, gridWidth - 1), gridWidth, m_width, filter, columnFirst[i], weights);
+			for (int tap = 0; tap < kNumTaps; tap++)
+				columnWeights[tap][i] = weights[tap];
+		}
+
+		// An image row padded with its edge texels, one before and two after, so taps never need clamping
+		std::vector<float> imageRow((size_t)m_width + kNumTaps - 1);
+
+		// Image rows already filtered along x. Output rows only move forwards so the four most recent are enough,
+		// and four neighbouring rows always land in different slots.
+		std::vector<float> filteredRows[kNumTaps];
+		int filteredRowOf[kNumTaps]{ -1, -1, -1, -1 };
+		for (std::vector<float>& row : filteredRows)
+			row.resize(outWidth);
+
+		auto filteredRow = [&](int z) -> const float* {
+			const int slot{ z & (kNumTaps - 1) };
+			std::vector<float>& filtered = filteredRows[slot];
+			if (filteredRowOf[slot] == z)
+				return filtered.data();
+
+			ConvertRow(z, imageRow.data() + 1);
+			imageRow[0] = imageRow[1];
+			imageRow[(size_t)m_width + 1] = imageRow[(size_t)m_width + 2] = imageRow[m_width];
+
+			// Shifted by one for the padding, so first texel -1 is index 0
+			const float* padded{ imageRow.data() + 1 };
+			int i{ 0 };
+#ifdef HEIGHTFIELD_USE_SSE
+			for (; i + 4 <= outWidth; i += 4)
+			{
+				__m128 sum{ _mm_setzero_ps() };
+				for (int tap = 0; tap < kNumTaps; tap++)
+				{
+					const __m128 texels{ _mm_set_ps(padded[columnFirst[i + 3] + tap], padded[columnFirst[i + 2] + tap],
+						padded[columnFirst[i + 1] + tap], padded[columnFirst[i] + tap]) };
+					sum = _mm_add_ps(sum, _mm_mul_ps(texels, _mm_loadu_ps(&columnWeights[tap][i])));
+				}
+				_mm_storeu_ps(&filtered[i], sum);
+			}
+#endif
+			for (; i < outWidth; i++)
+			{
+				float sum{ 0.0f };
+				for (int tap = 0; tap < kNumTaps; tap++)
+					sum += padded[columnFirst[i] + tap] * columnWeights[tap][i];
+				filtered[i] = sum;
+			}
+
+			filteredRowOf[slot] = z;
+			return filtered.data();
+		};
+
+		for (int j = 0; j < region.Depth(); j++)
+		{
+			int first;
+			float weights[kNumTaps];
+			FilterTaps(std::clamp(region.firstZ + j, 0, gridDepth - 1), gridDepth, m_depth, filter, first, weights);
+
+			const float* rows[kNumTaps];
+			for (int tap = 0; tap < kNumTaps; tap++)
+				rows[tap] = filteredRow(std::clamp(first + tap, 0, m_depth - 1));
+
+			// Bicubic can overshoot a little past the texels either side, heights stay within 0 to 1
+			float* outRow{ out + (size_t)j * outWidth };
+			int i{ 0 };
+#ifdef HEIGHTFIELD_USE_SSE
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 one{ _mm_set1_ps(1.0f) };
+			for (; i + 4 <= outWidth; i += 4)
+			{
+				__m128 sum{ _mm_mul_ps(_mm_loadu_ps(rows[0] + i), _mm_set1_ps(weights[0])) };
+				for (int tap = 1; tap < kNumTaps; tap++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[tap] + i), _mm_set1_ps(weights[tap])));
+				_mm_storeu_ps(outRow + i, _mm_min_ps(_mm_max_ps(sum, zero), one));
+			}
+#endif
+			for (; i < outWidth; i++)
+			{
+				float sum{ 0.0f };
+				for (int tap = 0; tap < kNumTaps; tap++)
+					sum += rows[tap][i] * weights[tap];
+				outRow[i] = std::clamp(sum, 0.0f, 1.0f);
+			}
+		}
+	}
+}
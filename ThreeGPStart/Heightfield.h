@@ -0,0 +1,69 @@
+#pragma once
+// A heightmap kept at the precision it was stored with and resampled to whatever grid a terrain needs
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// A rectangle of grid samples, the ends are one past the last column and row
+	struct HeightfieldRegion
+	{
+		int firstX{ 0 };
+		int firstZ{ 0 };
+		int endX{ 0 };
+		int endZ{ 0 };
+
+		int Width() const { return endX - firstX; }
+		int Depth() const { return endZ - firstZ; }
+		bool Empty() const { return endX <= firstX || endZ <= firstZ; }
+	};
+
+	// How samples between the image's texels are worked out
+	enum class HeightfieldFilter
+	{
+		// Closest texel, steps wherever the grid is finer than the image
+		Nearest,
+
+		// Straight lines between texels, continuous but creased at every texel
+		Bilinear,
+
+		// Catmull-Rom through the four nearest texels each way, smooth slopes as well as heights
+		Bicubic
+	};
+
+	const char* HeightfieldFilterName(HeightfieldFilter filter);
+
+	// Samples are 0 to 1. 16 bit grey scale images keep every bit, anything else keeps its red channel as 8 bits, a
+	// quarter of the RGBA8 the image loader decodes to. Resampling maps the image's corners onto the grid's corners so
+	// any resolution covers the same ground. Rows are worked out with SSE four columns at a time, filtering along
+	// each row first then down the columns, so the cost is per output sample rather than per image texel.
+	class Heightfield
+	{
+	private:
+		int m_width{ 0 };
+		int m_depth{ 0 };
+		int m_bitsPerSample{ 0 };
+		std::vector<uint8_t> m_samples8;
+		std::vector<uint16_t> m_samples16;
+
+		// One image row as 0 to 1 floats
+		void ConvertRow(int z, float* row) const;
+	public:
+		// Decode a heightmap image. Returns false on error.
+		bool Load(const std::string& filepath);
+
+		int Width() const { return m_width; }
+		int Depth() const { return m_depth; }
+
+		// 8 or 16
+		int BitsPerSample() const { return m_bitsPerSample; }
+		size_t Bytes() const { return m_samples8.size() + m_samples16.size() * sizeof(uint16_t); }
+
+		// The image's texel at x, z, clamped to its edges
+		float Texel(int x, int z) const;
+
+		// Resample to a grid of gridWidth x gridDepth samples and write the samples in region, row by row, to out.
+		// Region may reach past the grid, samples there repeat the grid's edge.
+		void Resample(int gridWidth, int gridDepth, HeightfieldFilter filter, const HeightfieldRegion& region, float* out) const;
+	};
+}
@@ -0,0 +1,149 @@
+#include "HeightfieldNormals.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <emmintrin.h>
+#define HEIGHTFIELD_NORMALS_USE_SSE
+#endif
+
+namespace Helpers
+{
+	namespace
+	{
+		// Fewer rows than this are not worth handing to another thread
+		constexpr int kMinRowsPerBand{ 16 };
+
+		struct Grid
+		{
+			const float* heights;
+			int width;
+			int depth;
+			float spacingX;
+			float spacingZ;
+		};
+
+		// (-dh/dx, 1, -dh/dz) normalised, the differences are already divided by their distance apart
+		void StoreNormal(float slopeX, float slopeZ, glm::vec3& normal)
+		{
+			const float inverseLength{ 1.0f / std::sqrt(slopeX * slopeX + slopeZ * slopeZ + 1.0f) };
+			normal = glm::vec3(slopeX * inverseLength, inverseLength, slopeZ * inverseLength);
+		}
+
+		void ComputeRows(const Grid& grid, int firstX, int endX, int firstZ, int endZ, glm::vec3* normals)
+		{
+			const int width{ grid.width };
+
+			// Interior columns, where both neighbours exist and are the same distance apart
+			const int firstInterior{ std::max(firstX, 1) };
+			const int endInterior{ std::max(std::min(endX, width - 1), firstInterior) };
+			const float interiorScaleX{ 1.0f / (2.0f * grid.spacingX) };
+
+			for (int z = firstZ; z < endZ; z++)
+			{
+				const int below{ std::max(z - 1, 0) };
+				const int above{ std::min(z + 1, grid.depth - 1) };
+				const float scaleZ{ above > below ? 1.0f / ((above - below) * grid.spacingZ) : 0.0f };
+
+				const float* row{ grid.heights + (size_t)z * width };
+				const float* rowBelow{ grid.heights + (size_t)below * width };
+				const float* rowAbove{ grid.heights + (size_t)above * width };
+				glm::vec3* rowNormals{ normals + (size_t)z * width };
+
+				// Edge columns fall back to the one neighbour they have
+				auto scalarNormal = [&](int x) {
+					const int left{ std::max(x - 1, 0) };
+					const int right{ std::min(x + 1, width - 1) };
+					const float slopeX{ right > left ? (row[left] - row[right]) / ((right - left) * grid.spacingX) : 0.0f };
+					StoreNormal(slopeX, (rowBelow[x] - rowAbove[x]) * scaleZ, rowNormals[x]);
+				};
+
+				for (int x = firstX; x < std::min(firstInterior, endX); x++)
+					scalarNormal(x);
+
+				int x{ firstInterior };
+#ifdef HEIGHTFIELD_NORMALS_USE_SSE
+				const __m128 scaleX4{ _mm_set1_ps(interiorScaleX) };
+				const __m128 scaleZ4{ _mm_set1_ps(scaleZ) };
+				const __m128 one{ _mm_set1_ps(1.0f) };
+
+				for (; x + 4 <= endInterior; x += 4)
+				{
+					const __m128 slopeX{ _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + x - 1), _mm_loadu_ps(row + x + 1)), scaleX4) };
+					const __m128 slopeZ{ _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(rowBelow + x), _mm_loadu_ps(rowAbove + x)), scaleZ4) };
+					const __m128 lengthSquared{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(slopeX, slopeX), _mm_mul_ps(slopeZ, slopeZ)), one) };
+					const __m128 inverseLength{ _mm_div_ps(one, _mm_sqrt_ps(lengthSquared)) };
+
+					// Four lanes of each component out to four xyz normals
+					alignas(16) float normalX[4], normalY[4], normalZ[4];
+					_mm_store_ps(normalX, _mm_mul_ps(slopeX, inverseLength));
+					_mm_store_ps(normalY, inverseLength);
+					_mm_store_ps(normalZ, _mm_mul_ps(slopeZ, inverseLength));
+					for (int lane = 0; lane < 4; lane++)
+						rowNormals[x + lane] = glm::vec3(normalX[lane], normalY[lane], normalZ[lane]);
+				}
+#endif
+
+				// Whatever does not fill a group of four
+				for (; x < endInterior; x++)
+					StoreNormal((row[x - 1] - row[x + 1]) * interiorScaleX, (rowBelow[x] - rowAbove[x]) * scaleZ, rowNormals[x]);
+
+				for (x = std::max(endInterior, firstX); x < endX; x++)
+					scalarNormal(x);
+			}
+		}
+	}
+
+	namespace HeightfieldNormals
+	{
+		void Compute(const float* heights, int width, int depth, float spacingX, float spacingZ, const HeightfieldRegion& region,
+			glm::vec3* normals, ThreadPool* pool)
+		{
+			const int firstX{ std::max(region.firstX, 0) };
+			const int firstZ{ std::max(region.firstZ, 0) };
+			const int endX{ std::min(region.endX, width) };
+			const int endZ{ std::min(region.endZ, depth) };
+			if (endX <= firstX || endZ <= firstZ)
+				return;
+
+			const Grid grid{ heights, width, depth, spacingX, spacingZ };
+			const int numRows{ endZ - firstZ };
+			const int numBands{ pool ? std::max(1, std::min((int)pool->NumThreads() + 1, numRows / kMinRowsPerBand)) : 1 };
+			if (numBands == 1)
+			{
+				ComputeRows(grid, firstX, endX, firstZ, endZ, normals);
+				return;
+			}
+
+			// Every band but the last goes to the workers, this thread does the last while it waits
+			std::mutex mutex;
+			std::condition_variable finished;
+			int numRemaining{ numBands - 1 };
+
+			for (int band = 0; band < numBands - 1; band++)
+			{
+				const int bandFirstZ{ firstZ + numRows * band / numBands };
+				const int bandEndZ{ firstZ + numRows * (band + 1) / numBands };
+				pool->Submit([&, bandFirstZ, bandEndZ]() {
+					ComputeRows(grid, firstX, endX, bandFirstZ, bandEndZ, normals);
+
+					std::lock_guard<std::mutex> lock(mutex);
+					if (--numRemaining == 0)
+						finished.notify_one();
+				});
+			}
+
+			ComputeRows(grid, firstX, endX, firstZ + numRows * (numBands - 1) / numBands, endZ, normals);
+
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock, [&] { return numRemaining == 0; });
+		}
+
+		HeightfieldRegion NormalsAffectedBy(const HeightfieldRegion& edited, int width, int depth)
+		{
+			if (edited.Empty())
+				return HeightfieldRegion{};
+
+			return HeightfieldRegion{ std::max(edited.firstX - 1, 0), std::max(edited.firstZ - 1, 0),
+				std::min(edited.endX + 1, width), std::min(edited.endZ + 1, depth) };
+		}
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+// Normals of a regular grid of heights, worked out straight from the heights a row at a time
+
+#include "ExternalLibraryHeaders.h"
+#include "Heightfield.h"
+#include "ThreadPool.h"
+
+namespace Helpers
+{
+	// Heights are row major, width samples per row. Columns are spacingX apart and rows spacingZ apart in world
+	// space, negative if rows run along -z. Each normal comes from central differences of its four neighbours, one
+	// sided at the edges of the grid, so unlike summing triangle normals nothing is written to more than once.
+	// Columns are done four at a time with SSE and bands of rows are split across the pool's workers.
+	namespace HeightfieldNormals
+	{
+		// Writes the normalised normals of every sample in region. Normals outside it are left alone, so after
+		// editing some heights only NormalsAffectedBy the edit need doing again. Runs on the calling thread if pool
+		// is null, otherwise waits for the workers, so must not be called from a job on the same pool.
+		void Compute(const float* heights, int width, int depth, float spacingX, float spacingZ, const HeightfieldRegion& region,
+			glm::vec3* normals, ThreadPool* pool = nullptr);
+
+		// Every sample in the grid
+		inline HeightfieldRegion All(int width, int depth) { return HeightfieldRegion{ 0, 0, width, depth }; }
+
+		// The samples whose normals read any height in edited, which is edited grown by one and clipped to the grid
+		HeightfieldRegion NormalsAffectedBy(const HeightfieldRegion& edited, int width, int depth);
+	}
+}
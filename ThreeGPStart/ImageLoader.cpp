@@ -79,18 +79,26 @@ namespace Helpers
 				const FREE_IMAGE_TYPE image_type{ FreeImage_GetImageType(bitmap) };
 				if (image_type == FIT_UINT16)
 				{
-					// FreeImage seems to have an issue converting 16 bit grey scale images to 32 so handling this manually
-					UINT16* textureData{ (UINT16*)FreeImage_GetBits(bitmap) };
-
+					// FreeImage seems to have an issue converting 16 bit grey scale images to 32 so handling this manually.
+					// The full samples are kept for heightmaps, the RGBA copy is rounded to the nearest 8 bit value.
+					// Rows are read one scan line at a time as they are padded to 4 bytes.
+					m_greyData16 = new UINT16[(size_t)m_width * (size_t)m_height];
 					m_data = new GLubyte[(size_t)m_width * (size_t)m_height * 4];
-					size_t count{ 0 };
-					for (size_t i = 0; i < (size_t)m_width * (size_t)m_height * 4; i += 4)
+					for (int y = 0; y < m_height; y++)
 					{
-						BYTE asByte = (BYTE)(textureData[count++] / 256.0f);
-						m_data[i] = m_data[i + 1] = m_data[i + 2] = asByte;
-						m_data[i + 3] = 255;
+						const UINT16* scanLine{ (const UINT16*)FreeImage_GetScanLine(bitmap, y) };
+						for (int x = 0; x < m_width; x++)
+						{
+							const size_t i{ (size_t)y * m_width + x };
+							m_greyData16[i] = scanLine[x];
+
+							const BYTE asByte{ (BYTE)((scanLine[x] + 128) / 257) };
+							m_data[i * 4] = m_data[i * 4 + 1] = m_data[i * 4 + 2] = asByte;
+							m_data[i * 4 + 3] = 255;
+						}
 					}
 
+					FreeImage_Unload(bitmap);
 					return true;
 				}
 
@@ -12,8 +12,9 @@ namespace Helpers
 		int m_width{ 0 };
 		int m_height{ 0 };
 		BYTE* m_data{ nullptr };
+		UINT16* m_greyData16{ nullptr };
 	public:
-		~ImageLoader() { delete []m_data; }
+		~ImageLoader() { delete []m_data; delete []m_greyData16; }
 
 		// Width in texels of the image
 		int Width() const { return m_width; }
@@ -27,6 +28,10 @@ namespace Helpers
 		// Allows access to the raw bytes that make up the image laid out in RGBA format (8 bits per channel)
 		BYTE* GetData() const { return m_data; }
 
+		// The full 16 bit samples of a 16 bit grey scale image, one per texel in the same order as GetData.
+		// Null for any other kind of image.
+		const UINT16* GetGreyData16() const { return m_greyData16; }
+
 		// Returns a grey scale value at provided uv, useful for RMA textures
 		BYTE GetGreyValue(float u, float v) const;
 	};
@@ -0,0 +1,128 @@
+#include "IndirectBatcher.h"
+#include <algorithm>
+
+namespace Helpers
+{
+	namespace
+	{
+		// Gives the buffer fresh storage of at least numBytes before it is written. The GPU may still be reading last
+		// frame's draws from the old storage, orphaning it lets the driver hand over a new block rather than stall.
+		void Orphan(GLenum target, GLuint buffer, size_t& capacity, size_t numBytes)
+		{
+			glBindBuffer(target, buffer);
+			if (numBytes > capacity)
+				capacity = std::max(numBytes, capacity * 2);
+			glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+		}
+	}
+
+	IndirectBatcher::~IndirectBatcher()
+	{
+		glDeleteBuffers(1, &m_commandBuffer);
+		glDeleteBuffers(1, &m_paramsBuffer);
+	}
+
+	void IndirectBatcher::Clear()
+	{
+		for (size_t b = 0; b < m_numBatches; b++)
+		{
+			m_batches[b].commands.clear();
+			m_batches[b].params.clear();
+		}
+		m_numBatches = 0;
+		m_allCommands.clear();
+		m_allParams.clear();
+	}
+
+	IndirectBatch& IndirectBatcher::FindBatch(VertexFormat format, GLenum indexType, GLuint texture)
+	{
+		for (size_t b = 0; b < m_numBatches; b++)
+		{
+			IndirectBatch& batch = m_batches[b];
+			if (batch.format == format && batch.indexType == indexType && batch.texture == texture)
+				return batch;
+		}
+
+		// Batches are reused between frames to keep their allocations
+		if (m_numBatches == m_batches.size())
+			m_batches.emplace_back();
+
+		IndirectBatch& batch = m_batches[m_numBatches++];
+		batch.format = format;
+		batch.indexType = indexType;
+		batch.texture = texture;
+		return batch;
+	}
+
+	void IndirectBatcher::Add(const GeometryAllocation& geometry, GLuint firstElement, GLuint numElements, GLuint texture,
+		const glm::mat4& modelXform, const glm::vec3& positionOffset, const glm::vec3& positionScale, bool octahedralNormals)
+	{
+		if (!geometry.valid || numElements == 0)
+			return;
+
+		IndirectBatch& batch = FindBatch(geometry.format, geometry.indexType, texture);
+
+		// The arena keeps index ranges 4 byte aligned so the byte offset is always a whole number of indices
+		DrawElementsIndirectCommand command;
+		command.count = numElements;
+		command.firstIndex = (GLuint)(geometry.indexByteOffset / IndexSize(geometry.indexType)) + firstElement;
+		command.baseVertex = geometry.baseVertex;
+		batch.commands.push_back(command);
+
+		IndirectDrawParams params;
+		params.modelXform = modelXform;
+		params.positionOffset = glm::vec4(positionOffset, 0.0f);
+		params.positionScale = glm::vec4(positionScale, octahedralNormals ? 1.0f : 0.0f);
+		batch.params.push_back(params);
+	}
+
+	size_t IndirectBatcher::Submit(const GeometryArena& arena, ShaderProgram& program, GLStateCache& state)
+	{
+		if (m_numBatches == 0)
+			return 0;
+
+		if (!m_commandBuffer)
+		{
+			glGenBuffers(1, &m_commandBuffer);
+			glGenBuffers(1, &m_paramsBuffer);
+		}
+
+		// Lay the batches out end to end so each is a contiguous range of both buffers
+		for (size_t b = 0; b < m_numBatches; b++)
+		{
+			m_allCommands.insert(m_allCommands.end(), m_batches[b].commands.begin(), m_batches[b].commands.end());
+			m_allParams.insert(m_allParams.end(), m_batches[b].params.begin(), m_batches[b].params.end());
+		}
+
+		const size_t commandBytes{ m_allCommands.size() * sizeof(DrawElementsIndirectCommand) };
+		Orphan(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer, m_commandCapacity, commandBytes);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commandBytes, m_allCommands.data());
+
+		const size_t paramsBytes{ m_allParams.size() * sizeof(IndirectDrawParams) };
+		Orphan(GL_SHADER_STORAGE_BUFFER, m_paramsBuffer, m_paramsCapacity, paramsBytes);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, paramsBytes, m_allParams.data());
+		state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_paramsBuffer);
+
+		// gl_DrawID restarts at 0 for every multi-draw, the shader adds this to find the batch's parameters
+		const int firstDrawHandle{ program.UniformHandle("first_draw") };
+
+		size_t firstDraw{ 0 };
+		for (size_t b = 0; b < m_numBatches; b++)
+		{
+			const IndirectBatch& batch = m_batches[b];
+
+			state.BindVertexArray(arena.Vao(batch.format));
+			state.BindTexture(0, GL_TEXTURE_2D, batch.texture);
+			program.Set(firstDrawHandle, (int)firstDraw);
+
+			glMultiDrawElementsIndirect(GL_TRIANGLES, batch.indexType,
+				(void*)(firstDraw * sizeof(DrawElementsIndirectCommand)), (GLsizei)batch.commands.size(), 0);
+
+			firstDraw += batch.commands.size();
+		}
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		return m_numBatches;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+// Collects static draws into indirect command and per-draw parameter buffers so they can be issued with glMultiDrawElementsIndirect
+
+#include "ExternalLibraryHeaders.h"
+#include "GeometryArena.h"
+#include "ShaderProgram.h"
+#include "GLStateCache.h"
+
+namespace Helpers
+{
+	// Layout of glMultiDrawElementsIndirect's commands
+	struct DrawElementsIndirectCommand
+	{
+		GLuint count{ 0 };
+		GLuint instanceCount{ 1 };
+		GLuint firstIndex{ 0 };
+		GLint baseVertex{ 0 };
+		GLuint baseInstance{ 0 };
+	};
+
+	// One per draw, std430 layout matching DrawParams in indirect_vertex_shader.vert
+	struct IndirectDrawParams
+	{
+		glm::mat4 modelXform{ 1 };
+
+		// w is unused
+		glm::vec4 positionOffset{ 0 };
+
+		// w is 1 when normals are octahedral encoded
+		glm::vec4 positionScale{ 1 };
+	};
+
+	// Draws that share a vertex format, index type and texture, issued as one multi-draw. The texture is per batch
+	// because GLSL only allows a sampler array to be indexed by a value that is the same across the whole draw call.
+	struct IndirectBatch
+	{
+		VertexFormat format{ VertexFormat::Float };
+		GLenum indexType{ GL_UNSIGNED_INT };
+		GLuint texture{ 0 };
+		std::vector<DrawElementsIndirectCommand> commands;
+		std::vector<IndirectDrawParams> params;
+	};
+
+	// Draws are added in the order they should be drawn within their batch. Submit uploads the commands and parameters
+	// for the frame and issues one glMultiDrawElementsIndirect per batch, the shader finds its parameters with gl_DrawID.
+	class IndirectBatcher
+	{
+	private:
+		std::vector<IndirectBatch> m_batches;
+		size_t m_numBatches{ 0 };
+
+		GLuint m_commandBuffer{ 0 };
+		GLuint m_paramsBuffer{ 0 };
+		size_t m_commandCapacity{ 0 };
+		size_t m_paramsCapacity{ 0 };
+
+		// Scratch for the whole frame's commands and parameters, batches end to end
+		std::vector<DrawElementsIndirectCommand> m_allCommands;
+		std::vector<IndirectDrawParams> m_allParams;
+
+		// Finds the batch for this combination, starting a new one if there is none yet
+		IndirectBatch& FindBatch(VertexFormat format, GLenum indexType, GLuint texture);
+	public:
+		IndirectBatcher() = default;
+		~IndirectBatcher();
+
+		IndirectBatcher(const IndirectBatcher&) = delete;
+		IndirectBatcher& operator=(const IndirectBatcher&) = delete;
+
+		// Forget last frame's draws, batch storage is kept
+		void Clear();
+
+		void Add(const GeometryAllocation& geometry, GLuint firstElement, GLuint numElements, GLuint texture,
+			const glm::mat4& modelXform, const glm::vec3& positionOffset, const glm::vec3& positionScale, bool octahedralNormals);
+
+		// The program must be in use with its other uniforms set. Returns the number of multi-draw calls made.
+		size_t Submit(const GeometryArena& arena, ShaderProgram& program, GLStateCache& state);
+	};
+}
@@ -0,0 +1,98 @@
+#include "InstanceBuffer.h"
+
+namespace Helpers
+{
+	InstanceBuffer::~InstanceBuffer()
+	{
+		glDeleteBuffers(1, &m_buffer);
+	}
+
+	void InstanceBuffer::MarkDirty(size_t begin, size_t end)
+	{
+		if (m_dirtyBegin == m_dirtyEnd)
+		{
+			m_dirtyBegin = begin;
+			m_dirtyEnd = end;
+		}
+		else
+		{
+			m_dirtyBegin = std::min(m_dirtyBegin, begin);
+			m_dirtyEnd = std::max(m_dirtyEnd, end);
+		}
+		m_boundsDirty = true;
+	}
+
+	void InstanceBuffer::Clear()
+	{
+		m_instances.clear();
+		m_dirtyBegin = m_dirtyEnd = 0;
+		m_boundsDirty = true;
+	}
+
+	size_t InstanceBuffer::Add(const InstanceData& instance)
+	{
+		m_instances.push_back(instance);
+		MarkDirty(m_instances.size() - 1, m_instances.size());
+		return m_instances.size() - 1;
+	}
+
+	void InstanceBuffer::Set(size_t index, const InstanceData& instance)
+	{
+		m_instances[index] = instance;
+		MarkDirty(index, index + 1);
+	}
+
+	size_t InstanceBuffer::Upload()
+	{
+		if (m_dirtyBegin == m_dirtyEnd)
+			return 0;
+
+		if (!m_buffer)
+			glGenBuffers(1, &m_buffer);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+
+		// Growing replaces the storage so everything has to go up, not just the dirty range
+		const size_t neededBytes{ m_instances.size() * sizeof(InstanceData) };
+		if (neededBytes > m_capacity)
+		{
+			m_capacity = std::max(neededBytes, m_capacity * 2);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, m_capacity, nullptr, GL_DYNAMIC_DRAW);
+			m_dirtyBegin = 0;
+			m_dirtyEnd = m_instances.size();
+		}
+
+		const size_t uploadBytes{ (m_dirtyEnd - m_dirtyBegin) * sizeof(InstanceData) };
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, m_dirtyBegin * sizeof(InstanceData), uploadBytes, m_instances.data() + m_dirtyBegin);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		m_dirtyBegin = m_dirtyEnd = 0;
+		return uploadBytes;
+	}
+
+	void InstanceBuffer::Bounds(glm::vec3& centre, float& radius)
+	{
+		if (m_boundsDirty)
+		{
+			m_boundsDirty = false;
+			m_boundsCentre = glm::vec3(0);
+			m_boundsRadius = 0;
+
+			if (!m_instances.empty())
+			{
+				glm::vec3 minExtents{ m_instances[0].modelXform[3] };
+				glm::vec3 maxExtents{ minExtents };
+				for (const InstanceData& instance : m_instances)
+				{
+					minExtents = glm::min(minExtents, glm::vec3(instance.modelXform[3]));
+					maxExtents = glm::max(maxExtents, glm::vec3(instance.modelXform[3]));
+				}
+				m_boundsCentre = (minExtents + maxExtents) * 0.5f;
+				m_boundsRadius = glm::distance(m_boundsCentre, maxExtents);
+			}
+		}
+
+		centre = m_boundsCentre;
+		radius = m_boundsRadius;
+	}
+}
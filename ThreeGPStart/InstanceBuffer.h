@@ -0,0 +1,60 @@
+#pragma once
+// Per-instance data for hardware instanced draws, kept on the CPU and uploaded only where it changed
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// std430 layout matching Instance in instanced_vertex_shader.vert
+	struct InstanceData
+	{
+		glm::mat4 modelXform{ 1 };
+		glm::vec4 tint{ 1 };
+	};
+
+	// Instances are read by the shader from a storage buffer indexed with gl_InstanceID. Static instances cost nothing
+	// per frame: Upload only sends the range touched since the last call, and nothing at all if no instance changed.
+	class InstanceBuffer
+	{
+	private:
+		GLuint m_buffer{ 0 };
+		size_t m_capacity{ 0 };
+
+		std::vector<InstanceData> m_instances;
+
+		// Instances changed since the last upload, begin == end if none
+		size_t m_dirtyBegin{ 0 };
+		size_t m_dirtyEnd{ 0 };
+
+		// Sphere around every instance's origin, for level of detail selection
+		glm::vec3 m_boundsCentre{ 0 };
+		float m_boundsRadius{ 0 };
+		bool m_boundsDirty{ false };
+
+		void MarkDirty(size_t begin, size_t end);
+	public:
+		InstanceBuffer() = default;
+		~InstanceBuffer();
+
+		InstanceBuffer(const InstanceBuffer&) = delete;
+		InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+		void Clear();
+
+		// Returns the instance's index
+		size_t Add(const InstanceData& instance);
+		void Set(size_t index, const InstanceData& instance);
+
+		// Sends changed instances to the GPU, returns the number of bytes uploaded
+		size_t Upload();
+
+		// Bind as a shader storage block, 0 until the first upload
+		GLuint Buffer() const { return m_buffer; }
+
+		size_t NumInstances() const { return m_instances.size(); }
+		const std::vector<InstanceData>& Instances() const { return m_instances; }
+
+		// Radius includes the instances' origins only, add the mesh's own radius
+		void Bounds(glm::vec3& centre, float& radius);
+	};
+}
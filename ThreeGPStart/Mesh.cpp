@@ -1,4 +1,13 @@
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshSimplifier.h"
+#include <chrono>
+#include <execution>
+#include <numeric>
+#include <mutex>
+#include <emmintrin.h>
+#include <assimp/DefaultLogger.hpp>
+#include <assimp/LogStream.hpp>
 //#include <math.h>
 //#define VERBOSE
 
@@ -7,6 +16,13 @@
 
 namespace Helpers
 {
+	using Clock = std::chrono::high_resolution_clock;
+
+	static float ElapsedMs(Clock::time_point start)
+	{
+		return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+	}
+
 	// Conversions from ASSIMP types
 	inline glm::vec4 aiColor4DToGlmVec4(aiColor4D col) { return glm::vec4(col.r, col.g, col.b, col.a); }
 	inline std::string aiStringToString(const aiString& str) { return std::string(str.C_Str()); }
@@ -49,57 +65,310 @@ namespace Helpers
 		return angles;
 	}
 
+	// Post processing for a profile, attribute specific steps are only added if that attribute is wanted
+	static unsigned int PostProcessSteps(const LoadOptions& options)
+	{
+		// Always needed to get a clean triangle list
+		unsigned int ppsteps = aiProcess_Triangulate |		// triangulate polygons with more than 3 edges
+			aiProcess_SortByPType |							// make 'clean' meshes which consist of a single typ of primitives
+			aiProcess_RemoveComponent |						// strip the attributes not asked for, see RemovedComponents
+			aiProcess_GlobalScale;							// KD: Needed for FBX which uses cm rather than metres
+
+		if (options.attributes & MeshAttribute_Normals)
+			ppsteps |= aiProcess_GenSmoothNormals;			// if no normals then create them
+
+		if (options.attributes & (MeshAttribute_UVs | MeshAttribute_ExtraUVs))
+			ppsteps |= aiProcess_GenUVCoords |				// convert spherical, cylindrical, box and planar mapping to proper UVs
+				aiProcess_TransformUVCoords;				// preprocess UV transformations (scaling, translation ...)
+
+		if (options.attributes & MeshAttribute_Tangents)
+			ppsteps |= aiProcess_CalcTangentSpace;			// calculate tangents and bitangents if possible
+
+		if (options.profile == LoadProfile::FastPreview)
+			return ppsteps;
+
+		ppsteps |= aiProcess_JoinIdenticalVertices |		// join identical vertices/ optimize indexing
+			aiProcess_ImproveCacheLocality |				// improve the cache locality of the output vertices
+			aiProcess_RemoveRedundantMaterials |			// remove redundant materials
+			aiProcess_OptimizeMeshes |						// join small meshes, if possible;
+			aiProcess_SplitLargeMeshes;						// split large, unrenderable meshes into submeshes
+
+		if (options.profile == LoadProfile::RuntimeOptimized)
+			return ppsteps;
+
+		ppsteps |= aiProcess_ValidateDataStructure |		// perform a full validation of the loader's output
+			aiProcess_FindDegenerates |						// remove degenerated polygons from the import
+			aiProcess_FindInvalidData |						// detect invalid model data, such as invalid normal vectors
+			aiProcess_FindInstances;						// search for instanced meshes and remove them by references to one master
+
+		return ppsteps;
+	}
+
+	// Components for aiProcess_RemoveComponent. Bones are never used so always go.
+	static unsigned int RemovedComponents(const LoadOptions& options)
+	{
+		unsigned int removed = aiComponent_BONEWEIGHTS | aiComponent_LIGHTS | aiComponent_CAMERAS;
+
+		if (!(options.attributes & MeshAttribute_Normals))
+			removed |= aiComponent_NORMALS;
+
+		if (!(options.attributes & MeshAttribute_Tangents))
+			removed |= aiComponent_TANGENTS_AND_BITANGENTS;
+
+		if (!(options.attributes & MeshAttribute_Colours))
+			removed |= aiComponent_COLORS;
+		else
+			for (unsigned int set = 1; set < AI_MAX_NUMBER_OF_COLOR_SETS; set++)
+				removed |= aiComponent_COLORSn(set);
+
+		// Keep uv set 0 and optionally set 1
+		const unsigned int firstUnusedUVSet{ (options.attributes & MeshAttribute_ExtraUVs) ? 2u :
+			(options.attributes & MeshAttribute_UVs) ? 1u : 0u };
+		if (firstUnusedUVSet == 0)
+			removed |= aiComponent_TEXCOORDS;
+		else
+			for (unsigned int set = firstUnusedUVSet; set < AI_MAX_NUMBER_OF_TEXTURECOORDS; set++)
+				removed |= aiComponent_TEXCOORDSn(set);
+
+		return removed;
+	}
+
+	// Receives ASSIMP log messages and picks out the step timings AI_CONFIG_GLOB_MEASURE_TIME writes e.g.
+	// "Debug, T0: END   `postprocess`, dt= 0.0012 s". Loads run on many threads so each thread has its own destination.
+	static thread_local std::vector<AssimpStepTiming>* t_stepTimings{ nullptr };
+
+	class StepTimingStream : public Assimp::LogStream
+	{
+	public:
+		void write(const char* message) override
+		{
+			if (!t_stepTimings)
+				return;
+
+			const char* end = strstr(message, "END   `");
+			if (!end)
+				return;
+
+			const char* name = end + strlen("END   `");
+			const char* nameEnd = strchr(name, '`');
+			if (!nameEnd)
+				return;
+
+			const char* dt = strstr(nameEnd, "dt= ");
+			if (!dt)
+				return;
+
+			t_stepTimings->push_back(AssimpStepTiming{ std::string(name, nameEnd), (float)(atof(dt + 4) * 1000.0) });
+		}
+	};
+
+	// ASSIMP only has one global logger. It is created on first use and only set to verbose (debug messages,
+	// which is where the timings go) while at least one load is measuring.
+	static std::mutex s_stepLoggerMutex;
+	static int s_numMeasuringSteps{ 0 };
+
+	static void BeginMeasuringSteps(std::vector<AssimpStepTiming>* timings)
+	{
+		{
+			std::lock_guard<std::mutex> lock(s_stepLoggerMutex);
+			if (s_numMeasuringSteps++ == 0)
+			{
+				static bool streamAttached{ false };
+				if (!streamAttached)
+				{
+					if (Assimp::DefaultLogger::isNullLogger())
+						Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE, 0);
+					Assimp::DefaultLogger::get()->attachStream(new StepTimingStream, Assimp::Logger::Debugging);
+					streamAttached = true;
+				}
+				Assimp::DefaultLogger::get()->setLogSeverity(Assimp::Logger::VERBOSE);
+			}
+		}
+		t_stepTimings = timings;
+	}
+
+	static void EndMeasuringSteps()
+	{
+		t_stepTimings = nullptr;
+
+		std::lock_guard<std::mutex> lock(s_stepLoggerMutex);
+		if (--s_numMeasuringSteps == 0)
+			Assimp::DefaultLogger::get()->setLogSeverity(Assimp::Logger::NORMAL);
+	}
+
+	// ASSIMP stores uvs as 3D vectors, narrow to 2D. Four at a time with SSE: 3 loads of xyz data shuffled into 2 stores of xy
+	static void NarrowUVs(const aiVector3D* source, glm::vec2* dest, size_t count)
+	{
+		static_assert(sizeof(aiVector3D) == 3 * sizeof(float) && sizeof(glm::vec2) == 2 * sizeof(float), "Unexpected vector layout");
+
+		const float* in = (const float*)source;
+		float* out = (float*)dest;
+
+		size_t v = 0;
+		for (; v + 4 <= count; v += 4, in += 12, out += 8)
+		{
+			const __m128 a = _mm_loadu_ps(in);		// x0 y0 z0 x1
+			const __m128 b = _mm_loadu_ps(in + 4);	// y1 z1 x2 y2
+			const __m128 c = _mm_loadu_ps(in + 8);	// z2 x3 y3 z3
+
+			const __m128 x1y1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 3, 3));	// x1 x1 y1 y1
+			_mm_storeu_ps(out, _mm_shuffle_ps(a, x1y1, _MM_SHUFFLE(2, 0, 1, 0)));	// x0 y0 x1 y1
+			_mm_storeu_ps(out + 4, _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2)));	// x2 y2 x3 y3
+		}
+
+		for (; v < count; v++)
+			dest[v] = glm::vec2(source[v].x, source[v].y);
+	}
+
+	// Copy one ASSIMP mesh into mine. Streams are sized once up front and copied in bulk.
+	static void ConvertAiMesh(const aiMesh* aimesh, unsigned int attributes, Mesh& newMesh)
+	{
+		static_assert(sizeof(aiVector3D) == sizeof(glm::vec3), "ASSIMP and glm vectors must match to bulk copy");
+
+		newMesh.name = aimesh->mName.C_Str();
+
+		const size_t numVertices{ aimesh->mNumVertices };
+
+		// The ai format of a vertex is the same as mine
+		newMesh.vertices.resize(numVertices);
+		memcpy(newMesh.vertices.data(), aimesh->mVertices, sizeof(glm::vec3) * numVertices);
+
+		// And the normals if there are any
+		if ((attributes & MeshAttribute_Normals) && aimesh->HasNormals())
+		{
+			newMesh.normals.resize(numVertices);
+			memcpy(newMesh.normals.data(), aimesh->mNormals, sizeof(glm::vec3) * numVertices);
+		}
+
+		// And texture coordinates
+		if ((attributes & MeshAttribute_UVs) && aimesh->HasTextureCoords(0))
+		{
+			newMesh.uvCoords.resize(numVertices);
+			NarrowUVs(aimesh->mTextureCoords[0], newMesh.uvCoords.data(), numVertices);
+		}
+
+		// Optional extras
+		if ((attributes & MeshAttribute_Tangents) && aimesh->HasTangentsAndBitangents())
+		{
+			newMesh.tangents.resize(numVertices);
+			memcpy(newMesh.tangents.data(), aimesh->mTangents, sizeof(glm::vec3) * numVertices);
+			newMesh.bitangents.resize(numVertices);
+			memcpy(newMesh.bitangents.data(), aimesh->mBitangents, sizeof(glm::vec3) * numVertices);
+		}
+
+		if ((attributes & MeshAttribute_Colours) && aimesh->HasVertexColors(0))
+		{
+			static_assert(sizeof(aiColor4D) == sizeof(glm::vec4), "ASSIMP and glm colours must match to bulk copy");
+			newMesh.colours.resize(numVertices);
+			memcpy(newMesh.colours.data(), aimesh->mColors[0], sizeof(glm::vec4) * numVertices);
+		}
+
+		if ((attributes & MeshAttribute_ExtraUVs) && aimesh->HasTextureCoords(1))
+		{
+			newMesh.uvCoords2.resize(numVertices);
+			NarrowUVs(aimesh->mTextureCoords[1], newMesh.uvCoords2.data(), numVertices);
+		}
+
+		// Faces contain the vertex indices and due to the flags I set before are always triangles
+		// Each face owns its own index array so this cannot be a single copy
+		newMesh.elements.resize((size_t)aimesh->mNumFaces * 3);
+		unsigned int* element = newMesh.elements.data();
+		for (unsigned int face = 0; face < aimesh->mNumFaces; face++)
+		{
+			EsAssert(aimesh->mFaces[face].mNumIndices == 3);
+			const unsigned int* indices = aimesh->mFaces[face].mIndices;
+			*element++ = indices[0];
+			*element++ = indices[1];
+			*element++ = indices[2];
+		}
+
+		// Material index
+		newMesh.materialIndex = aimesh->mMaterialIndex;
+	}
+
+	// Append one vertex stream of a mesh being merged, zero filling whichever side does not have the attribute
+	template <typename T>
+	static void AppendStream(std::vector<T>& target, size_t targetVertices, const std::vector<T>& source, size_t sourceVertices)
+	{
+		if (target.empty() && source.empty())
+			return;
+
+		target.resize(targetVertices);
+		if (source.empty())
+			target.resize(targetVertices + sourceVertices);
+		else
+			target.insert(target.end(), source.begin(), source.end());
+	}
+
+	static void AppendMesh(Mesh& target, const Mesh& source)
+	{
+		const size_t targetVertices{ target.vertices.size() };
+		const size_t sourceVertices{ source.vertices.size() };
+
+		// The first merge records where the target's own data is
+		if (target.submeshes.empty())
+			target.submeshes.push_back(Submesh{ target.name, 0, (unsigned int)target.elements.size(), 0, (unsigned int)targetVertices });
+		target.submeshes.push_back(Submesh{ source.name, (unsigned int)target.elements.size(), (unsigned int)source.elements.size(),
+			(unsigned int)targetVertices, (unsigned int)sourceVertices });
+
+		AppendStream(target.normals, targetVertices, source.normals, sourceVertices);
+		AppendStream(target.uvCoords, targetVertices, source.uvCoords, sourceVertices);
+		AppendStream(target.tangents, targetVertices, source.tangents, sourceVertices);
+		AppendStream(target.bitangents, targetVertices, source.bitangents, sourceVertices);
+		AppendStream(target.colours, targetVertices, source.colours, sourceVertices);
+		AppendStream(target.uvCoords2, targetVertices, source.uvCoords2, sourceVertices);
+		target.vertices.insert(target.vertices.end(), source.vertices.begin(), source.vertices.end());
+
+		target.elements.reserve(target.elements.size() + source.elements.size());
+		for (unsigned int index : source.elements)
+			target.elements.push_back(index + (unsigned int)targetVertices);
+	}
+
 	// Retrieve the dimensions of this mesh in local coordinates
-	void Mesh::GetLocalExtents(glm::vec3& minExtents, glm::vec3& maxExtents) const
+	void GetExtents(const std::vector<glm::vec3>& positions, glm::vec3& minExtents, glm::vec3& maxExtents)
 	{
-		if (vertices.empty())
+		if (positions.empty())
 			return;
 
-		minExtents.x = maxExtents.x = vertices[0].x;
-		minExtents.y = maxExtents.y = vertices[0].y;
-		minExtents.z = maxExtents.z = vertices[0].z;
+		minExtents = maxExtents = positions[0];
 
-		for (size_t i = 1; i < vertices.size(); i++)
+		for (size_t i = 1; i < positions.size(); i++)
 		{
-			minExtents.x = std::min(minExtents.x, vertices[i].x);
-			minExtents.y = std::min(minExtents.y, vertices[i].y);
-			minExtents.z = std::min(minExtents.z, vertices[i].z);
-
-			maxExtents.x = std::max(maxExtents.x, vertices[i].x);
-			maxExtents.y = std::max(maxExtents.y, vertices[i].y);
-			maxExtents.z = std::max(maxExtents.z, vertices[i].z);
+			minExtents = glm::min(minExtents, positions[i]);
+			maxExtents = glm::max(maxExtents, positions[i]);
 		}
 	}
 
+	void Mesh::GetLocalExtents(glm::vec3& minExtents, glm::vec3& maxExtents) const
+	{
+		GetExtents(vertices, minExtents, maxExtents);
+	}
+
 	// Load a 3D model form a provided file and path, return false on error
-	bool ModelLoader::LoadFromFile(const std::string& objFilename)
+	bool ModelLoader::LoadFromFile(const std::string& objFilename, const LoadOptions& options)
 	{
 		m_filename = objFilename;
+		m_options = options;
+		m_timings = LoadTimings();
+		m_optimizeReports.clear();
+
+		const auto loadStart = Clock::now();
 
 #if defined(VERBOSE)
 		std::cout << "\nUsing assimp to load: " << objFilename << std::endl;
 #endif
-		// Commom post processing steps - may slow load but make mesh better optimised
-		unsigned int ppsteps = aiProcess_CalcTangentSpace | // calculate tangents and bitangents if possible
-			aiProcess_JoinIdenticalVertices |				// join identical vertices/ optimize indexing
-			aiProcess_ValidateDataStructure |				// perform a full validation of the loader's output
-			aiProcess_ImproveCacheLocality |				// improve the cache locality of the output vertices
-			aiProcess_RemoveRedundantMaterials |			// remove redundant materials
-			aiProcess_FindDegenerates |						// remove degenerated polygons from the import
-			aiProcess_FindInvalidData |						// detect invalid model data, such as invalid normal vectors
-			aiProcess_GenUVCoords |							// convert spherical, cylindrical, box and planar mapping to proper UVs
-			aiProcess_TransformUVCoords |					// preprocess UV transformations (scaling, translation ...)
-			aiProcess_FindInstances |						// search for instanced meshes and remove them by references to one master
-			aiProcess_LimitBoneWeights |					// limit bone weights to 4 per vertex
-			aiProcess_OptimizeMeshes |						// join small meshes, if possible;
-			aiProcess_SplitByBoneCount |					// split meshes with too many bones.
-			aiProcess_GenSmoothNormals |					// generate smooth normal vectors if not existing
-			aiProcess_SplitLargeMeshes |					// split large, unrenderable meshes into submeshes
-			aiProcess_Triangulate |							// triangulate polygons with more than 3 edges
-			aiProcess_SortByPType |							// make 'clean' meshes which consist of a single typ of primitives
-			aiProcess_GenSmoothNormals |					// if no normals then create them
-			aiProcess_GlobalScale |							// KD: Needed for FBX which uses cm rather than metres
-			0;
+		const unsigned int ppsteps{ PostProcessSteps(options) };
+		const unsigned int removedComponents{ RemovedComponents(options) };
+
+		// A valid cooked cache means ASSIMP does not need to run at all
+		const uint64_t cacheKey{ m_useCache ? MeshCache::ComputeKey(objFilename, ppsteps, options) : 0 };
+		if (cacheKey && MeshCache::Load(objFilename, cacheKey, m_meshVector, m_materials, m_hierarchy))
+		{
+			m_timings.fromCache = true;
+			m_timings.totalMs = ElapsedMs(loadStart);
+			std::cout << "Loaded OK " << m_timings.ToString() << std::endl;
+			return true;
+		}
 
 		// Create an instance of the Importer class
 		Assimp::Importer importer;
@@ -110,13 +379,26 @@ namespace Helpers
 
 		// By removing all points and lines we guarantee a face will describe a 3 vertex triangle
 		importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT);
-		importer.SetPropertyInteger(AI_CONFIG_GLOB_MEASURE_TIME, 1);
+
+		// Strip anything the caller does not want before the other steps spend time on it
+		importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removedComponents);
+
+		if (options.measureSteps)
+			importer.SetPropertyInteger(AI_CONFIG_GLOB_MEASURE_TIME, 1);
 
 		// KD: Need to scale down FBX which uses cm rather than metres
 		if (objFilename.find(".fbx")!=std::string::npos)
 			importer.SetPropertyFloat(AI_CONFIG_GLOBAL_SCALE_FACTOR_KEY, 0.01f);
 
+		if (options.measureSteps)
+			BeginMeasuringSteps(&m_timings.assimpSteps);
+
+		auto stageStart = Clock::now();
 		const aiScene* scene = importer.ReadFile(objFilename.c_str(), ppsteps);
+		m_timings.parseMs = ElapsedMs(stageStart);
+
+		if (options.measureSteps)
+			EndMeasuringSteps();
 
 		if (!scene)
 		{
@@ -124,7 +406,50 @@ namespace Helpers
 			return false;
 		}
 
-		return PopulateFromAssimpScene(scene);
+		if (!PopulateFromAssimpScene(scene))
+			return false;
+
+		if (options.mergeMeshes)
+		{
+			stageStart = Clock::now();
+			MergeMeshes();
+			m_timings.mergeMs = ElapsedMs(stageStart);
+		}
+
+		// Simplification is by far the slowest part of a load so is done once here and then cached
+		if (options.generateLods)
+		{
+			stageStart = Clock::now();
+			std::for_each(std::execution::par, m_meshVector.begin(), m_meshVector.end(), [](Mesh& mesh) {
+				mesh.lods = GenerateLodChain(mesh.vertices, mesh.elements);
+			});
+			m_timings.lodMs = ElapsedMs(stageStart);
+		}
+
+		// After LOD generation so the simplified index lists are reordered and remapped along with the rest
+		if (options.optimizeMeshes)
+		{
+			stageStart = Clock::now();
+			m_optimizeReports.resize(m_meshVector.size());
+			std::vector<size_t> meshIds(m_meshVector.size());
+			std::iota(meshIds.begin(), meshIds.end(), 0);
+			std::for_each(std::execution::par, meshIds.begin(), meshIds.end(), [&](size_t i) {
+				m_optimizeReports[i] = OptimizeMesh(m_meshVector[i]);
+			});
+			m_timings.optimizeMs = ElapsedMs(stageStart);
+		}
+
+		if (cacheKey)
+		{
+			stageStart = Clock::now();
+			MeshCache::Save(objFilename, cacheKey, m_meshVector, m_materials, m_hierarchy);
+			m_timings.cacheWriteMs = ElapsedMs(stageStart);
+		}
+
+		m_timings.totalMs = ElapsedMs(loadStart);
+		std::cout << "Loaded OK " << m_timings.ToString() << std::endl;
+
+		return true;
 	}
 
 	// Parse the ASSIMP data into our format
@@ -145,6 +470,8 @@ namespace Helpers
 			return false;
 		}
 
+		auto stageStart = Clock::now();
+
 		// Materials are held scene wide and referenced in the part by id so need to grab here
 		m_materials.resize(scene->mNumMaterials);
 		for (unsigned int m = 0; m < scene->mNumMaterials; m++)
@@ -196,6 +523,8 @@ namespace Helpers
 #endif
 		}
 
+		m_timings.materialsMs = ElapsedMs(stageStart);
+
 		int hasBones{ 0 };
 		int hasTangents{ 0 };
 		int hasColourChannels{ 0 };
@@ -207,7 +536,7 @@ namespace Helpers
 		// http://assimp.sourceforge.net/lib_html/structai_mesh.html
 		for (unsigned int i = 0; i < scene->mNumMeshes; i++)
 		{
-			aiMesh* aimesh = scene->mMeshes[i];
+			const aiMesh* aimesh = scene->mMeshes[i];
 
 			if (aimesh->HasBones())
 				hasBones++;
@@ -217,55 +546,22 @@ namespace Helpers
 				hasMMoreThanOneUVChannel++;
 			if (aimesh->HasTangentsAndBitangents())
 				hasTangents++;
+		}
 
-			// Create my mesh part
-			m_meshVector.push_back(Mesh());
-			Mesh& newMesh = m_meshVector.back();
-
-			newMesh.name = aimesh->mName.C_Str();
-
-			//		std::cout << "Processing mesh with name: " + newMesh->name);
-
-					// Copy over all the vertices, ai format of a vertex is same as mine
-					// Probably be able to speed this all up at some point
-			for (size_t v = 0; v < aimesh->mNumVertices; v++)
-			{
-				glm::vec3 newV = *(glm::vec3*) & aimesh->mVertices[v];
-				newMesh.vertices.push_back(newV);
-			}
+		// Each ASSIMP mesh converts independently into its own pre-created slot so they can run in parallel
+		stageStart = Clock::now();
 
-			// And the normals if there are any
-			if (aimesh->HasNormals())
-			{
-				for (size_t v = 0; v < aimesh->mNumVertices; v++)
-				{
-					glm::vec3 newN = *(glm::vec3*) & aimesh->mNormals[v];
-					newMesh.normals.push_back(newN);
-				}
-			}
+		const size_t firstMesh{ m_meshVector.size() };
+		m_meshVector.resize(firstMesh + scene->mNumMeshes);
 
-			// And texture coordinates
-			if (aimesh->HasTextureCoords(0))
-			{
-				for (size_t v = 0; v < aimesh->mNumVertices; v++)
-				{
-					glm::vec2 newN = *(glm::vec2*) &aimesh->mTextureCoords[0][v];
-					
-					newMesh.uvCoords.push_back(newN);
-				}
-			}
+		std::vector<unsigned int> meshIds(scene->mNumMeshes);
+		std::iota(meshIds.begin(), meshIds.end(), 0);
+		std::for_each(std::execution::par, meshIds.begin(), meshIds.end(), [&](unsigned int i) {
+			ConvertAiMesh(scene->mMeshes[i], m_options.attributes, m_meshVector[firstMesh + i]);
+		});
 
-			// Faces contain the vertex indices and due to the flags I set before are always triangles
-			for (unsigned int face = 0; face < aimesh->mNumFaces; face++)
-			{
-				EsAssert(aimesh->mFaces[face].mNumIndices == 3);
-				for (int triInd = 0; triInd < 3; triInd++)
-					newMesh.elements.push_back(aimesh->mFaces[face].mIndices[triInd]);
-			}
+		m_timings.meshesMs = ElapsedMs(stageStart);
 
-			// Material index
-			newMesh.materialIndex = aimesh->mMaterialIndex;
-		}
 #if defined(VERBOSE)
 		if (hasBones)
 			std::cout << "Ignoring: One or more mesh have bones" << std::endl;
@@ -277,7 +573,12 @@ namespace Helpers
 			std::cout << "Ignoring: One or more mesh has tangents" << std::endl;
 #endif
 		// Hierarchy, ASSIMP calls these nodes
-		m_rootNode = RecurseCreateNode(scene->mRootNode, nullptr);
+		stageStart = Clock::now();
+		m_hierarchy.Clear();
+		RecurseCreateNode(scene->mRootNode, -1);
+		m_timings.hierarchyMs = ElapsedMs(stageStart);
+
+		stageStart = Clock::now();
 
 		for (size_t i = 0; i < scene->mNumAnimations; i++)
 		{
@@ -299,13 +600,15 @@ namespace Helpers
 				std::cout << "Node: " + aiStringToString(node->mNodeName) << std::endl;
 #endif
 
-				Node* internalNode{ RecurseFindNode(m_rootNode,aiStringToString(node->mNodeName)) };
-				if (!internalNode)
+				const int internalNode{ m_hierarchy.FindNode(aiStringToString(node->mNodeName)) };
+				if (internalNode < 0)
 				{
 					std::cout << "Failed to find internal node for channel animation" << std::endl;
 					continue;
 				}
 
+				NodeAnimation& animation = m_hierarchy.animations[internalNode];
+
 #if defined(VERBOSE)
 				std::cout << "Node has " + std::to_string(node->mNumPositionKeys) + " position keys" << std::endl;
 				std::cout << "Node has " + std::to_string(node->mNumRotationKeys) + " rotation keys" << std::endl;
@@ -317,7 +620,7 @@ namespace Helpers
 					double time = node->mPositionKeys[j].mTime;
 					aiVector3D val=node->mPositionKeys[j].mValue;
 
-					internalNode->translationAnimationKeys.push_back(AnimationData{ (float)time, aiVector3DToGlmVec3(val) });
+					animation.translationAnimationKeys.push_back(AnimationData{ (float)time, aiVector3DToGlmVec3(val) });
 				}
 
 				for (unsigned int j = 0; j < node->mNumRotationKeys; j++)
@@ -325,7 +628,7 @@ namespace Helpers
 					double time = node->mRotationKeys[j].mTime;
 					aiQuaternion val = node->mRotationKeys[j].mValue;
 
-					internalNode->translationAnimationKeys.push_back(AnimationData{ (float)time, aiQuaternionToEulerAngles(val) });					
+					animation.rotationAnimationKeys.push_back(AnimationData{ (float)time, aiQuaternionToEulerAngles(val) });
 				}
 
 				for (unsigned int j = 0; j < node->mNumScalingKeys; j++)
@@ -333,15 +636,15 @@ namespace Helpers
 					double time = node->mScalingKeys[j].mTime;
 					aiVector3D val = node->mScalingKeys[j].mValue;
 
-					internalNode->translationAnimationKeys.push_back(AnimationData{ (float)time, aiVector3DToGlmVec3(val) });
-				}				
+					animation.scaleAnimationKeys.push_back(AnimationData{ (float)time, aiVector3DToGlmVec3(val) });
+				}
 			}
 		}
 
-		std::cout << "Loaded OK" << std::endl;
+		m_timings.animationMs = ElapsedMs(stageStart);
 
 #if defined(VERBOSE)
-		RecurseOutputHierarchy(m_rootNode, 0);
+		OutputHierarchy();
 #endif
 
 #if defined(VERBOSE)
@@ -390,93 +693,220 @@ namespace Helpers
 		return true;
 	}
 
-	void ModelLoader::RecurseOutputHierarchy(Node* node, int depth)
+	void ModelLoader::MergeMeshes()
 	{
-		for (int i=0;i<depth;i++)
-			std::cout << " ";
+		const size_t numMeshes{ m_meshVector.size() };
+		if (numMeshes < 2)
+			return;
 
-		glm::vec3 tran = glm::vec3(node->transform[3]);
+		std::vector<glm::mat4> worldTransforms;
+		m_hierarchy.ComputeWorldTransforms(worldTransforms);
 
-		std::cout << "Node name: " << node->name << " Trans: " << tran.x << "," << tran.y << "," << tran.z << " Mesh: ";
-		for (unsigned int m : node->meshIndices)
-			std::cout << m << " ";
-		std::cout << std::endl;
+		// Anything under an animated node moves at runtime so has to stay separate
+		std::vector<char> animated(m_hierarchy.NumNodes(), 0);
+		for (size_t n = 0; n < m_hierarchy.NumNodes(); n++)
+		{
+			const NodeAnimation& animation = m_hierarchy.animations[n];
+			animated[n] = !animation.translationAnimationKeys.empty() || !animation.rotationAnimationKeys.empty() ||
+				!animation.scaleAnimationKeys.empty() || (m_hierarchy.parents[n] >= 0 && animated[m_hierarchy.parents[n]]);
+		}
 
-		for (auto n : node->childNodes)
-			RecurseOutputHierarchy(n, depth + 1);
-	}
+		// The node drawing each mesh. -1 means none so identity, -2 means animated or drawn by several nodes.
+		const int kNotMergeable{ -2 };
+		std::vector<int> owner(numMeshes, -1);
+		for (size_t n = 0; n < m_hierarchy.NumNodes(); n++)
+		{
+			const glm::uvec2 range{ m_hierarchy.meshRanges[n] };
+			for (unsigned int i = range.x; i < range.x + range.y; i++)
+			{
+				const unsigned int m{ m_hierarchy.meshIndices[i] };
+				owner[m] = (owner[m] == -1 && !animated[n]) ? (int)n : kNotMergeable;
+			}
+		}
 
-	Node* ModelLoader::RecurseFindNode(Node* node, const std::string& nodeName)
-	{
-		if (!node)
-			return nullptr;
+		// Each mergeable mesh joins the first earlier one with the same material and world transform. Meshes no node
+		// draws only join each other, a node's mesh absorbed into one would vanish from the hierarchy below.
+		std::vector<size_t> leader(numMeshes);
+		std::vector<size_t> leaders;
+		for (size_t m = 0; m < numMeshes; m++)
+		{
+			leader[m] = m;
+			if (owner[m] == kNotMergeable)
+				continue;
+
+			const glm::mat4 transform{ owner[m] >= 0 ? worldTransforms[owner[m]] : glm::mat4(1) };
+			for (size_t l : leaders)
+			{
+				const glm::mat4 leaderTransform{ owner[l] >= 0 ? worldTransforms[owner[l]] : glm::mat4(1) };
+				if ((owner[l] >= 0) == (owner[m] >= 0) && m_meshVector[l].materialIndex == m_meshVector[m].materialIndex &&
+					leaderTransform == transform)
+				{
+					leader[m] = l;
+					break;
+				}
+			}
 
-		if (node->name == nodeName)
-			return node;
+			if (leader[m] == m)
+				leaders.push_back(m);
+		}
 
-		Node* retVal{ nullptr };
-		for (auto child : node->childNodes)
+		std::vector<Mesh> merged;
+		std::vector<int> newIndex(numMeshes, -1);
+		for (size_t m = 0; m < numMeshes; m++)
 		{
-			retVal=RecurseFindNode(child, nodeName);
-			if (retVal)
-				break;
+			if (leader[m] == m)
+			{
+				newIndex[m] = (int)merged.size();
+				merged.push_back(std::move(m_meshVector[m]));
+			}
+			else
+			{
+				AppendMesh(merged[newIndex[leader[m]]], m_meshVector[m]);
+			}
 		}
 
-		return retVal;
+		if (merged.size() == numMeshes)
+		{
+			m_meshVector = std::move(merged);
+			return;
+		}
+
+#if defined(VERBOSE)
+		std::cout << "Merged " << numMeshes << " mesh into " << merged.size() << std::endl;
+#endif
+
+		// Nodes keep only the merged mesh, the others are drawn by the leader's node which has the same transform
+		std::vector<unsigned int> meshIndices;
+		for (size_t n = 0; n < m_hierarchy.NumNodes(); n++)
+		{
+			glm::uvec2& range = m_hierarchy.meshRanges[n];
+			const unsigned int first{ (unsigned int)meshIndices.size() };
+			for (unsigned int i = range.x; i < range.x + range.y; i++)
+			{
+				const unsigned int m{ m_hierarchy.meshIndices[i] };
+				if (newIndex[m] >= 0)
+					meshIndices.push_back(newIndex[m]);
+			}
+			range = glm::uvec2(first, (unsigned int)meshIndices.size() - first);
+		}
+		m_hierarchy.meshIndices = std::move(meshIndices);
+
+		m_meshVector = std::move(merged);
 	}
 
-	// Recursive node creation
-	Node* ModelLoader::RecurseCreateNode(aiNode* node, Node* parent)
+	void ModelLoader::OutputHierarchy() const
 	{
-		Node* newNode = new Node;
+		// Parents come first so depth can be worked out as we go
+		std::vector<int> depth(m_hierarchy.NumNodes(), 0);
+
+		for (size_t n = 0; n < m_hierarchy.NumNodes(); n++)
+		{
+			if (m_hierarchy.parents[n] >= 0)
+				depth[n] = depth[m_hierarchy.parents[n]] + 1;
+
+			for (int i = 0; i < depth[n]; i++)
+				std::cout << " ";
 
-		newNode->name = node->mName.C_Str();
-		newNode->parentNode = parent;
+			glm::vec3 tran = glm::vec3(m_hierarchy.localTransforms[n][3]);
 
-		for (size_t i = 0; i < node->mNumMeshes; i++)
-			newNode->meshIndices.push_back(node->mMeshes[i]);
+			std::cout << "Node name: " << m_hierarchy.names[n] << " Trans: " << tran.x << "," << tran.y << "," << tran.z << " Mesh: ";
+			const glm::uvec2 range{ m_hierarchy.meshRanges[n] };
+			for (unsigned int m = range.x; m < range.x + range.y; m++)
+				std::cout << m_hierarchy.meshIndices[m] << " ";
+			std::cout << std::endl;
+		}
+	}
+
+	// Recursive node creation, depth first so each subtree ends up contiguous
+	void ModelLoader::RecurseCreateNode(const aiNode* node, int parent)
+	{
+		const int index{ m_hierarchy.AddNode(node->mName.C_Str(), parent, aiMatrix4x4ToGlm(&node->mTransformation),
+			node->mMeshes, node->mNumMeshes) };
 
-		newNode->transform = aiMatrix4x4ToGlm(&node->mTransformation);
-		
 		for (size_t i = 0; i < node->mNumChildren; i++)
-			newNode->childNodes.emplace_back(RecurseCreateNode(node->mChildren[i], newNode));
+			RecurseCreateNode(node->mChildren[i], index);
+	}
+
+	int NodeHierarchy::AddNode(const std::string& name, int parent, const glm::mat4& localTransform,
+		const unsigned int* nodeMeshIndices, size_t numMeshIndices)
+	{
+		const int index{ (int)parents.size() };
 
-		return newNode;
+		names.push_back(name);
+		parents.push_back(parent);
+		localTransforms.push_back(localTransform);
+		meshRanges.push_back(glm::uvec2((unsigned int)meshIndices.size(), (unsigned int)numMeshIndices));
+		meshIndices.insert(meshIndices.end(), nodeMeshIndices, nodeMeshIndices + numMeshIndices);
+		animations.emplace_back();
+
+		// Keeps the first if the name is already used
+		nameToIndex.emplace(name, index);
+
+		return index;
 	}
 
-	// Recursive deletion of nodes
-	void ModelLoader::RecurseDeleteNode(Node* node)
+	int NodeHierarchy::FindNode(const std::string& name) const
 	{
-		if (!node)
-			return;
+		auto it = nameToIndex.find(name);
+		return it == nameToIndex.end() ? -1 : it->second;
+	}
 
-		for (Node* n : node->childNodes)
-			RecurseDeleteNode(n);
+	void NodeHierarchy::ComputeWorldTransforms(std::vector<glm::mat4>& worldTransforms) const
+	{
+		worldTransforms.resize(parents.size());
+		for (size_t n = 0; n < parents.size(); n++)
+		{
+			if (parents[n] < 0)
+				worldTransforms[n] = localTransforms[n];
+			else
+				worldTransforms[n] = worldTransforms[parents[n]] * localTransforms[n];
+		}
+	}
 
-		delete node;
+	void NodeHierarchy::RebuildNameLookup()
+	{
+		nameToIndex.clear();
+		nameToIndex.reserve(names.size());
+		for (size_t n = 0; n < names.size(); n++)
+			nameToIndex.emplace(names[n], (int)n);
+	}
+
+	void NodeHierarchy::Clear()
+	{
+		names.clear();
+		parents.clear();
+		localTransforms.clear();
+		meshRanges.clear();
+		meshIndices.clear();
+		animations.clear();
+		nameToIndex.clear();
 	}
 
 	// Retrieve the dimensions of this model in local coordinates
 	void ModelLoader::GetLocalExtents(glm::vec3& minExtents, glm::vec3& maxExtents) const
 	{
-		if (m_meshVector.empty())
-			return;
-
-		m_meshVector[0].GetLocalExtents(minExtents, maxExtents);
+		bool first{ true };
 
-		for (size_t i = 1; i < m_meshVector.size(); i++)
+		for (const Mesh& mesh : m_meshVector)
 		{
+			if (mesh.vertices.empty())
+				continue;
+
 			glm::vec3 newMin;
 			glm::vec3 newMax;
-			m_meshVector[0].GetLocalExtents(newMin, newMax);
-
-			minExtents.x = std::min(minExtents.x, newMin.x);
-			minExtents.y = std::min(minExtents.y, newMin.y);
-			minExtents.z = std::min(minExtents.z, newMin.z);
+			mesh.GetLocalExtents(newMin, newMax);
 
-			maxExtents.x = std::max(maxExtents.x, newMax.x);
-			maxExtents.y = std::max(maxExtents.y, newMax.y);
-			maxExtents.z = std::max(maxExtents.z, newMax.z);
+			if (first)
+			{
+				minExtents = newMin;
+				maxExtents = newMax;
+				first = false;
+			}
+			else
+			{
+				minExtents = glm::min(minExtents, newMin);
+				maxExtents = glm::max(maxExtents, newMax);
+			}
 		}
 	}
-}
\ No newline at end of file
+}
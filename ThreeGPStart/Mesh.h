@@ -3,6 +3,8 @@
 
 #include "ExternalLibraryHeaders.h"
 #include "Helper.h"
+#include "MeshOptimizer.h"
+#include <unordered_map>
 
 namespace Helpers
 {
@@ -49,6 +51,75 @@ namespace Helpers
 		}
 	};
 
+	// Vertex attributes a caller can ask ModelLoader to keep, positions are always loaded
+	// Anything not asked for is stripped before ASSIMP post processing so no work is done on it
+	enum MeshAttribute : unsigned int
+	{
+		MeshAttribute_Normals = 1 << 0,
+		MeshAttribute_UVs = 1 << 1,
+		MeshAttribute_Tangents = 1 << 2,	// tangents and bitangents, requires normals and uvs
+		MeshAttribute_Colours = 1 << 3,		// first vertex colour set
+		MeshAttribute_ExtraUVs = 1 << 4,	// second uv set
+
+		MeshAttribute_Default = MeshAttribute_Normals | MeshAttribute_UVs
+	};
+
+	// How much optimisation ASSIMP should do while loading
+	enum class LoadProfile
+	{
+		// Just enough to get renderable triangles, no vertex welding or cache optimisation
+		FastPreview,
+
+		// Welded vertices, optimised indices and merged mesh. Suitable for loading at runtime.
+		RuntimeOptimized,
+
+		// Everything in RuntimeOptimized plus validation and clean up of bad data. Use when building the mesh cache offline.
+		OfflineCook
+	};
+
+	// What a caller needs from ModelLoader::LoadFromFile
+	struct LoadOptions
+	{
+		// Combination of MeshAttribute flags
+		unsigned int attributes{ MeshAttribute_Default };
+
+		LoadProfile profile{ LoadProfile::RuntimeOptimized };
+
+		// Capture ASSIMP's own per step timings into LoadTimings::assimpSteps
+		bool measureSteps{ false };
+
+		// Build Mesh::lods for every mesh
+		bool generateLods{ false };
+
+		// Reorder indices and vertices for the post transform cache, overdraw and vertex fetch
+		bool optimizeMeshes{ false };
+
+		// Concatenate meshes that share a material and a static world transform into one, see Mesh::submeshes
+		bool mergeMeshes{ false };
+	};
+
+	// A simplified version of a mesh that indexes the same vertices
+	struct MeshLod
+	{
+		std::vector<unsigned int> elements;
+
+		// Largest object space distance from the full detail surface
+		float error{ 0 };
+	};
+
+	// Where one of the original meshes ended up inside a merged mesh
+	struct Submesh
+	{
+		std::string name;
+		unsigned int firstElement{ 0 };
+		unsigned int numElements{ 0 };
+		unsigned int firstVertex{ 0 };
+		unsigned int numVertices{ 0 };
+	};
+
+	// Axis aligned box around a set of positions, left untouched if there are none
+	void GetExtents(const std::vector<glm::vec3>& positions, glm::vec3& minExtents, glm::vec3& maxExtents);
+
 	// Data container for a mesh
 	// A model can be made up of a number of mesh
 	struct Mesh
@@ -61,12 +132,24 @@ namespace Helpers
 		std::vector<glm::vec3> normals;
 		std::vector<glm::vec2> uvCoords;
 
+		// Only filled if asked for in LoadOptions::attributes and the model provides them
+		std::vector<glm::vec3> tangents;
+		std::vector<glm::vec3> bitangents;
+		std::vector<glm::vec4> colours;
+		std::vector<glm::vec2> uvCoords2;
+
 		// Elements
 		std::vector<unsigned int> elements;
 
+		// Progressively simpler versions of elements, only filled if LoadOptions::generateLods was set
+		std::vector<MeshLod> lods;
+
 		// Index into the material vector held by the ModelLoader
 		size_t materialIndex{ 0 };
 
+		// Only filled if this mesh was merged from two or more, e.g. for picking the original part
+		std::vector<Submesh> submeshes;
+
 		// Retrieve the dimensions of this mesh in local model coordinates
 		void GetLocalExtents(glm::vec3& minExtents, glm::vec3& maxExtents) const;
 
@@ -78,27 +161,113 @@ namespace Helpers
 				" Num verts: " + std::to_string(vertices.size()) + "\n" +
 				" Num normals: " + std::to_string(normals.size()) + "\n" +
 				" Num uv coords: " + std::to_string(uvCoords.size()) + "\n" +
-				" Num indices: " + std::to_string(elements.size());
+				" Num indices: " + std::to_string(elements.size()) + "\n" +
+				" Num LODs: " + std::to_string(lods.size()) + "\n" +
+				" Num submeshes: " + std::to_string(submeshes.size());
 		}
 	};	
 
-	// A mesh can contain a hierarchy in a tree structure
-	// Each entry is a Node
-	struct Node
+	// Animation keys for one node
+	struct NodeAnimation
 	{
-		std::string name;
-		glm::mat4 transform{ 1 };
-		std::vector<unsigned int> meshIndices;
-
-		Node* parentNode{ nullptr };
-		std::vector<Node*> childNodes;
-
-		// Animations
 		std::vector<AnimationData> translationAnimationKeys;
 		std::vector<AnimationData> rotationAnimationKeys;
 		std::vector<AnimationData> scaleAnimationKeys;
 	};
 
+	// A mesh can contain a hierarchy of nodes, stored here as parallel arrays indexed by node.
+	// Nodes are in depth first order so a parent always comes before its children and a whole
+	// subtree is contiguous. Index 0 is the root.
+	struct NodeHierarchy
+	{
+		std::vector<std::string> names;
+
+		// -1 for the root
+		std::vector<int> parents;
+		std::vector<glm::mat4> localTransforms;
+
+		// x = first entry in meshIndices, y = count
+		std::vector<glm::uvec2> meshRanges;
+		std::vector<unsigned int> meshIndices;
+
+		std::vector<NodeAnimation> animations;
+
+		// Names are not guaranteed unique, a lookup finds the first in depth first order
+		std::unordered_map<std::string, int> nameToIndex;
+
+		size_t NumNodes() const { return parents.size(); }
+		bool Empty() const { return parents.empty(); }
+
+		// Append a node, the parent must already have been added. Returns the new index.
+		int AddNode(const std::string& name, int parent, const glm::mat4& localTransform, const unsigned int* nodeMeshIndices, size_t numMeshIndices);
+
+		// -1 if there is no node with this name
+		int FindNode(const std::string& name) const;
+
+		// One linear pass, world = parent world * local
+		void ComputeWorldTransforms(std::vector<glm::mat4>& worldTransforms) const;
+
+		// Recreate nameToIndex after the arrays have been filled directly e.g. from the mesh cache
+		void RebuildNameLookup();
+
+		void Clear();
+	};
+
+	// One step as timed by ASSIMP itself
+	struct AssimpStepTiming
+	{
+		std::string step;
+		float ms{ 0 };
+	};
+
+	// Where the time went during ModelLoader::LoadFromFile, all in milliseconds
+	struct LoadTimings
+	{
+		// True if loaded from the binary mesh cache, in which case only totalMs is set
+		bool fromCache{ false };
+
+		// ASSIMP import and post processing
+		float parseMs{ 0 };
+
+		// Conversion of the ASSIMP scene into our format
+		float materialsMs{ 0 };
+		float meshesMs{ 0 };
+		float hierarchyMs{ 0 };
+		float animationMs{ 0 };
+		float mergeMs{ 0 };
+		float lodMs{ 0 };
+		float optimizeMs{ 0 };
+
+		float cacheWriteMs{ 0 };
+		float totalMs{ 0 };
+
+		// Only filled if LoadOptions::measureSteps was set, in the order ASSIMP finished them
+		std::vector<AssimpStepTiming> assimpSteps;
+
+		std::string ToString() const {
+			if (fromCache)
+				return "(cache) Total: " + std::to_string(totalMs) + "ms";
+			return "Parse: " + std::to_string(parseMs) + "ms" +
+				" Materials: " + std::to_string(materialsMs) + "ms" +
+				" Mesh: " + std::to_string(meshesMs) + "ms" +
+				" Nodes: " + std::to_string(hierarchyMs) + "ms" +
+				" Animation: " + std::to_string(animationMs) + "ms" +
+				" Merge: " + std::to_string(mergeMs) + "ms" +
+				" LODs: " + std::to_string(lodMs) + "ms" +
+				" Optimise: " + std::to_string(optimizeMs) + "ms" +
+				" Cache write: " + std::to_string(cacheWriteMs) + "ms" +
+				" Total: " + std::to_string(totalMs) + "ms" +
+				AssimpStepsToString();
+		}
+
+		std::string AssimpStepsToString() const {
+			std::string steps;
+			for (const AssimpStepTiming& timing : assimpSteps)
+				steps += "\n  ASSIMP " + timing.step + ": " + std::to_string(timing.ms) + "ms";
+			return steps;
+		}
+	};
+
 	// Helper to load model data into mesh and material structures
 	class ModelLoader
 	{
@@ -107,35 +276,51 @@ namespace Helpers
 		std::vector<Mesh> m_meshVector;
 		std::vector<Material> m_materials;
 
-		Node* m_rootNode{ nullptr };
+		NodeHierarchy m_hierarchy;
+
+		LoadOptions m_options;
+		LoadTimings m_timings;
+
+		// One per mesh when LoadOptions::optimizeMeshes was set and the model did not come from the cache
+		std::vector<MeshOptimizeReport> m_optimizeReports;
+
+		// Use the cooked binary cache in place of ASSIMP when it is still valid
+		bool m_useCache{ true };
 
 		bool PopulateFromAssimpScene(const aiScene* scene);
 
-		// Recursive
-		Node* RecurseCreateNode(aiNode* node, Node* parent);
-		void RecurseDeleteNode(Node* node);
-		Node* RecurseFindNode(Node* node, const std::string& nodeName);
-		void RecurseOutputHierarchy(Node* node, int depth);
+		// Recursive, appends the node and its children to m_hierarchy
+		void RecurseCreateNode(const aiNode* node, int parent);
+		void OutputHierarchy() const;
+
+		// Implements LoadOptions::mergeMeshes
+		void MergeMeshes();
 	public:
 		ModelLoader() = default;
-		~ModelLoader() { RecurseDeleteNode(m_rootNode); }
 
 		// Load a 3D model form a provided file and path, return false on error
-		bool LoadFromFile(const std::string& objFilename);
+		bool LoadFromFile(const std::string& objFilename, const LoadOptions& options = LoadOptions());
+
+		// Turn the binary mesh cache on or off, on by default. Must be called before LoadFromFile.
+		void SetUseCache(bool useCache) { m_useCache = useCache; }
 
 		// Retrieves the collection of mesh loaded from the 3D model
 		std::vector<Mesh>& GetMeshVector() { return m_meshVector; }
 
+		// Per stage timings of the last LoadFromFile
+		const LoadTimings& GetLoadTimings() const { return m_timings; }
+
+		// Vertex cache figures from the last load, empty if no optimisation ran
+		const std::vector<MeshOptimizeReport>& GetOptimizeReports() const { return m_optimizeReports; }
+
 		// Retrieves the collection of materials loaded from the 3D model
 		const std::vector<Material>& GetMaterialVector() const { return m_materials; }
 
-		// For a mesh heirarchy this is the root.
-		Node* GetRootNode() { return m_rootNode; }
+		// The node hierarchy, empty if the model has none
+		const NodeHierarchy& GetHierarchy() const { return m_hierarchy; }
 
-		// Retrieve a specific node by name
-		Node* FindNode(const std::string& nodeName) {
-			return RecurseFindNode(m_rootNode, nodeName);
-		}
+		// Retrieve a specific node's index by name, -1 if not found
+		int FindNode(const std::string& nodeName) const { return m_hierarchy.FindNode(nodeName); }
 
 		// Retrieve the dimensions of this model in local model coordinates
 		void GetLocalExtents(glm::vec3& minExtents, glm::vec3& maxExtents) const;
@@ -0,0 +1,542 @@
+#include "MeshCache.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+namespace fs = std::filesystem;
+
+namespace Helpers
+{
+	namespace
+	{
+		// Bump whenever the layout below changes so old caches get rebuilt
+		constexpr uint32_t kCacheVersion{ 5 };
+		constexpr char kCacheMagic[4]{ 'M', 'S', 'H', 'C' };
+
+		struct CacheHeader
+		{
+			char magic[4];
+			uint32_t version;
+			uint64_t key;
+			uint32_t numMeshes;
+			uint32_t numMaterials;
+		};
+
+		// 64 bit FNV-1a
+		constexpr uint64_t kFnvOffset{ 14695981039346656037ull };
+		constexpr uint64_t kFnvPrime{ 1099511628211ull };
+
+		uint64_t Fnv1a(const char* data, size_t size, uint64_t hash = kFnvOffset)
+		{
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= (unsigned char)data[i];
+				hash *= kFnvPrime;
+			}
+			return hash;
+		}
+
+		// Read only view of a whole file, unmapped on destruction
+		class MappedFile
+		{
+		private:
+			HANDLE m_file{ INVALID_HANDLE_VALUE };
+			HANDLE m_mapping{ nullptr };
+			const char* m_data{ nullptr };
+			size_t m_size{ 0 };
+		public:
+			explicit MappedFile(const std::string& filepath)
+			{
+				m_file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (m_file == INVALID_HANDLE_VALUE)
+					return;
+
+				LARGE_INTEGER size;
+				if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+					return;
+
+				m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (!m_mapping)
+					return;
+
+				m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+				if (m_data)
+					m_size = (size_t)size.QuadPart;
+			}
+
+			~MappedFile()
+			{
+				if (m_data)
+					UnmapViewOfFile(m_data);
+				if (m_mapping)
+					CloseHandle(m_mapping);
+				if (m_file != INVALID_HANDLE_VALUE)
+					CloseHandle(m_file);
+			}
+
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			const char* Data() const { return m_data; }
+			size_t Size() const { return m_size; }
+		};
+
+		// Bounds checked cursor over the mapped cache, any overrun marks the whole read as failed
+		class CacheReader
+		{
+		private:
+			const char* m_cursor;
+			const char* m_end;
+			bool m_ok{ true };
+		public:
+			CacheReader(const char* data, size_t size) : m_cursor(data), m_end(data + size) {}
+
+			bool Ok() const { return m_ok; }
+
+			bool Read(void* dest, size_t numBytes)
+			{
+				if (!m_ok || (size_t)(m_end - m_cursor) < numBytes)
+				{
+					m_ok = false;
+					return false;
+				}
+				memcpy(dest, m_cursor, numBytes);
+				m_cursor += numBytes;
+				return true;
+			}
+
+			template<typename T>
+			T Value()
+			{
+				T value{};
+				Read(&value, sizeof(T));
+				return value;
+			}
+
+			std::string String()
+			{
+				const uint32_t length{ Value<uint32_t>() };
+				std::string str;
+				if (m_ok && (size_t)(m_end - m_cursor) >= length)
+					str.assign(m_cursor, length);
+				else
+					m_ok = false;
+				if (m_ok)
+					m_cursor += length;
+				return str;
+			}
+
+			// Count of items that each take at least minBytesEach, 0 and failed if the rest of the file is too short
+			uint32_t Count(size_t minBytesEach)
+			{
+				const uint32_t count{ Value<uint32_t>() };
+				if (!m_ok || (size_t)(m_end - m_cursor) / minBytesEach < count)
+				{
+					m_ok = false;
+					return 0;
+				}
+				return count;
+			}
+
+			// Vectors are stored as a count followed by the raw elements so a read is a single copy
+			template<typename T>
+			void Vector(std::vector<T>& dest)
+			{
+				const uint32_t count{ Value<uint32_t>() };
+				if (!m_ok || (size_t)(m_end - m_cursor) / sizeof(T) < count)
+				{
+					m_ok = false;
+					return;
+				}
+				dest.resize(count);
+				Read(dest.data(), sizeof(T) * count);
+			}
+		};
+
+		class CacheWriter
+		{
+		private:
+			std::ofstream& m_out;
+		public:
+			explicit CacheWriter(std::ofstream& out) : m_out(out) {}
+
+			template<typename T>
+			void Value(const T& value) { m_out.write((const char*)&value, sizeof(T)); }
+
+			void String(const std::string& str)
+			{
+				Value((uint32_t)str.size());
+				m_out.write(str.data(), str.size());
+			}
+
+			template<typename T>
+			void Vector(const std::vector<T>& vec)
+			{
+				Value((uint32_t)vec.size());
+				m_out.write((const char*)vec.data(), sizeof(T) * vec.size());
+			}
+		};
+
+		// The hierarchy is already flat so each array is written whole, animations follow per node
+		void WriteHierarchy(CacheWriter& writer, const NodeHierarchy& hierarchy)
+		{
+			writer.Value((uint32_t)hierarchy.NumNodes());
+			for (const std::string& name : hierarchy.names)
+				writer.String(name);
+			writer.Vector(hierarchy.parents);
+			writer.Vector(hierarchy.localTransforms);
+			writer.Vector(hierarchy.meshRanges);
+			writer.Vector(hierarchy.meshIndices);
+			for (const NodeAnimation& animation : hierarchy.animations)
+			{
+				writer.Vector(animation.translationAnimationKeys);
+				writer.Vector(animation.rotationAnimationKeys);
+				writer.Vector(animation.scaleAnimationKeys);
+			}
+		}
+
+		void ReadHierarchy(CacheReader& reader, NodeHierarchy& hierarchy)
+		{
+			const uint32_t numNodes{ reader.Count(sizeof(uint32_t)) };
+			if (!reader.Ok())
+				return;
+
+			hierarchy.names.resize(numNodes);
+			for (std::string& name : hierarchy.names)
+				name = reader.String();
+			reader.Vector(hierarchy.parents);
+			reader.Vector(hierarchy.localTransforms);
+			reader.Vector(hierarchy.meshRanges);
+			reader.Vector(hierarchy.meshIndices);
+
+			hierarchy.animations.resize(numNodes);
+			for (NodeAnimation& animation : hierarchy.animations)
+			{
+				reader.Vector(animation.translationAnimationKeys);
+				reader.Vector(animation.rotationAnimationKeys);
+				reader.Vector(animation.scaleAnimationKeys);
+			}
+
+			hierarchy.RebuildNameLookup();
+		}
+
+		// True if n is 0 or the vertex count, attributes are either missing or one per vertex
+		bool PerVertex(size_t n, size_t numVertices)
+		{
+			return n == 0 || n == numVertices;
+		}
+
+		bool ElementsInRange(const std::vector<unsigned int>& elements, size_t numVertices)
+		{
+			return elements.size() % 3 == 0 &&
+				std::all_of(elements.begin(), elements.end(), [numVertices](unsigned int index) { return index < numVertices; });
+		}
+
+		// Everything the loader, optimiser and upload index with, so a damaged cache cannot send them out of range
+		bool MeshInRange(const Mesh& mesh, size_t numMaterials)
+		{
+			const size_t numVertices{ mesh.vertices.size() };
+			if (!PerVertex(mesh.normals.size(), numVertices) || !PerVertex(mesh.uvCoords.size(), numVertices) ||
+				!PerVertex(mesh.tangents.size(), numVertices) || !PerVertex(mesh.bitangents.size(), numVertices) ||
+				!PerVertex(mesh.colours.size(), numVertices) || !PerVertex(mesh.uvCoords2.size(), numVertices))
+				return false;
+
+			if (mesh.materialIndex >= numMaterials || !ElementsInRange(mesh.elements, numVertices))
+				return false;
+
+			for (const MeshLod& lod : mesh.lods)
+				if (!ElementsInRange(lod.elements, numVertices))
+					return false;
+
+			for (const Submesh& submesh : mesh.submeshes)
+				if ((uint64_t)submesh.firstElement + submesh.numElements > mesh.elements.size() ||
+					(uint64_t)submesh.firstVertex + submesh.numVertices > numVertices)
+					return false;
+
+			return true;
+		}
+	}
+
+	namespace MeshCache
+	{
+		std::string CachePathFor(const std::string& sourceFilename)
+		{
+			return sourceFilename + ".meshcache";
+		}
+
+		uint64_t ComputeKey(const std::string& sourceFilename, unsigned int ppsteps, const LoadOptions& options)
+		{
+			std::ifstream in(sourceFilename, std::ios::binary);
+			if (!in)
+				return 0;
+
+			uint64_t hash{ kFnvOffset };
+			std::vector<char> buffer(1 << 16);
+			while (in)
+			{
+				in.read(buffer.data(), buffer.size());
+				hash = Fnv1a(buffer.data(), (size_t)in.gcount(), hash);
+			}
+
+			hash = Fnv1a((const char*)&ppsteps, sizeof(ppsteps), hash);
+			hash = Fnv1a((const char*)&options.attributes, sizeof(options.attributes), hash);
+			hash = Fnv1a((const char*)&options.generateLods, sizeof(options.generateLods), hash);
+			hash = Fnv1a((const char*)&options.optimizeMeshes, sizeof(options.optimizeMeshes), hash);
+			hash = Fnv1a((const char*)&options.mergeMeshes, sizeof(options.mergeMeshes), hash);
+			hash = Fnv1a((const char*)&kCacheVersion, sizeof(kCacheVersion), hash);
+
+			// Reserve 0 for 'no key'
+			return hash ? hash : 1;
+		}
+
+		bool Load(const std::string& sourceFilename, uint64_t key, std::vector<Mesh>& meshes,
+			std::vector<Material>& materials, NodeHierarchy& hierarchy)
+		{
+			if (key == 0)
+				return false;
+
+			MappedFile file(CachePathFor(sourceFilename));
+			if (!file.Data())
+				return false;
+
+			CacheReader reader(file.Data(), file.Size());
+
+			const CacheHeader header{ reader.Value<CacheHeader>() };
+			if (!reader.Ok() || memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+				header.version != kCacheVersion || header.key != key)
+				return false;
+
+			std::vector<Mesh> newMeshes(header.numMeshes);
+			for (Mesh& mesh : newMeshes)
+			{
+				mesh.name = reader.String();
+				reader.Vector(mesh.vertices);
+				reader.Vector(mesh.normals);
+				reader.Vector(mesh.uvCoords);
+				reader.Vector(mesh.tangents);
+				reader.Vector(mesh.bitangents);
+				reader.Vector(mesh.colours);
+				reader.Vector(mesh.uvCoords2);
+				reader.Vector(mesh.elements);
+				mesh.materialIndex = reader.Value<uint32_t>();
+
+				mesh.lods.resize(reader.Count(sizeof(float) + sizeof(uint32_t)));
+				for (MeshLod& lod : mesh.lods)
+				{
+					lod.error = reader.Value<float>();
+					reader.Vector(lod.elements);
+				}
+
+				mesh.submeshes.resize(reader.Count(5 * sizeof(uint32_t)));
+				for (Submesh& submesh : mesh.submeshes)
+				{
+					submesh.name = reader.String();
+					submesh.firstElement = reader.Value<uint32_t>();
+					submesh.numElements = reader.Value<uint32_t>();
+					submesh.firstVertex = reader.Value<uint32_t>();
+					submesh.numVertices = reader.Value<uint32_t>();
+				}
+			}
+
+			std::vector<Material> newMaterials(header.numMaterials);
+			for (Material& material : newMaterials)
+			{
+				material.diffuseTextureFilename = reader.String();
+				material.specularTextureFilename = reader.String();
+				material.diffuseColour = reader.Value<glm::vec4>();
+				material.ambientColour = reader.Value<glm::vec4>();
+				material.emissiveColour = reader.Value<glm::vec4>();
+				material.specularColour = reader.Value<glm::vec4>();
+				material.specularFactor = reader.Value<float>();
+			}
+
+			NodeHierarchy newHierarchy;
+			ReadHierarchy(reader, newHierarchy);
+
+			bool meshesOk{ true };
+			for (size_t m = 0; meshesOk && m < newMeshes.size(); m++)
+				meshesOk = MeshInRange(newMeshes[m], newMaterials.size());
+
+			// Every array must have one entry per node, each parent must come before its child and every mesh index
+			// must name a mesh
+			bool hierarchyOk{ newHierarchy.parents.size() == newHierarchy.names.size() &&
+				newHierarchy.localTransforms.size() == newHierarchy.names.size() &&
+				newHierarchy.meshRanges.size() == newHierarchy.names.size() };
+			for (size_t n = 0; hierarchyOk && n < newHierarchy.parents.size(); n++)
+			{
+				const glm::uvec2 range{ newHierarchy.meshRanges[n] };
+				hierarchyOk = newHierarchy.parents[n] < (int)n &&
+					(size_t)range.x + range.y <= newHierarchy.meshIndices.size();
+			}
+			hierarchyOk = hierarchyOk && std::all_of(newHierarchy.meshIndices.begin(), newHierarchy.meshIndices.end(),
+				[&](unsigned int m) { return m < newMeshes.size(); });
+
+			if (!reader.Ok() || !meshesOk || !hierarchyOk)
+			{
+				std::cout << "Mesh cache is corrupt, reloading: " << sourceFilename << std::endl;
+				return false;
+			}
+
+			meshes = std::move(newMeshes);
+			materials = std::move(newMaterials);
+			hierarchy = std::move(newHierarchy);
+
+			return true;
+		}
+
+		bool Save(const std::string& sourceFilename, uint64_t key, const std::vector<Mesh>& meshes,
+			const std::vector<Material>& materials, const NodeHierarchy& hierarchy)
+		{
+			if (key == 0)
+				return false;
+
+			const std::string cachePath{ CachePathFor(sourceFilename) };
+			std::ofstream out(cachePath, std::ios::binary | std::ios::trunc);
+			if (!out)
+			{
+				std::cout << "Could not write mesh cache: " << cachePath << std::endl;
+				return false;
+			}
+
+			CacheWriter writer(out);
+
+			CacheHeader header{};
+			memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+			header.version = kCacheVersion;
+			header.key = key;
+			header.numMeshes = (uint32_t)meshes.size();
+			header.numMaterials = (uint32_t)materials.size();
+			writer.Value(header);
+
+			for (const Mesh& mesh : meshes)
+			{
+				writer.String(mesh.name);
+				writer.Vector(mesh.vertices);
+				writer.Vector(mesh.normals);
+				writer.Vector(mesh.uvCoords);
+				writer.Vector(mesh.tangents);
+				writer.Vector(mesh.bitangents);
+				writer.Vector(mesh.colours);
+				writer.Vector(mesh.uvCoords2);
+				writer.Vector(mesh.elements);
+				writer.Value((uint32_t)mesh.materialIndex);
+
+				writer.Value((uint32_t)mesh.lods.size());
+				for (const MeshLod& lod : mesh.lods)
+				{
+					writer.Value(lod.error);
+					writer.Vector(lod.elements);
+				}
+
+				writer.Value((uint32_t)mesh.submeshes.size());
+				for (const Submesh& submesh : mesh.submeshes)
+				{
+					writer.String(submesh.name);
+					writer.Value((uint32_t)submesh.firstElement);
+					writer.Value((uint32_t)submesh.numElements);
+					writer.Value((uint32_t)submesh.firstVertex);
+					writer.Value((uint32_t)submesh.numVertices);
+				}
+			}
+
+			for (const Material& material : materials)
+			{
+				writer.String(material.diffuseTextureFilename);
+				writer.String(material.specularTextureFilename);
+				writer.Value(material.diffuseColour);
+				writer.Value(material.ambientColour);
+				writer.Value(material.emissiveColour);
+				writer.Value(material.specularColour);
+				writer.Value(material.specularFactor);
+			}
+
+			WriteHierarchy(writer, hierarchy);
+
+			if (!out)
+			{
+				// Do not leave a partial cache behind
+				out.close();
+				std::error_code ec;
+				fs::remove(cachePath, ec);
+				return false;
+			}
+
+			return true;
+		}
+	}
+
+	std::vector<MeshCacheBenchmarkResult> BenchmarkMeshCache(const std::string& directory)
+	{
+		std::vector<MeshCacheBenchmarkResult> results;
+
+		std::error_code ec;
+		if (!fs::exists(directory, ec))
+		{
+			std::cout << "Benchmark directory does not exist: " << directory << std::endl;
+			return results;
+		}
+
+		Assimp::Importer importer;
+
+		for (const fs::directory_entry& entry : fs::recursive_directory_iterator(directory, ec))
+		{
+			if (!entry.is_regular_file())
+				continue;
+
+			const std::string extension{ entry.path().extension().string() };
+			if (extension.empty() || extension == ".meshcache" || !importer.IsExtensionSupported(extension))
+				continue;
+
+			MeshCacheBenchmarkResult result;
+			result.filename = entry.path().string();
+
+			// Cold: no cache so ASSIMP runs and the cache gets written
+			fs::remove(MeshCache::CachePathFor(result.filename), ec);
+
+			// Both passes use the same options so they differ only in where the data comes from
+			const LoadOptions options;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			{
+				ModelLoader loader;
+				result.ok = loader.LoadFromFile(result.filename, options);
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			result.coldMs = std::chrono::duration<float, std::milli>(end - start).count();
+
+			// Warm: straight from the cache
+			if (result.ok)
+			{
+				start = std::chrono::high_resolution_clock::now();
+				{
+					ModelLoader loader;
+					result.ok = loader.LoadFromFile(result.filename, options);
+				}
+				end = std::chrono::high_resolution_clock::now();
+				result.warmMs = std::chrono::duration<float, std::milli>(end - start).count();
+			}
+
+			// ASSIMP's own step timings turn on its verbose logger, which would slow the cold pass down, so they come
+			// from one more load that is not timed. It skips the cache so ASSIMP has to run.
+			if (result.ok)
+			{
+				LoadOptions stepOptions{ options };
+				stepOptions.measureSteps = true;
+
+				ModelLoader loader;
+				loader.SetUseCache(false);
+				if (loader.LoadFromFile(result.filename, stepOptions))
+					result.assimpSteps = loader.GetLoadTimings().assimpSteps;
+			}
+
+			std::cout << "Mesh cache benchmark: " << result.filename << " cold " << result.coldMs << "ms warm "
+				<< result.warmMs << "ms" << (result.ok ? "" : " (failed)") << std::endl;
+			for (const AssimpStepTiming& step : result.assimpSteps)
+				std::cout << "  " << step.step << " " << step.ms << "ms" << std::endl;
+
+			results.push_back(result);
+		}
+
+		return results;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+// Cooked binary cache of loaded models so ASSIMP only has to run once per source file
+
+#include "ExternalLibraryHeaders.h"
+#include "Mesh.h"
+
+namespace Helpers
+{
+	// Reads and writes the ModelLoader mesh, material and node data to a binary file stored
+	// next to the source model. The cache is keyed by a hash of the source file plus the load
+	// settings, so editing the model or changing the flags invalidates it.
+	// Note: only the main model file is hashed, e.g. an edited .mtl next to an .obj is not detected
+	namespace MeshCache
+	{
+		// Filename of the cache for a source model
+		std::string CachePathFor(const std::string& sourceFilename);
+
+		// Key used to validate a cache, 0 if the source file cannot be read
+		// ppsteps are the ASSIMP post process flags, options the rest of the settings that change the loaded data
+		uint64_t ComputeKey(const std::string& sourceFilename, unsigned int ppsteps, const LoadOptions& options);
+
+		// Memory maps the cache and fills the passed in containers. Returns false if there is no valid cache.
+		bool Load(const std::string& sourceFilename, uint64_t key, std::vector<Mesh>& meshes,
+			std::vector<Material>& materials, NodeHierarchy& hierarchy);
+
+		// Writes a cache for the source model. Returns false on error.
+		bool Save(const std::string& sourceFilename, uint64_t key, const std::vector<Mesh>& meshes,
+			const std::vector<Material>& materials, const NodeHierarchy& hierarchy);
+	}
+
+	// Result of loading one model with and without the cache
+	struct MeshCacheBenchmarkResult
+	{
+		std::string filename;
+		float coldMs{ 0 };
+		float warmMs{ 0 };
+		bool ok{ false };
+
+		// ASSIMP's per step timings, from a separate load that is not part of coldMs
+		std::vector<AssimpStepTiming> assimpSteps;
+	};
+
+	// Loads every model under a directory first via ASSIMP (cold) and then via the cache (warm), with the same
+	// options both times. ASSIMP's step breakdown comes from a third, untimed load.
+	// Results are also written to cout
+	std::vector<MeshCacheBenchmarkResult> BenchmarkMeshCache(const std::string& directory);
+}
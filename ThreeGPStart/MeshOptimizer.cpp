@@ -0,0 +1,401 @@
+#include "MeshOptimizer.h"
+#include "Mesh.h"
+#include <numeric>
+
+namespace Helpers
+{
+	namespace
+	{
+		// Tuning values from Tom Forsyth's 'Linear-Speed Vertex Cache Optimisation'
+		constexpr int kForsythCacheSize{ 32 };
+		constexpr float kCacheDecayPower{ 1.5f };
+		constexpr float kLastTriangleScore{ 0.75f };
+		constexpr float kValenceBoostScale{ 2.0f };
+		constexpr float kValenceBoostPower{ 0.5f };
+
+		float VertexScore(int cachePosition, unsigned int remainingTriangles)
+		{
+			// Nothing left to draw so no point attracting the search
+			if (remainingTriangles == 0)
+				return -1.0f;
+
+			float score{ 0 };
+			if (cachePosition >= 0)
+			{
+				// The last triangle's vertices get a fixed score so the algorithm does not prefer strips
+				if (cachePosition < 3)
+					score = kLastTriangleScore;
+				else
+					score = std::pow(1.0f - (cachePosition - 3) / (float)(kForsythCacheSize - 3), kCacheDecayPower);
+			}
+
+			// Vertices with few triangles left are finished off first so they stop taking up space
+			score += kValenceBoostScale * std::pow((float)remainingTriangles, -kValenceBoostPower);
+			return score;
+		}
+	}
+
+	VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& elements, size_t numVertices, unsigned int cacheSize)
+	{
+		VertexCacheStats stats;
+		if (elements.size() < 3)
+			return stats;
+
+		// Timestamp of when each vertex entered the cache, it is still in if fewer than cacheSize misses happened since
+		std::vector<size_t> enteredCache(numVertices, 0);
+		std::vector<char> referenced(numVertices, 0);
+		size_t misses{ 0 };
+		size_t numReferenced{ 0 };
+
+		for (unsigned int index : elements)
+		{
+			if (!referenced[index])
+			{
+				referenced[index] = 1;
+				numReferenced++;
+			}
+
+			if (enteredCache[index] == 0 || misses - enteredCache[index] >= cacheSize)
+			{
+				misses++;
+				enteredCache[index] = misses;
+			}
+		}
+
+		stats.acmr = misses / (float)(elements.size() / 3);
+		stats.atvr = numReferenced ? misses / (float)numReferenced : 0.0f;
+		return stats;
+	}
+
+	std::vector<unsigned int> OptimizeVertexCache(const std::vector<unsigned int>& elements, size_t numVertices)
+	{
+		const size_t numTriangles{ elements.size() / 3 };
+		if (numTriangles == 0)
+			return elements;
+
+		// Triangles repeating a vertex would be counted twice against it. They draw nothing so are left out of the
+		// search and added at the end, the caller relies on getting back as many elements as it passed in.
+		std::vector<char> degenerate(numTriangles, 0);
+		size_t numDegenerate{ 0 };
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			const unsigned int* triangle{ &elements[t * 3] };
+			if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2])
+			{
+				degenerate[t] = 1;
+				numDegenerate++;
+			}
+		}
+
+		// Triangles using each vertex, the live part of each list shrinks as triangles are emitted
+		std::vector<unsigned int> remaining(numVertices, 0);
+		for (size_t i = 0; i < numTriangles * 3; i++)
+			if (!degenerate[i / 3])
+				remaining[elements[i]]++;
+
+		std::vector<unsigned int> adjacencyOffsets(numVertices + 1, 0);
+		for (size_t v = 0; v < numVertices; v++)
+			adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+
+		std::vector<unsigned int> adjacency((numTriangles - numDegenerate) * 3);
+		{
+			std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < numTriangles * 3; i++)
+				if (!degenerate[i / 3])
+					adjacency[fill[elements[i]]++] = (unsigned int)(i / 3);
+		}
+
+		std::vector<int> cachePosition(numVertices, -1);
+		std::vector<float> vertexScore(numVertices);
+		for (size_t v = 0; v < numVertices; v++)
+			vertexScore[v] = VertexScore(-1, remaining[v]);
+
+		// Degenerate triangles count as already emitted and score below any live one
+		std::vector<float> triangleScore(numTriangles);
+		std::vector<char> emitted(degenerate);
+		for (size_t t = 0; t < numTriangles; t++)
+			triangleScore[t] = degenerate[t] ? -1.0f : vertexScore[elements[t * 3]] + vertexScore[elements[t * 3 + 1]] + vertexScore[elements[t * 3 + 2]];
+
+		std::vector<unsigned int> result;
+		result.reserve(numTriangles * 3);
+
+		// Room for the cache plus the three vertices of the triangle being added
+		std::vector<unsigned int> cache;
+		std::vector<unsigned int> newCache;
+		cache.reserve(kForsythCacheSize + 3);
+		newCache.reserve(kForsythCacheSize + 3);
+
+		// Start from the best triangle anywhere, after that only the ones touching the cache are considered
+		size_t bestTriangle{ (size_t)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin()) };
+		size_t scanCursor{ 0 };
+
+		while (result.size() < (numTriangles - numDegenerate) * 3)
+		{
+			// The cache ran dry, carry on with the next triangle in input order
+			if (bestTriangle == SIZE_MAX)
+			{
+				while (emitted[scanCursor])
+					scanCursor++;
+				bestTriangle = scanCursor;
+			}
+
+			emitted[bestTriangle] = 1;
+
+			newCache.clear();
+			for (int corner = 0; corner < 3; corner++)
+			{
+				const unsigned int v{ elements[bestTriangle * 3 + corner] };
+				result.push_back(v);
+				newCache.push_back(v);
+
+				// Drop the triangle from this vertex's live list
+				const unsigned int begin{ adjacencyOffsets[v] };
+				const unsigned int end{ begin + remaining[v] };
+				for (unsigned int a = begin; a < end; a++)
+				{
+					if (adjacency[a] == bestTriangle)
+					{
+						std::swap(adjacency[a], adjacency[end - 1]);
+						break;
+					}
+				}
+				remaining[v]--;
+			}
+
+			for (unsigned int v : cache)
+				if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+					newCache.push_back(v);
+
+			// Anything pushed past the end of the cache has been evicted
+			for (size_t i = kForsythCacheSize; i < newCache.size(); i++)
+			{
+				cachePosition[newCache[i]] = -1;
+				vertexScore[newCache[i]] = VertexScore(-1, remaining[newCache[i]]);
+			}
+			if (newCache.size() > kForsythCacheSize)
+				newCache.resize(kForsythCacheSize);
+
+			for (size_t i = 0; i < newCache.size(); i++)
+			{
+				cachePosition[newCache[i]] = (int)i;
+				vertexScore[newCache[i]] = VertexScore((int)i, remaining[newCache[i]]);
+			}
+
+			// Rescore the triangles around everything in the cache and pick the best for next time
+			bestTriangle = SIZE_MAX;
+			float bestScore{ -1.0f };
+			for (unsigned int v : newCache)
+			{
+				for (unsigned int a = adjacencyOffsets[v]; a < adjacencyOffsets[v] + remaining[v]; a++)
+				{
+					const unsigned int t{ adjacency[a] };
+					triangleScore[t] = vertexScore[elements[t * 3]] + vertexScore[elements[t * 3 + 1]] + vertexScore[elements[t * 3 + 2]];
+					if (triangleScore[t] > bestScore)
+					{
+						bestScore = triangleScore[t];
+						bestTriangle = t;
+					}
+				}
+			}
+
+			cache.swap(newCache);
+		}
+
+		for (size_t t = 0; t < numTriangles; t++)
+			if (degenerate[t])
+				result.insert(result.end(), elements.begin() + t * 3, elements.begin() + t * 3 + 3);
+
+		return result;
+	}
+
+	std::vector<unsigned int> OptimizeOverdraw(const std::vector<unsigned int>& elements, const std::vector<glm::vec3>& positions)
+	{
+		const size_t numTriangles{ elements.size() / 3 };
+		if (numTriangles == 0)
+			return elements;
+
+		// Split into clusters wherever a triangle misses the cache on all three vertices, i.e. the cache optimiser restarted
+		constexpr unsigned int kCacheSize{ 16 };
+		std::vector<size_t> enteredCache(positions.size(), 0);
+		size_t misses{ 0 };
+
+		std::vector<size_t> clusterStarts;
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			int triangleMisses{ 0 };
+			for (int corner = 0; corner < 3; corner++)
+			{
+				const unsigned int v{ elements[t * 3 + corner] };
+				if (enteredCache[v] == 0 || misses - enteredCache[v] >= kCacheSize)
+				{
+					misses++;
+					enteredCache[v] = misses;
+					triangleMisses++;
+				}
+			}
+
+			if (t == 0 || triangleMisses == 3)
+				clusterStarts.push_back(t);
+		}
+		clusterStarts.push_back(numTriangles);
+
+		// Area weighted centre of the whole mesh
+		glm::dvec3 meshCentre{ 0 };
+		double meshArea{ 0 };
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			const glm::vec3& p0 = positions[elements[t * 3]];
+			const glm::vec3& p1 = positions[elements[t * 3 + 1]];
+			const glm::vec3& p2 = positions[elements[t * 3 + 2]];
+			const double area{ glm::length(glm::cross(p1 - p0, p2 - p0)) };
+			meshCentre += glm::dvec3(p0 + p1 + p2) / 3.0 * area;
+			meshArea += area;
+		}
+		if (meshArea > 0)
+			meshCentre /= meshArea;
+
+		// Clusters that face away from the centre are likely to be in front of the rest so draw them first
+		struct Cluster
+		{
+			size_t first;
+			size_t last;
+			double sortKey;
+		};
+
+		std::vector<Cluster> clusters;
+		clusters.reserve(clusterStarts.size() - 1);
+		for (size_t c = 0; c + 1 < clusterStarts.size(); c++)
+		{
+			glm::dvec3 centre{ 0 };
+			glm::dvec3 normal{ 0 };
+			double area{ 0 };
+			for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+			{
+				const glm::vec3& p0 = positions[elements[t * 3]];
+				const glm::vec3& p1 = positions[elements[t * 3 + 1]];
+				const glm::vec3& p2 = positions[elements[t * 3 + 2]];
+				const glm::dvec3 cross{ glm::cross(p1 - p0, p2 - p0) };
+				const double triangleArea{ glm::length(cross) };
+				centre += glm::dvec3(p0 + p1 + p2) / 3.0 * triangleArea;
+				normal += cross;
+				area += triangleArea;
+			}
+
+			double sortKey{ 0 };
+			const double normalLength{ glm::length(normal) };
+			if (area > 0 && normalLength > 0)
+				sortKey = glm::dot(centre / area - meshCentre, normal / normalLength);
+
+			clusters.push_back(Cluster{ clusterStarts[c], clusterStarts[c + 1], sortKey });
+		}
+
+		std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& l, const Cluster& r) { return l.sortKey > r.sortKey; });
+
+		std::vector<unsigned int> result;
+		result.reserve(numTriangles * 3);
+		for (const Cluster& cluster : clusters)
+			result.insert(result.end(), elements.begin() + cluster.first * 3, elements.begin() + cluster.last * 3);
+
+		return result;
+	}
+
+	std::vector<unsigned int> OptimizeVertexFetchRemap(const std::vector<unsigned int>& elements, size_t numVertices)
+	{
+		const unsigned int unassigned{ UINT_MAX };
+		std::vector<unsigned int> remap(numVertices, unassigned);
+
+		unsigned int next{ 0 };
+		for (unsigned int index : elements)
+			if (remap[index] == unassigned)
+				remap[index] = next++;
+
+		for (unsigned int& newIndex : remap)
+			if (newIndex == unassigned)
+				newIndex = next++;
+
+		return remap;
+	}
+
+	void RemapElements(std::vector<unsigned int>& elements, const std::vector<unsigned int>& remap)
+	{
+		for (unsigned int& index : elements)
+			index = remap[index];
+	}
+
+	std::vector<unsigned int> OptimizeIndexLists(std::vector<std::vector<unsigned int>*> elementLists,
+		const std::vector<glm::vec3>& positions, MeshOptimizeReport& report, const std::vector<glm::uvec2>& firstListRanges)
+	{
+		const size_t numVertices{ positions.size() };
+		std::vector<unsigned int> remap(numVertices);
+		std::iota(remap.begin(), remap.end(), 0);
+
+		if (elementLists.empty())
+			return remap;
+
+		report.numTriangles = elementLists[0]->size() / 3;
+		report.before = AnalyzeVertexCache(*elementLists[0], numVertices);
+
+		for (size_t list = 0; list < elementLists.size(); list++)
+		{
+			std::vector<unsigned int>& elements = *elementLists[list];
+			if (list > 0 || firstListRanges.empty())
+			{
+				elements = OptimizeOverdraw(OptimizeVertexCache(elements, numVertices), positions);
+				continue;
+			}
+
+			for (const glm::uvec2& range : firstListRanges)
+			{
+				const std::vector<unsigned int> slice(elements.begin() + range.x, elements.begin() + range.x + range.y);
+				const std::vector<unsigned int> optimized{ OptimizeOverdraw(OptimizeVertexCache(slice, numVertices), positions) };
+				std::copy(optimized.begin(), optimized.end(), elements.begin() + range.x);
+			}
+		}
+
+		// Vertex order follows the full detail list, lower levels only use a subset of its vertices
+		remap = OptimizeVertexFetchRemap(*elementLists[0], numVertices);
+		for (std::vector<unsigned int>* elements : elementLists)
+			RemapElements(*elements, remap);
+
+		report.after = AnalyzeVertexCache(*elementLists[0], numVertices);
+		return remap;
+	}
+
+	MeshOptimizeReport OptimizeMesh(Mesh& mesh)
+	{
+		MeshOptimizeReport report;
+		report.name = mesh.name;
+
+		std::vector<std::vector<unsigned int>*> elementLists{ &mesh.elements };
+		for (MeshLod& lod : mesh.lods)
+			elementLists.push_back(&lod.elements);
+
+		std::vector<glm::uvec2> submeshRanges;
+		for (const Submesh& submesh : mesh.submeshes)
+			submeshRanges.push_back(glm::uvec2(submesh.firstElement, submesh.numElements));
+
+		const std::vector<unsigned int> remap{ OptimizeIndexLists(elementLists, mesh.vertices, report, submeshRanges) };
+
+		RemapVertexStream(mesh.vertices, remap);
+		RemapVertexStream(mesh.normals, remap);
+		RemapVertexStream(mesh.uvCoords, remap);
+		RemapVertexStream(mesh.tangents, remap);
+		RemapVertexStream(mesh.bitangents, remap);
+		RemapVertexStream(mesh.colours, remap);
+		RemapVertexStream(mesh.uvCoords2, remap);
+
+		// Submeshes do not share vertices so first use order keeps each one's vertices together
+		for (Submesh& submesh : mesh.submeshes)
+		{
+			if (submesh.numElements == 0)
+				continue;
+
+			const auto first = mesh.elements.begin() + submesh.firstElement;
+			const auto minMax = std::minmax_element(first, first + submesh.numElements);
+			submesh.firstVertex = *minMax.first;
+			submesh.numVertices = *minMax.second - *minMax.first + 1;
+		}
+
+		return report;
+	}
+}
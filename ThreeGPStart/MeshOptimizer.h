@@ -0,0 +1,66 @@
+#pragma once
+// Index and vertex reordering for better post transform cache use, less overdraw and linear vertex fetch
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	struct Mesh;
+
+	// Results of running a triangle list through a simulated FIFO post transform cache
+	struct VertexCacheStats
+	{
+		// Average cache miss ratio, vertices transformed per triangle. 0.5 is ideal for a large grid, 3 is no reuse.
+		float acmr{ 0 };
+
+		// Average transform to vertex ratio, vertices transformed per referenced vertex. 1 is ideal.
+		float atvr{ 0 };
+	};
+
+	// Before and after figures for one optimised mesh
+	struct MeshOptimizeReport
+	{
+		std::string name;
+		size_t numTriangles{ 0 };
+		VertexCacheStats before;
+		VertexCacheStats after;
+	};
+
+	// Simulate a FIFO cache of cacheSize entries
+	VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& elements, size_t numVertices, unsigned int cacheSize = 16);
+
+	// Reorder triangles for post transform cache hits using Tom Forsyth's linear speed greedy algorithm
+	std::vector<unsigned int> OptimizeVertexCache(const std::vector<unsigned int>& elements, size_t numVertices);
+
+	// Reorder clusters of an already cache optimised list so outward facing parts of the mesh are drawn first.
+	// Clusters are split where the cache would restart anyway so the cache efficiency is mostly kept.
+	std::vector<unsigned int> OptimizeOverdraw(const std::vector<unsigned int>& elements, const std::vector<glm::vec3>& positions);
+
+	// Remap table giving each vertex its new index in order of first use. Unused vertices go last.
+	std::vector<unsigned int> OptimizeVertexFetchRemap(const std::vector<unsigned int>& elements, size_t numVertices);
+
+	// Apply a remap table to an index list
+	void RemapElements(std::vector<unsigned int>& elements, const std::vector<unsigned int>& remap);
+
+	// Apply a remap table to one vertex stream. Empty streams are left alone.
+	template <typename T>
+	void RemapVertexStream(std::vector<T>& stream, const std::vector<unsigned int>& remap)
+	{
+		if (stream.empty())
+			return;
+
+		std::vector<T> remapped(stream.size());
+		for (size_t v = 0; v < stream.size(); v++)
+			remapped[remap[v]] = stream[v];
+		stream.swap(remapped);
+	}
+
+	// Runs the vertex cache, overdraw and vertex fetch passes over index lists that share positions, e.g. a mesh
+	// and its levels of detail. Returns the remap to apply to every vertex stream. The report is for the first list.
+	// firstListRanges (first element, count) are optimised separately so triangles never move between them.
+	std::vector<unsigned int> OptimizeIndexLists(std::vector<std::vector<unsigned int>*> elementLists,
+		const std::vector<glm::vec3>& positions, MeshOptimizeReport& report, const std::vector<glm::uvec2>& firstListRanges = {});
+
+	// Optimise a loaded mesh in place including all of its vertex streams and levels of detail. Submesh ranges are kept.
+	MeshOptimizeReport OptimizeMesh(Mesh& mesh);
+}
@@ -0,0 +1,398 @@
+#include "MeshSimplifier.h"
+#include <unordered_map>
+#include <climits>
+
+namespace Helpers
+{
+	namespace
+	{
+		// Symmetric 4x4 matrix holding the sum of squared distances to a set of planes
+		struct Quadric
+		{
+			double xx{ 0 }, xy{ 0 }, xz{ 0 }, xw{ 0 };
+			double yy{ 0 }, yz{ 0 }, yw{ 0 };
+			double zz{ 0 }, zw{ 0 };
+			double ww{ 0 };
+
+			// Number of planes summed
+			double numPlanes{ 0 };
+
+			void AddPlane(const glm::dvec3& n, double d)
+			{
+				xx += n.x * n.x; xy += n.x * n.y; xz += n.x * n.z; xw += n.x * d;
+				yy += n.y * n.y; yz += n.y * n.z; yw += n.y * d;
+				zz += n.z * n.z; zw += n.z * d;
+				ww += d * d;
+				numPlanes += 1;
+			}
+
+			Quadric& operator+=(const Quadric& o)
+			{
+				xx += o.xx; xy += o.xy; xz += o.xz; xw += o.xw;
+				yy += o.yy; yz += o.yz; yw += o.yw;
+				zz += o.zz; zw += o.zw;
+				ww += o.ww;
+				numPlanes += o.numPlanes;
+				return *this;
+			}
+
+			// Mean squared distance from p to the planes. The mean rather than the sum keeps the error in
+			// object space units however many collapses have been merged.
+			double Evaluate(const glm::dvec3& p) const
+			{
+				if (numPlanes <= 0)
+					return 0;
+
+				return (xx * p.x * p.x + 2 * xy * p.x * p.y + 2 * xz * p.x * p.z + 2 * xw * p.x +
+					yy * p.y * p.y + 2 * yz * p.y * p.z + 2 * yw * p.y +
+					zz * p.z * p.z + 2 * zw * p.z +
+					ww) / numPlanes;
+			}
+		};
+
+		constexpr unsigned int kNoVertex{ UINT_MAX };
+
+		// Moves the vertex 'from' onto 'to'. Along a seam the position's other wedge moves with it, from2 onto to2.
+		struct Collapse
+		{
+			unsigned int from;
+			unsigned int to;
+			unsigned int from2;
+			unsigned int to2;
+			double cost;
+		};
+
+		// An edge between two positions and the vertices its triangles use at each end, a at the lower position id
+		struct Edge
+		{
+			int uses{ 0 };
+			unsigned int a{ 0 }, b{ 0 };
+			unsigned int a2{ 0 }, b2{ 0 };
+
+			// The two triangles disagree about the vertex at either end, or at both ends
+			bool Split() const { return a != a2 || b != b2; }
+			bool Seam() const { return a != a2 && b != b2; }
+		};
+
+		uint64_t EdgeKey(unsigned int positionA, unsigned int positionB)
+		{
+			return (uint64_t)std::min(positionA, positionB) << 32 | std::max(positionA, positionB);
+		}
+
+		void FindEdges(const std::vector<unsigned int>& triangles, const std::vector<unsigned int>& positionId,
+			std::unordered_map<uint64_t, Edge>& edges)
+		{
+			edges.clear();
+			edges.reserve(triangles.size());
+			for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+			{
+				for (int e = 0; e < 3; e++)
+				{
+					unsigned int a{ triangles[t + e] };
+					unsigned int b{ triangles[t + (e + 1) % 3] };
+					if (positionId[a] == positionId[b])
+						continue;
+					if (positionId[a] > positionId[b])
+						std::swap(a, b);
+
+					Edge& edge = edges[EdgeKey(positionId[a], positionId[b])];
+					if (edge.uses++ == 0)
+					{
+						edge.a = edge.a2 = a;
+						edge.b = edge.b2 = b;
+					}
+					else
+					{
+						edge.a2 = a;
+						edge.b2 = b;
+					}
+				}
+			}
+		}
+
+		struct PositionHash
+		{
+			size_t operator()(const glm::vec3& p) const
+			{
+				uint32_t bits[3];
+				memcpy(bits, &p, sizeof(bits));
+				return (size_t)bits[0] * 73856093u ^ (size_t)bits[1] * 19349663u ^ (size_t)bits[2] * 83492791u;
+			}
+		};
+
+		// Bitwise so it agrees with the hash, e.g. 0 and -0 are different keys
+		struct PositionEqual
+		{
+			bool operator()(const glm::vec3& l, const glm::vec3& r) const
+			{
+				return memcmp(&l, &r, sizeof(glm::vec3)) == 0;
+			}
+		};
+
+		glm::dvec3 TriangleNormal(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+		{
+			return glm::cross(glm::dvec3(p1) - glm::dvec3(p0), glm::dvec3(p2) - glm::dvec3(p0));
+		}
+	}
+
+	std::vector<unsigned int> SimplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& elements,
+		size_t targetNumElements, float& error)
+	{
+		error = 0;
+
+		const size_t numVertices{ positions.size() };
+		std::vector<unsigned int> triangles{ elements };
+		if (triangles.size() <= targetNumElements || numVertices == 0)
+			return triangles;
+
+		// Vertices that share a position (split for uvs or normals) are treated as one for quadrics and borders
+		std::vector<unsigned int> positionId(numVertices);
+		std::vector<unsigned int> wedgeCount;
+		{
+			std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> firstWithPosition;
+			firstWithPosition.reserve(numVertices);
+			for (size_t v = 0; v < numVertices; v++)
+			{
+				auto inserted = firstWithPosition.emplace(positions[v], (unsigned int)wedgeCount.size());
+				if (inserted.second)
+					wedgeCount.push_back(0);
+				positionId[v] = inserted.first->second;
+				wedgeCount[positionId[v]]++;
+			}
+		}
+		const size_t numPositions{ wedgeCount.size() };
+
+		// Plane quadrics of every triangle accumulated onto its corners
+		std::vector<Quadric> quadrics(numPositions);
+		for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+		{
+			const glm::vec3& p0 = positions[triangles[t]];
+			glm::dvec3 n{ TriangleNormal(p0, positions[triangles[t + 1]], positions[triangles[t + 2]]) };
+			const double length{ glm::length(n) };
+			if (length <= 0.0)
+				continue;
+			n /= length;
+			const double d{ -glm::dot(n, glm::dvec3(p0)) };
+
+			for (int corner = 0; corner < 3; corner++)
+				quadrics[positionId[triangles[t + corner]]].AddPlane(n, d);
+		}
+
+		// Open borders and non manifold edges are locked so the silhouette and joins with other mesh stay intact.
+		// A uv or normal seam runs along edges whose two triangles use different vertices at both ends. A position
+		// with two vertices and two seam edges lies in the middle of a seam and can move along it, taking both its
+		// vertices with it. Anywhere a seam ends, branches or has more than two vertices is locked.
+		std::vector<char> locked(numPositions, 0);
+		std::vector<char> onSeam(numPositions, 0);
+		std::unordered_map<uint64_t, Edge> edges;
+		{
+			FindEdges(triangles, positionId, edges);
+
+			std::vector<unsigned int> seamEdges(numPositions, 0);
+			for (const auto& keyed : edges)
+			{
+				const unsigned int positionA{ (unsigned int)(keyed.first >> 32) };
+				const unsigned int positionB{ (unsigned int)(keyed.first & 0xFFFFFFFF) };
+				const Edge& edge = keyed.second;
+				if (edge.uses != 2 || (edge.Split() && !edge.Seam()))
+				{
+					locked[positionA] = 1;
+					locked[positionB] = 1;
+				}
+				else if (edge.Seam())
+				{
+					seamEdges[positionA]++;
+					seamEdges[positionB]++;
+				}
+			}
+
+			for (size_t p = 0; p < numPositions; p++)
+			{
+				onSeam[p] = wedgeCount[p] == 2 && seamEdges[p] == 2;
+				if (wedgeCount[p] > 1 && !onSeam[p])
+					locked[p] = 1;
+			}
+		}
+
+		std::vector<unsigned int> remap(numVertices);
+		std::vector<unsigned int> adjacencyOffsets(numVertices + 1);
+		std::vector<unsigned int> adjacency;
+		std::vector<char> touched(numVertices);
+		std::vector<Collapse> collapses;
+		double maxCost{ 0 };
+
+		// Each pass collapses as many independent edges as it can, cheapest first, then rebuilds the triangle list
+		while (triangles.size() > targetNumElements)
+		{
+			// Vertex to triangle adjacency
+			std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+			for (unsigned int index : triangles)
+				adjacencyOffsets[index + 1]++;
+			for (size_t v = 0; v < numVertices; v++)
+				adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+			adjacency.resize(triangles.size());
+			{
+				std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t i = 0; i < triangles.size(); i++)
+					adjacency[fill[triangles[i]]++] = (unsigned int)(i / 3);
+			}
+
+			// Every edge in both directions. Seam positions only move along their seam and everything else only
+			// along edges where both triangles agree, so each triangle keeps its uvs and normals.
+			FindEdges(triangles, positionId, edges);
+			collapses.clear();
+			for (const auto& keyed : edges)
+			{
+				const Edge& edge = keyed.second;
+				if (edge.uses != 2 || (edge.Split() && !edge.Seam()))
+					continue;
+
+				const unsigned int positionA{ positionId[edge.a] };
+				const unsigned int positionB{ positionId[edge.b] };
+				Quadric q{ quadrics[positionA] };
+				q += quadrics[positionB];
+
+				if (!locked[positionA] && onSeam[positionA] == edge.Seam())
+					collapses.push_back(edge.Seam() ? Collapse{ edge.a, edge.b, edge.a2, edge.b2, q.Evaluate(positions[edge.b]) } :
+						Collapse{ edge.a, edge.b, kNoVertex, kNoVertex, q.Evaluate(positions[edge.b]) });
+				if (!locked[positionB] && onSeam[positionB] == edge.Seam())
+					collapses.push_back(edge.Seam() ? Collapse{ edge.b, edge.a, edge.b2, edge.a2, q.Evaluate(positions[edge.a]) } :
+						Collapse{ edge.b, edge.a, kNoVertex, kNoVertex, q.Evaluate(positions[edge.a]) });
+			}
+
+			if (collapses.empty())
+				break;
+
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+			for (size_t v = 0; v < numVertices; v++)
+				remap[v] = (unsigned int)v;
+			std::fill(touched.begin(), touched.end(), 0);
+
+			size_t remaining{ triangles.size() };
+			size_t numCollapsed{ 0 };
+
+			for (const Collapse& collapse : collapses)
+			{
+				if (remaining <= targetNumElements)
+					break;
+
+				// The vertices that move, one or both sides of a seam
+				const unsigned int from[2]{ collapse.from, collapse.from2 };
+				const unsigned int to[2]{ collapse.to, collapse.to2 };
+				const int numMoved{ collapse.from2 == kNoVertex ? 1 : 2 };
+
+				// Anything already changed this pass has stale adjacency
+				bool stale{ false };
+				for (int m = 0; m < numMoved; m++)
+					stale = stale || touched[from[m]] || touched[to[m]];
+				if (stale)
+					continue;
+
+				const unsigned int toPosition{ positionId[collapse.to] };
+				const glm::vec3& target = positions[collapse.to];
+
+				// Reject collapses that would flip a surviving triangle
+				bool flips{ false };
+				size_t numRemoved{ 0 };
+				for (int m = 0; m < numMoved && !flips; m++)
+				{
+					for (unsigned int a = adjacencyOffsets[from[m]]; a < adjacencyOffsets[from[m] + 1]; a++)
+					{
+						const unsigned int* tri = &triangles[(size_t)adjacency[a] * 3];
+						if (positionId[tri[0]] == toPosition || positionId[tri[1]] == toPosition || positionId[tri[2]] == toPosition)
+						{
+							numRemoved++;
+							continue;
+						}
+
+						glm::vec3 moved[3]{ positions[tri[0]], positions[tri[1]], positions[tri[2]] };
+						const glm::dvec3 before{ TriangleNormal(moved[0], moved[1], moved[2]) };
+						for (int corner = 0; corner < 3; corner++)
+							if (tri[corner] == from[m])
+								moved[corner] = target;
+						const glm::dvec3 after{ TriangleNormal(moved[0], moved[1], moved[2]) };
+
+						if (glm::dot(before, after) <= 0.0)
+						{
+							flips = true;
+							break;
+						}
+					}
+				}
+
+				if (flips)
+					continue;
+
+				quadrics[toPosition] += quadrics[positionId[collapse.from]];
+				maxCost = std::max(maxCost, collapse.cost);
+
+				for (int m = 0; m < numMoved; m++)
+				{
+					remap[from[m]] = to[m];
+					touched[from[m]] = touched[to[m]] = 1;
+					for (unsigned int a = adjacencyOffsets[from[m]]; a < adjacencyOffsets[from[m] + 1]; a++)
+					{
+						const unsigned int* tri = &triangles[(size_t)adjacency[a] * 3];
+						touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+					}
+				}
+
+				remaining -= numRemoved * 3;
+				numCollapsed++;
+			}
+
+			if (numCollapsed == 0)
+				break;
+
+			// Apply the collapses and drop the triangles that became degenerate
+			size_t write{ 0 };
+			for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+			{
+				const unsigned int i0{ remap[triangles[t]] };
+				const unsigned int i1{ remap[triangles[t + 1]] };
+				const unsigned int i2{ remap[triangles[t + 2]] };
+				if (positionId[i0] == positionId[i1] || positionId[i1] == positionId[i2] || positionId[i0] == positionId[i2])
+					continue;
+
+				triangles[write++] = i0;
+				triangles[write++] = i1;
+				triangles[write++] = i2;
+			}
+			triangles.resize(write);
+		}
+
+		error = (float)std::sqrt(std::max(maxCost, 0.0));
+		return triangles;
+	}
+
+	std::vector<MeshLod> GenerateLodChain(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& elements,
+		int maxLevels, float reduction)
+	{
+		std::vector<MeshLod> lods;
+
+		size_t previousSize{ elements.size() };
+		float target{ (float)elements.size() };
+
+		for (int level = 0; level < maxLevels; level++)
+		{
+			// Always simplify from the original so errors do not compound
+			target *= reduction;
+			const size_t targetNumElements{ (size_t)target / 3 * 3 };
+			if (targetNumElements < 3)
+				break;
+
+			MeshLod lod;
+			lod.elements = SimplifyMesh(positions, elements, targetNumElements, lod.error);
+
+			// Locked borders and seam ends stop simplification at some point, no need to keep near duplicates
+			if (lod.elements.empty() || lod.elements.size() > previousSize * 9 / 10)
+				break;
+
+			previousSize = lod.elements.size();
+			lods.push_back(std::move(lod));
+		}
+
+		return lods;
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+// Quadric error metric mesh simplification used to build level of detail chains
+
+#include "ExternalLibraryHeaders.h"
+#include "Mesh.h"
+
+namespace Helpers
+{
+	// Reduce a triangle list towards targetNumElements indices by collapsing edges, cheapest first as measured by
+	// the quadric error metric. Vertices are only ever collapsed onto other existing vertices so the result indexes
+	// the same vertex data. Vertices on attribute seams (same position, different uv/normal) move along the seam with
+	// both sides together. Vertices on open borders, and where a seam ends or branches, are never removed so the
+	// result may be larger than asked for.
+	// error receives the largest root mean square distance, in object space, of a collapsed vertex from its original planes.
+	std::vector<unsigned int> SimplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& elements,
+		size_t targetNumElements, float& error);
+
+	// Each level targets reduction times the triangles of the one before. Stops early once a level no longer
+	// gets meaningfully smaller.
+	std::vector<MeshLod> GenerateLodChain(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& elements,
+		int maxLevels = 4, float reduction = 0.5f);
+}
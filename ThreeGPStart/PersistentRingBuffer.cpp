@@ -0,0 +1,140 @@
+#include "PersistentRingBuffer.h"
+
+namespace Helpers
+{
+	PersistentRingBuffer::~PersistentRingBuffer()
+	{
+		Destroy();
+	}
+
+	bool PersistentRingBuffer::Initialise(GLenum target, size_t bytesPerFrame)
+	{
+		m_target = target;
+
+		GLint alignment{ 1 };
+		if (target == GL_UNIFORM_BUFFER)
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		else if (target == GL_SHADER_STORAGE_BUFFER)
+			glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		m_alignment = (size_t)std::max(alignment, 1);
+
+		return Create(bytesPerFrame);
+	}
+
+	bool PersistentRingBuffer::Create(size_t bytesPerFrame)
+	{
+		m_bytesPerFrame = AlignedSize(bytesPerFrame);
+
+		// Coherent so writes are seen by the GPU without an explicit flush
+		const GLbitfield flags{ GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT };
+
+		glGenBuffers(1, &m_buffer);
+		glBindBuffer(m_target, m_buffer);
+		glBufferStorage(m_target, m_bytesPerFrame * kFramesInFlight, nullptr, flags);
+		m_mapped = (unsigned char*)glMapBufferRange(m_target, 0, m_bytesPerFrame * kFramesInFlight, flags);
+		glBindBuffer(m_target, 0);
+
+		if (!m_mapped)
+		{
+			std::cout << "PersistentRingBuffer: failed to map " << m_bytesPerFrame * kFramesInFlight << " bytes" << std::endl;
+			return false;
+		}
+
+		m_frameOffset = 0;
+		return true;
+	}
+
+	void PersistentRingBuffer::Destroy()
+	{
+		for (GLsync& fence : m_fences)
+		{
+			if (fence)
+			{
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+
+		if (m_buffer)
+		{
+			glBindBuffer(m_target, m_buffer);
+			glUnmapBuffer(m_target);
+			glBindBuffer(m_target, 0);
+			glDeleteBuffers(1, &m_buffer);
+		}
+		m_buffer = 0;
+		m_mapped = nullptr;
+	}
+
+	bool PersistentRingBuffer::Wait(GLsync& fence)
+	{
+		if (!fence)
+			return false;
+
+		// Poll first, only flush and block if the GPU is not done yet
+		GLenum result{ glClientWaitSync(fence, 0, 0) };
+		const bool stalled{ result == GL_TIMEOUT_EXPIRED };
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+		glDeleteSync(fence);
+		fence = nullptr;
+		return stalled;
+	}
+
+	bool PersistentRingBuffer::BeginFrame(size_t bytesNeeded)
+	{
+		m_frame = (m_frame + 1) % kFramesInFlight;
+		m_frameOffset = 0;
+
+		if (bytesNeeded > m_bytesPerFrame)
+		{
+			// The GPU may still be reading any region so wait for them all before replacing the buffer
+			for (GLsync& fence : m_fences)
+				Wait(fence);
+
+			// The new buffer is made before the old one is deleted so it never reuses its name, which would
+			// look like an unchanged binding to anything tracking state
+			const GLuint oldBuffer{ m_buffer };
+			const bool created{ Create(std::max(bytesNeeded, m_bytesPerFrame * 2)) };
+
+			glBindBuffer(m_target, oldBuffer);
+			glUnmapBuffer(m_target);
+			glBindBuffer(m_target, 0);
+			glDeleteBuffers(1, &oldBuffer);
+
+			return created;
+		}
+
+		if (Wait(m_fences[m_frame]))
+			m_numStalls++;
+
+		return m_mapped != nullptr;
+	}
+
+	void PersistentRingBuffer::EndFrame()
+	{
+		if (m_fences[m_frame])
+			glDeleteSync(m_fences[m_frame]);
+		m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	size_t PersistentRingBuffer::Allocate(size_t numBytes)
+	{
+		const size_t size{ AlignedSize(numBytes) };
+		if (!m_mapped || m_frameOffset + size > m_bytesPerFrame)
+			return kInvalidOffset;
+
+		const size_t offset{ (size_t)m_frame * m_bytesPerFrame + m_frameOffset };
+		m_frameOffset += size;
+		return offset;
+	}
+
+	size_t PersistentRingBuffer::Write(const void* data, size_t numBytes)
+	{
+		const size_t offset{ Allocate(numBytes) };
+		if (offset != kInvalidOffset)
+			memcpy(m_mapped + offset, data, numBytes);
+		return offset;
+	}
+}
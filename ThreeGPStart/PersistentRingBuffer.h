@@ -0,0 +1,71 @@
+#pragma once
+// A persistently mapped buffer split into one region per frame in flight, fenced so the CPU never writes what the GPU is reading
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Per-frame data is written straight into mapped memory, there is no glBufferSubData or glUniform* per draw.
+	// BeginFrame waits for the GPU to finish with the region it hands out, which only blocks if the CPU is
+	// kFramesInFlight frames ahead.
+	class PersistentRingBuffer
+	{
+	public:
+		static constexpr int kFramesInFlight{ 3 };
+		static constexpr size_t kInvalidOffset{ SIZE_MAX };
+	private:
+		GLenum m_target{ GL_UNIFORM_BUFFER };
+		GLuint m_buffer{ 0 };
+		unsigned char* m_mapped{ nullptr };
+
+		size_t m_bytesPerFrame{ 0 };
+		size_t m_alignment{ 1 };
+
+		int m_frame{ 0 };
+		GLsync m_fences[kFramesInFlight]{};
+
+		// Offset of the next free byte in the current frame's region
+		size_t m_frameOffset{ 0 };
+
+		// Frames where BeginFrame had to wait for the GPU
+		size_t m_numStalls{ 0 };
+
+		bool Create(size_t bytesPerFrame);
+		void Destroy();
+
+		// Returns true if it had to block
+		bool Wait(GLsync& fence);
+	public:
+		PersistentRingBuffer() = default;
+		~PersistentRingBuffer();
+
+		PersistentRingBuffer(const PersistentRingBuffer&) = delete;
+		PersistentRingBuffer& operator=(const PersistentRingBuffer&) = delete;
+
+		// Allocations are aligned to the target's offset alignment, e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+		bool Initialise(GLenum target, size_t bytesPerFrame);
+
+		// Starts writing the next region. If more than the current size is needed the buffer is recreated after
+		// all frames in flight have finished.
+		bool BeginFrame(size_t bytesNeeded = 0);
+
+		// Fences the region used this frame
+		void EndFrame();
+
+		// Offset from the start of the buffer for glBindBufferRange, kInvalidOffset if the frame's region is full
+		size_t Allocate(size_t numBytes);
+
+		// Copies data into a new allocation
+		size_t Write(const void* data, size_t numBytes);
+
+		// Space a numBytes allocation takes including alignment
+		size_t AlignedSize(size_t numBytes) const { return (numBytes + m_alignment - 1) / m_alignment * m_alignment; }
+
+		unsigned char* Pointer(size_t offset) const { return m_mapped + offset; }
+		GLuint Buffer() const { return m_buffer; }
+
+		size_t BytesUsed() const { return m_frameOffset; }
+		size_t BytesPerFrame() const { return m_bytesPerFrame; }
+		size_t NumStalls() const { return m_numStalls; }
+	};
+}
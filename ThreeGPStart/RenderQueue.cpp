@@ -0,0 +1,56 @@
+#include "RenderQueue.h"
+
+namespace Helpers
+{
+	uint64_t MakeSortKey(unsigned int pass, unsigned int program, unsigned int texture, unsigned int vertexArray, float depth01)
+	{
+		const uint64_t depth{ (uint64_t)(glm::clamp(depth01, 0.0f, 1.0f) * 0xFFFFFF) };
+
+		return (uint64_t)(pass & 0xF) << 60 |
+			(uint64_t)(program & 0xFF) << 52 |
+			(uint64_t)(texture & 0xFFFF) << 36 |
+			(uint64_t)(vertexArray & 0xF) << 32 |
+			depth << 8;
+	}
+
+	void RenderQueue::Sort()
+	{
+		if (m_entries.size() < 2)
+			return;
+
+		// Find which bytes actually differ so e.g. the unused low byte costs nothing
+		uint64_t allOr{ 0 };
+		uint64_t allAnd{ ~0ull };
+		for (const Entry& entry : m_entries)
+		{
+			allOr |= entry.key;
+			allAnd &= entry.key;
+		}
+		const uint64_t differing{ allOr ^ allAnd };
+
+		m_scratch.resize(m_entries.size());
+
+		for (int shift = 0; shift < 64; shift += 8)
+		{
+			if (((differing >> shift) & 0xFF) == 0)
+				continue;
+
+			size_t offsets[256]{};
+			for (const Entry& entry : m_entries)
+				offsets[(entry.key >> shift) & 0xFF]++;
+
+			size_t total{ 0 };
+			for (size_t& offset : offsets)
+			{
+				const size_t count{ offset };
+				offset = total;
+				total += count;
+			}
+
+			for (const Entry& entry : m_entries)
+				m_scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+
+			m_entries.swap(m_scratch);
+		}
+	}
+}
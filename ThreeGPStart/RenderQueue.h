@@ -0,0 +1,39 @@
+#pragma once
+// Draw submission order decided by a single 64 bit key per draw
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Draws are sorted by pass first, then program, texture and vertex array so state changes are grouped,
+	// and finally by depth so each group is drawn front to back
+	// Bits: pass 63-60, program 59-52, texture 51-36, vertex array 35-32, depth 31-8
+	uint64_t MakeSortKey(unsigned int pass, unsigned int program, unsigned int texture, unsigned int vertexArray, float depth01);
+
+	// Decode the parts of a key that need state changes
+	inline unsigned int SortKeyPass(uint64_t key) { return (unsigned int)(key >> 60); }
+
+	// Collects draws for a frame and puts them in key order
+	class RenderQueue
+	{
+	public:
+		struct Entry
+		{
+			uint64_t key;
+
+			// Index of the draw in whatever the caller keeps them in
+			uint32_t item;
+		};
+	private:
+		std::vector<Entry> m_entries;
+		std::vector<Entry> m_scratch;
+	public:
+		void Clear() { m_entries.clear(); }
+		void Add(uint64_t key, uint32_t item) { m_entries.push_back(Entry{ key, item }); }
+
+		// Stable least significant byte radix sort, bytes that are the same in every key are skipped
+		void Sort();
+
+		const std::vector<Entry>& Entries() const { return m_entries; }
+	};
+}
@@ -1,6 +1,49 @@
 #include "Renderer.h"
 #include "Camera.h"
 #include "ImageLoader.h"
+#include "AsyncModelLoader.h"
+#include "HeightfieldNormals.h"
+#include <chrono>
+
+namespace
+{
+	// Faces of each Data\Models\Sky set in cube map order +X, -X, +Y, -Y, +Z, -Z, matched to where each skybox.x puts them
+	struct SkySet
+	{
+		const char* name;
+		std::string faces[6];
+	};
+
+	const SkySet kSkySets[] = {
+		{ "Clouds", { "Data\\Models\\Sky\\Clouds\\SkyBox_Right.tga", "Data\\Models\\Sky\\Clouds\\SkyBox_Left.tga",
+			"Data\\Models\\Sky\\Clouds\\SkyBox_Top.tga", "Data\\Models\\Sky\\Clouds\\SkyBox_Bottom.tga",
+			"Data\\Models\\Sky\\Clouds\\SkyBox_Front.tga", "Data\\Models\\Sky\\Clouds\\SkyBox_Back.tga" } },
+		{ "Hills", { "Data\\Models\\Sky\\Hills\\skybox_right.JPG", "Data\\Models\\Sky\\Hills\\skybox_left.JPG",
+			"Data\\Models\\Sky\\Hills\\skybox_top.JPG", "Data\\Models\\Sky\\Hills\\skybox_bottom.JPG",
+			"Data\\Models\\Sky\\Hills\\skybox_front.JPG", "Data\\Models\\Sky\\Hills\\skybox_back.JPG" } },
+		{ "Mars", { "Data\\Models\\Sky\\Mars\\Mar_R.dds", "Data\\Models\\Sky\\Mars\\Mar_L.dds",
+			"Data\\Models\\Sky\\Mars\\Mar_U.dds", "Data\\Models\\Sky\\Mars\\Mar_D.dds",
+			"Data\\Models\\Sky\\Mars\\Mar_F.dds", "Data\\Models\\Sky\\Mars\\Mar_B.dds" } },
+		{ "Mountains", { "Data\\Models\\Sky\\Mountains\\2.jpg", "Data\\Models\\Sky\\Mountains\\4.jpg",
+			"Data\\Models\\Sky\\Mountains\\6.jpg", "Data\\Models\\Sky\\Mountains\\5.jpg",
+			"Data\\Models\\Sky\\Mountains\\1.jpg", "Data\\Models\\Sky\\Mountains\\3.jpg" } }
+	};
+	const int kNumSkySets{ (int)(sizeof(kSkySets) / sizeof(kSkySets[0])) };
+
+	// Quadtree terrain sizes in cells along each side, the mesh terrain is 150
+	const int kTerrainSizes[] = { 256, 512, 1024, 2048, 4096 };
+	const char* const kTerrainSizeNames[] = { "256", "512", "1024", "2048", "4096" };
+	const int kNumTerrainSizes{ (int)(sizeof(kTerrainSizes) / sizeof(kTerrainSizes[0])) };
+
+	// Heightmaps the quadtree terrain can be streamed from
+	const char* const kTerrainHeightmaps[] = { "Data\\Heightmaps\\Test.png", "Data\\Heightmaps\\3gp_heightmap.bmp" };
+	const char* const kTerrainHeightmapNames[] = { "Test", "3GP" };
+	const int kNumTerrainHeightmaps{ (int)(sizeof(kTerrainHeightmaps) / sizeof(kTerrainHeightmaps[0])) };
+
+	// In the order of Helpers::HeightfieldFilter
+	const char* const kTerrainFilterNames[] = { "Nearest", "Bilinear", "Bicubic" };
+	const int kNumTerrainFilters{ (int)(sizeof(kTerrainFilterNames) / sizeof(kTerrainFilterNames[0])) };
+}
 
 Renderer::Renderer() 
 {
@@ -11,8 +54,24 @@ Renderer::Renderer()
 Renderer::~Renderer()
 {
 	// TODO: clean up any memory used including OpenGL objects via glDelete* calls
-	glDeleteProgram(m_program);
 	glDeleteBuffers(1, &m_VAO);
+	glDeleteQueries(1, &m_timerQuery);
+	glDeleteVertexArrays(1, &m_emptyVao);
+	m_textures.Release(m_skyCubeMap);
+	m_textures.Release(m_terrainTexture);
+	m_geometryArena.Free(m_terrainPatch.geometry);
+
+	for (Model& model : modelVector)
+		UnloadModel(model);
+}
+
+void Renderer::UnloadModel(Model& model)
+{
+	for (Mesh& mesh : model.meshVector) {
+		m_geometryArena.Free(mesh.geometry);
+		m_textures.Release(mesh.tex);
+	}
+	model.meshVector.clear();
 }
 
 // Use IMGUI for a simple on screen GUI
@@ -27,13 +86,179 @@ void Renderer::DefineGUI()
 
 	ImGui::Checkbox("Wireframe", &m_wireframe);	// A checkbox linked to a member variable
 
+	// One cube map drawn last behind everything, or the original six textured meshes drawn first
+	ImGui::Checkbox("Cube map sky", &m_cubeMapSky);
+	const int previousSkySet{ m_skySet };
+	ImGui::Combo("Sky", &m_skySet, [](void*, int index, const char** name) { *name = kSkySets[index].name; return true; },
+		nullptr, kNumSkySets);
+	if (m_skySet != previousSkySet && !LoadSkyCubeMap(m_skySet))
+		m_skySet = previousSkySet;
+
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+
+	// Vertex memory of everything loaded
+	size_t numVertices{ 0 };
+	size_t vertexBytes{ 0 };
+	size_t numIndices{ 0 };
+	size_t indexBytes{ 0 };
+
+	// How far the LOD chains actually got, full detail against each chain's coarsest level
+	size_t numLodMeshes{ 0 };
+	size_t numLodLevels{ 0 };
+	size_t lodFullIndices{ 0 };
+	size_t lodCoarsestIndices{ 0 };
+	for (const Model& model : modelVector)
+	{
+		for (const Mesh& mesh : model.meshVector)
+		{
+			numVertices += mesh.numVertices;
+			vertexBytes += (size_t)mesh.numVertices * Helpers::VertexStride(mesh.vertexFormat);
+
+			size_t meshIndices{ mesh.numElements };
+			for (const MeshLodRange& lod : mesh.lods)
+				meshIndices += lod.numElements;
+			numIndices += meshIndices;
+			indexBytes += meshIndices * Helpers::IndexSize(mesh.geometry.indexType);
+
+			if (!mesh.lods.empty()) {
+				numLodMeshes++;
+				numLodLevels += mesh.lods.size();
+				lodFullIndices += mesh.numElements;
+				lodCoarsestIndices += mesh.lods.back().numElements;
+			}
+		}
+	}
+	ImGui::Text("Vertex format: %s", Helpers::VertexFormatName(m_vertexFormat));
+	ImGui::Text("%zu vertices, %.1f KB, %.1f bytes/vertex", numVertices, vertexBytes / 1024.0f,
+		numVertices ? vertexBytes / (float)numVertices : 0.0f);
+	ImGui::Text("%zu indices, %.1f KB (%.1f KB as 32 bit)", numIndices, indexBytes / 1024.0f, numIndices * sizeof(GLuint) / 1024.0f);
+
+	// Level of detail
+	ImGui::Checkbox("Use LODs", &m_useLods);
+	ImGui::SliderFloat("LOD pixel error", &m_lodPixelThreshold, 0.1f, 16.0f);
+	if (numLodMeshes)
+		ImGui::Text("%zu meshes with %.1f levels each, coarsest %.1f%% of full detail", numLodMeshes, numLodLevels / (float)numLodMeshes,
+			100.0f * lodCoarsestIndices / (float)lodFullIndices);
+	ImGui::Text("%zu triangles drawn", m_numTrianglesDrawn);
+
+	// Meshes, or instances for the instanced grid, tested against the view frustum
+	ImGui::Checkbox("Frustum culling", &m_frustumCulling);
+	ImGui::Text("%zu visible, %zu culled", m_numVisible, m_numCulled);
+
+	// Chunked quadtree terrain with continuous level of detail, or the original 150 x 150 cell mesh
+	if (ImGui::Checkbox("Quadtree terrain", &m_quadtreeTerrain) && !m_quadtreeTerrain && !m_meshTerrainBuilt && !BuildMeshTerrain())
+		m_quadtreeTerrain = true;
+	const int previousTerrainSize{ m_terrainSizeIndex };
+	const int previousTerrainHeightmap{ m_terrainHeightmap };
+	const int previousTerrainFilter{ m_terrainFilter };
+	ImGui::Combo("Terrain size", &m_terrainSizeIndex, kTerrainSizeNames, kNumTerrainSizes);
+	ImGui::Combo("Terrain heightmap", &m_terrainHeightmap, kTerrainHeightmapNames, kNumTerrainHeightmaps);
+	ImGui::Combo("Terrain filter", &m_terrainFilter, kTerrainFilterNames, kNumTerrainFilters);
+	if ((m_terrainSizeIndex != previousTerrainSize || m_terrainHeightmap != previousTerrainHeightmap || m_terrainFilter != previousTerrainFilter)
+		&& !BuildTerrain()) {
+		m_terrainSizeIndex = previousTerrainSize;
+		m_terrainHeightmap = previousTerrainHeightmap;
+		m_terrainFilter = previousTerrainFilter;
+	}
+
+	// Below about one and a half leaf nodes neighbours could be more than one level apart
+	const float leafSize{ Helpers::Terrain::kPatchCells * m_terrain.Settings().spacing };
+	ImGui::SliderFloat("Terrain LOD distance", &m_terrainLodDistance, leafSize * 1.5f, leafSize * 8.0f);
+	ImGui::Text("%d levels, %zu nodes drawn, %zu visited, %zu culled", m_terrain.NumLevels(),
+		m_terrain.Selection().size(), m_terrain.NumNodesVisited(), m_terrain.NumNodesCulled());
+
+	// Tiles are streamed in around the camera on worker threads, at most this much is uploaded a frame
+	ImGui::SliderInt("Terrain stream radius", &m_terrainStreamRadius, 1, 3);
+	ImGui::SliderInt("Terrain upload KB", &m_terrainUploadBudgetKB, 64, 4096);
+	ImGui::Text("%d / %d tiles resident, %d pending, %.1f KB uploaded, %zu evicted", m_terrain.NumResidentTiles(),
+		m_terrain.NumTiles(), m_terrain.NumPendingTiles(), m_terrain.BytesUploaded() / 1024.0f, m_terrain.NumEvictions());
+
+	// GPU memory of the two terrains. The per-vertex figure at the quadtree's size scales the mesh terrain by area.
+	const size_t patchBytes{ (size_t)m_terrainPatch.numVertices * Helpers::VertexStride(m_terrainPatch.vertexFormat) + m_terrainPatch.geometry.indexBytes };
+	const int terrainSize{ kTerrainSizes[m_terrainSizeIndex] };
+	const double meshBytesPerCell{ m_meshTerrainCells > 0 ? (double)m_meshTerrainBytes / ((double)m_meshTerrainCells * m_meshTerrainCells) : 0.0 };
+	ImGui::Text("Quadtree: %.1f MB heights, %.1f KB patch, %.1f KB instances", m_terrain.TextureBytes() / (1024.0f * 1024.0f),
+		patchBytes / 1024.0f, m_terrainInstances.size() * sizeof(Helpers::TerrainInstance) / 1024.0f);
+	if (m_meshTerrainBuilt)
+		ImGui::Text("Per-vertex: %.2f MB at %d cells, about %.1f MB at %d", m_meshTerrainBytes / (1024.0f * 1024.0f), m_meshTerrainCells,
+			meshBytesPerCell * terrainSize * terrainSize / (1024.0 * 1024.0), terrainSize);
+	else
+		ImGui::Text("Per-vertex: built the first time the quadtree terrain is turned off");
+
+	// Draw calls would be one per submesh without load time merging
+	size_t numUnmergedDraws{ 0 };
+	for (const Model& model : modelVector)
+		for (const Mesh& mesh : model.meshVector)
+			numUnmergedDraws += mesh.numSubmeshes;
+	ImGui::Text("%zu draw calls, %zu without mesh merging", m_numDrawCalls, numUnmergedDraws);
+
+	// State calls made through the cache last frame and how many actually reached the driver
+	if (ImGui::CollapsingHeader("GL state calls")) {
+		for (int c = 0; c < (int)Helpers::GLCall::Count; c++) {
+			const Helpers::GLCallCounter& counter = m_state.Counter((Helpers::GLCall)c);
+			ImGui::Text("%s: %zu issued, %zu filtered", Helpers::GLCallName((Helpers::GLCall)c), counter.issued,
+				counter.requested - counter.issued);
+		}
+	}
+
+	// One glMultiDrawElementsIndirect per batch instead of a draw per mesh, compare with the benchmark grid
+	ImGui::Checkbox("Multi-draw indirect", &m_useMultiDrawIndirect);
+	ImGui::SliderInt("Benchmark grid", &m_benchmarkGridSize, 0, 48);
+	ImGui::Text("%zu meshes, submit %.3f ms CPU %.3f ms GPU", m_drawItems.size(), m_submitMs, m_gpuSubmitMs);
+	ImGui::Text("Uniform ring %.1f / %.1f KB per frame, %zu stalls", m_uniformRing.BytesUsed() / 1024.0f,
+		m_uniformRing.BytesPerFrame() / 1024.0f, m_uniformRing.NumStalls());
+
+	// Hardware instanced aqua pigs, 100 x 100 is the 10k stress scene
+	ImGui::SliderInt("Instanced grid", &m_instanceGridSize, 0, 100);
+	ImGui::Checkbox("Animate instances", &m_animateInstances);
+	ImGui::Text("%zu instances, %.1f KB instance data uploaded", m_instancedPigs.instances.NumInstances(), m_instanceBytesUploaded / 1024.0f);
+
+	// Simulated 16 entry FIFO cache, before and after reordering
+	if (ImGui::CollapsingHeader("Vertex cache")) {
+		for (const Helpers::MeshOptimizeReport& report : m_optimizeReports)
+			ImGui::Text("%s (%zu tris) ACMR %.2f -> %.2f ATVR %.2f -> %.2f", report.name.c_str(), report.numTriangles,
+				report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr);
+	}
+
+	// Geometry arena fill, padding and fragmentation
+	if (ImGui::CollapsingHeader("Geometry arena")) {
+		auto showStats = [](const char* name, const Helpers::GeometryArenaStats& stats) {
+			ImGui::Text("%s: %.1f / %.1f MB (%.1f%%), %zu B padding, %zu free ranges, largest %.1f MB", name,
+				stats.usedBytes / (1024.0f * 1024.0f), stats.capacityBytes / (1024.0f * 1024.0f),
+				stats.capacityBytes ? 100.0f * stats.usedBytes / stats.capacityBytes : 0.0f,
+				stats.paddingBytes, stats.numFreeRanges, stats.largestFreeBytes / (1024.0f * 1024.0f));
+		};
+		showStats("Float vertices", m_geometryArena.VertexStats(Helpers::VertexFormat::Float));
+		showStats("Quantized vertices", m_geometryArena.VertexStats(Helpers::VertexFormat::Quantized));
+		showStats("Indices", m_geometryArena.IndexStats());
+	}
+
+	// Resident textures and what sharing them saved
+	if (ImGui::CollapsingHeader("Textures")) {
+		ImGui::Text("%zu textures, %.1f MB, %zu duplicate loads avoided (%.1f MB)", m_textures.NumResident(),
+			m_textures.ResidentBytes() / (1024.0f * 1024.0f), m_textures.DuplicatesAvoided(), m_textures.BytesSaved() / (1024.0f * 1024.0f));
+		for (const Helpers::TextureReportEntry& texture : m_textures.Report())
+			ImGui::Text("%s %dx%d %.1f MB, %d refs, %zu requests", texture.path.c_str(), texture.width, texture.height,
+				texture.bytes / (1024.0f * 1024.0f), texture.refCount, texture.requests);
+	}
+
+	// Cold (ASSIMP) vs. warm (mesh cache) load times for everything under Data\Models
+	if (ImGui::Button("Benchmark model cache"))
+		m_cacheBenchmark = Helpers::BenchmarkMeshCache("Data\\Models");
+
+	for (const Helpers::MeshCacheBenchmarkResult& result : m_cacheBenchmark)
+	{
+		if (result.ok)
+			ImGui::Text("%s cold %.1fms warm %.1fms", result.filename.c_str(), result.coldMs, result.warmMs);
+		else
+			ImGui::Text("%s failed to load", result.filename.c_str());
+	}
 		
 	ImGui::End();
 }
 
 // Load, compile and link the shaders and create a program object to host them
-GLuint Renderer::CreateProgram(std::string vsPath, std::string fsPath)
+Helpers::ShaderProgram Renderer::CreateProgram(std::string vsPath, std::string fsPath)
 {
 	//This function has been edited to make a program based on passedin shaders
 
@@ -44,7 +269,7 @@ GLuint Renderer::CreateProgram(std::string vsPath, std::string fsPath)
 	GLuint vertex_shader{ Helpers::LoadAndCompileShader(GL_VERTEX_SHADER, vsPath) };
 	GLuint fragment_shader{ Helpers::LoadAndCompileShader(GL_FRAGMENT_SHADER, fsPath) };
 	if (vertex_shader == 0 || fragment_shader == 0)
-		return false;
+		return Helpers::ShaderProgram();
 
 	// Attach the vertex shader to this program (copies it)
 	glAttachShader(program, vertex_shader);
@@ -65,12 +290,72 @@ GLuint Renderer::CreateProgram(std::string vsPath, std::string fsPath)
 		return 0;*/
 
 	if (!Helpers::LinkProgramShaders(program))
-		return 0;
+		return Helpers::ShaderProgram();
 
-	return program;
+	// Wrapping it queries all the uniforms, inputs and blocks once here rather than every frame
+	return Helpers::ShaderProgram(program);
 }
 
 
+// Upload mesh data as one interleaved vertex buffer plus an element buffer and wrap them in a vertex array object
+Mesh Renderer::CreateMesh(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+	const std::vector<glm::vec2>& uvCoords, const std::vector<GLuint>& elements, Helpers::VertexFormat format,
+	const std::vector<Helpers::MeshLod>& lods)
+{
+	Mesh newMesh;
+
+	//local box, and a bounding sphere around the centre of the box
+	if (!positions.empty()) {
+		Helpers::GetExtents(positions, newMesh.boundsMin, newMesh.boundsMax);
+		newMesh.boundsCentre = (newMesh.boundsMin + newMesh.boundsMax) * 0.5f;
+		for (const glm::vec3& p : positions)
+			newMesh.boundsRadius = std::max(newMesh.boundsRadius, glm::distance(newMesh.boundsCentre, p));
+	}
+
+	Helpers::PackedVertices packed{ Helpers::PackVertices(format, positions, normals, uvCoords) };
+	newMesh.vertexFormat = format;
+	newMesh.positionOffset = packed.positionOffset;
+	newMesh.positionScale = packed.positionScale;
+	newMesh.numVertices = (GLuint)packed.numVertices;
+
+	//elements, each level of detail is appended after the full detail indices
+	newMesh.numElements = (GLuint)elements.size();
+	std::vector<GLuint> allElements{ elements };
+	for (const Helpers::MeshLod& lod : lods) {
+		newMesh.lods.push_back(MeshLodRange{ (GLuint)allElements.size(), (GLuint)lod.elements.size(), lod.error });
+		allElements.insert(allElements.end(), lod.elements.begin(), lod.elements.end());
+	}
+
+	//small mesh get 8 or 16 bit indices
+	const GLenum indexType{ Helpers::IndexTypeFor(positions.size()) };
+	const std::vector<unsigned char> packedElements{ Helpers::PackIndices(indexType, allElements) };
+
+	//copy into the shared buffers, a mesh that does not fit is not drawn
+	if (!m_geometryArena.Allocate(packed, indexType, packedElements, newMesh.geometry)) {
+		newMesh.numElements = 0;
+		newMesh.lods.clear();
+	}
+
+	return newMesh;
+}
+
+// Pick the coarsest level whose error, projected to the screen at this distance, stays under the pixel threshold
+MeshLodRange Renderer::SelectLod(const Mesh& mesh, float distance, float pixelsPerUnitAtOne) const
+{
+	MeshLodRange selected{ 0, mesh.numElements, 0 };
+	if (!m_useLods)
+		return selected;
+
+	const float pixelsPerUnit{ pixelsPerUnitAtOne / distance };
+	for (const MeshLodRange& lod : mesh.lods) {
+		if (lod.error * pixelsPerUnit > m_lodPixelThreshold)
+			break;
+		selected = lod;
+	}
+
+	return selected;
+}
+
 // Load / create geometry into OpenGL buffers	
 bool Renderer::InitialiseGeometry()
 {
@@ -78,157 +363,96 @@ bool Renderer::InitialiseGeometry()
 	m_program = CreateProgram("Data\\Shaders\\vertex_shader.vert", "Data\\Shaders\\fragment_shader.frag");
 	m_cubeProgram = CreateProgram("Data\\Shaders\\cube_vertex_shader.vert", "Data\\Shaders\\cube_fragment_shader.frag");
 	m_skyProgram = CreateProgram("Data\\Shaders\\sky_vertex_shader.vert", "Data\\Shaders\\sky_fragment_shader.frag");
+	m_indirectProgram = CreateProgram("Data\\Shaders\\indirect_vertex_shader.vert", "Data\\Shaders\\indirect_fragment_shader.frag");
+	m_instancedProgram = CreateProgram("Data\\Shaders\\instanced_vertex_shader.vert", "Data\\Shaders\\instanced_fragment_shader.frag");
+	m_skyboxProgram = CreateProgram("Data\\Shaders\\skybox_vertex_shader.vert", "Data\\Shaders\\skybox_fragment_shader.frag");
+	m_terrainProgram = CreateProgram("Data\\Shaders\\terrain_vertex_shader.vert", "Data\\Shaders\\terrain_fragment_shader.frag");
+	if (!m_program.Valid() || !m_cubeProgram.Valid() || !m_skyProgram.Valid() || !m_indirectProgram.Valid() || !m_instancedProgram.Valid()
+		|| !m_skyboxProgram.Valid() || !m_terrainProgram.Valid()) {
+		return false;
+	}
+
+	//the cube map sky has no vertices but a VAO still has to be bound to draw
+	glCreateVertexArrays(1, &m_emptyVao);
+	if (!LoadSkyCubeMap(m_skySet)) {
+		return false;
+	}
+
+	//uniforms for a frame, grows if a frame ever needs more
+	if (!m_uniformRing.Initialise(GL_UNIFORM_BUFFER, 1024 * 1024)) {
+		return false;
+	}
+
+	//shared buffers for every mesh, sized for the scene with room to spare
+	if (!m_geometryArena.Initialise(16 * 1024 * 1024, 16 * 1024 * 1024)) {
+		return false;
+	}
+
+	//==================================================================================================================================================================
+	//start parsing every model file on worker threads, each is collected and uploaded below once needed
+	Helpers::AsyncModelLoader modelLoader;
+
+	//the sky is unlit so only needs uvs
+	Helpers::LoadOptions skyOptions;
+	skyOptions.attributes = Helpers::MeshAttribute_UVs;
+	const size_t skyTicket{ modelLoader.Submit("Data\\Models\\Sky\\Clouds\\skybox.x", skyOptions) };
+
+	//list of all file names for meshes
+	std::vector<std::string> aquaPigMeshes = 
+	{ "Data\\Models\\AquaPig\\hull.obj",
+		"Data\\Models\\AquaPig\\wing_right.obj",
+		"Data\\Models\\AquaPig\\wing_left.obj",
+		"Data\\Models\\AquaPig\\propeller.obj",
+		"Data\\Models\\AquaPig\\gun_base.obj",
+		"Data\\Models\\AquaPig\\gun.obj" };
+
+	//the aqua pig is drawn at a distance so gets levels of detail
+	Helpers::LoadOptions aquaPigOptions;
+	aquaPigOptions.generateLods = true;
+	aquaPigOptions.optimizeMeshes = true;
+	aquaPigOptions.mergeMeshes = true;
+
+	for (const std::string& fileName : aquaPigMeshes)
+		modelLoader.Submit(fileName, aquaPigOptions);
 
 	//==================================================================================================================================================================
 	//make skybox
 	Model skyModel;
 	skyModel.modelName = "skybox";
+	skyModel.kind = ModelKind::Sky;
 
 	int textureNumber = 0;
 
 	//load skybox model
-	Helpers::ModelLoader loader;
-	if (!loader.LoadFromFile("Data\\Models\\Sky\\Clouds\\skybox.x")) {
+	Helpers::LoadedModel skyLoaded{ modelLoader.Collect(skyTicket) };
+	if (!skyLoaded.ok) {
 		return false;
 	}
 
 	//loop through all of the mesh in the model:
-	for (const Helpers::Mesh& mesh : loader.GetMeshVector()) {
-		std::vector<glm::vec3> vertices = mesh.vertices;
-		std::vector<glm::vec3> normals = mesh.normals;
-		std::vector<GLuint> elements = mesh.elements;
-		std::vector<glm::vec2> texCoords = mesh.uvCoords;
-
-		Mesh newMesh;
-
-		//VBOs
-		//positions
-		GLuint positionsVBO;
-		glGenBuffers(1, &positionsVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		//normals
-		GLuint normalsVBO;
-		glGenBuffers(1, &normalsVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * normals.size(), normals.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		//texture coordinates
-		GLuint textCoordsVBO;
-		glGenBuffers(1, &textCoordsVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, textCoordsVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * texCoords.size(), texCoords.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		//elements
-		newMesh.numElements = elements.size();
-		GLuint elementsEBO;
-		glGenBuffers(1, &elementsEBO);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * elements.size(), elements.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-
-		//VAOs
-		//positons
-		glGenVertexArrays(1, &newMesh.vao);
-		glBindVertexArray(newMesh.vao);
-		glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
-		glEnableVertexAttribArray(0);
-
-		glVertexAttribPointer(
-			0,
-			3,
-			GL_FLOAT,
-			GL_FALSE,
-			0,
-			(void*)0
-		);
-
-		//normals
-		glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-		glEnableVertexAttribArray(1);
-
-		glVertexAttribPointer(
-			1,
-			3,
-			GL_FLOAT,
-			GL_FALSE,
-			0,
-			(void*)0
-		);
-
-		//texture
-		glBindBuffer(GL_ARRAY_BUFFER, textCoordsVBO);
-		glEnableVertexAttribArray(2);
-
-		glVertexAttribPointer(
-			2,
-			2,
-			GL_FLOAT,
-			GL_FALSE,
-			0,
-			(void*)0
-		);
-
-		//elements
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO);
-		glBindVertexArray(0);
-
-		//Texture loading
-		Helpers::ImageLoader Imageloader2;
-
-		//load a texture for each face of teh skybox model 
-		switch (textureNumber) {
-		case 0:
-			if (!Imageloader2.Load("Data\\Models\\Sky\\Clouds\\SkyBox_Top.tga")) {
-				return false;
-			}
-			break;
-		case 1:
-			if (!Imageloader2.Load("Data\\Models\\Sky\\Clouds\\SkyBox_Right.tga")) {
-				return false;
-			}
-			break;
-		case 2:
-			if (!Imageloader2.Load("Data\\Models\\Sky\\Clouds\\SkyBox_Left.tga")) {
+	for (const Helpers::Mesh& mesh : skyLoaded.loader->GetMeshVector()) {
+		Mesh newMesh{ CreateMesh(mesh.vertices, mesh.normals, mesh.uvCoords, mesh.elements, m_vertexFormat) };
+
+		//one texture for each face of the skybox model, in the order of its meshes
+		const char* skyFaces[] = {
+			"Data\\Models\\Sky\\Clouds\\SkyBox_Top.tga",
+			"Data\\Models\\Sky\\Clouds\\SkyBox_Right.tga",
+			"Data\\Models\\Sky\\Clouds\\SkyBox_Left.tga",
+			"Data\\Models\\Sky\\Clouds\\SkyBox_Front.tga",
+			"Data\\Models\\Sky\\Clouds\\SkyBox_Back.tga",
+			"Data\\Models\\Sky\\Clouds\\SkyBox_Bottom.tga" };
+
+		if (textureNumber < 6) {
+			//clamped so the face edges do not pick up the opposite side
+			Helpers::TextureSettings skySettings;
+			skySettings.wrap = GL_CLAMP_TO_EDGE;
+
+			newMesh.tex = m_textures.Acquire(skyFaces[textureNumber], skySettings);
+			if (!newMesh.tex) {
 				return false;
 			}
-			break;
-		case 3:
-			if (!Imageloader2.Load("Data\\Models\\Sky\\Clouds\\SkyBox_Front.tga")) {
-				return false;
-			}
-			break;
-		case 4:
-			if (!Imageloader2.Load("Data\\Models\\Sky\\Clouds\\SkyBox_Back.tga")) {
-				return false;
-			}
-			break;
-		case 5:
-			if (!Imageloader2.Load("Data\\Models\\Sky\\Clouds\\SkyBox_Bottom.tga")) {
-				return false;
-			}
-			break;
-		default:
-			break;
 		}
 
-		
-		glGenTextures(1, &newMesh.tex);
-		glBindTexture(GL_TEXTURE_2D, newMesh.tex);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, Imageloader2.Width(), Imageloader2.Height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, Imageloader2.GetData());
-		glGenerateMipmap(GL_TEXTURE_2D);
-
 		skyModel.meshVector.emplace_back(newMesh);
 
 		textureNumber++;
@@ -239,8 +463,7 @@ bool Renderer::InitialiseGeometry()
 	//make cube
 	Model cube;
 	cube.modelName = "Cube";
-
-	Mesh cubeMesh;
+	cube.kind = ModelKind::Cube;
 
 	//make cube vertecies
 	std::vector<glm::vec3> cubeVertices = {
@@ -315,88 +538,469 @@ bool Renderer::InitialiseGeometry()
 		23, 22, 20
 	};
 
-	//positions
-	GLuint cubePositionsVBO;
-	glGenBuffers(1, &cubePositionsVBO);
+	//reorder for the vertex cache, the report is shown in the GUI
+	Helpers::MeshOptimizeReport cubeReport;
+	cubeReport.name = "Cube";
+	const std::vector<GLuint> cubeRemap{ Helpers::OptimizeIndexLists({ &cubeElements }, cubeVertices, cubeReport) };
+	Helpers::RemapVertexStream(cubeVertices, cubeRemap);
+	Helpers::RemapVertexStream(cubeColours, cubeRemap);
+	m_optimizeReports.push_back(cubeReport);
+
+	// The cube shader reads its colours from the normal attribute. Always float so the colours are not octahedral encoded
+	Mesh cubeMesh{ CreateMesh(cubeVertices, cubeColours, {}, cubeElements, Helpers::VertexFormat::Float) };
+
+	cubeMesh.translation = glm::vec3(-10, 20, -170);
+
+	cube.meshVector.emplace_back(cubeMesh);
+
+	//the original mesh terrain is only built once the quadtree terrain is turned off, so its heightmap is not decoded at startup
+	if (!m_quadtreeTerrain && !BuildMeshTerrain()) {
+		return false;
+	}
+
 
-	glBindBuffer(GL_ARRAY_BUFFER, cubePositionsVBO);
+	//==================================================================================================================================================================
+	//quadtree terrain, every quadrant of every node is an instance of this one patch
+	std::vector<glm::vec3> patchPositions;
+	std::vector<GLuint> patchElements;
+	Helpers::Terrain::CreatePatch(patchPositions, patchElements);
+
+	Helpers::MeshOptimizeReport patchReport;
+	patchReport.name = "Terrain patch";
+	const std::vector<GLuint> patchRemap{ Helpers::OptimizeIndexLists({ &patchElements }, patchPositions, patchReport) };
+	Helpers::RemapVertexStream(patchPositions, patchRemap);
+	m_optimizeReports.push_back(patchReport);
+
+	//float so the shader gets whole cell positions back
+	m_terrainPatch = CreateMesh(patchPositions, {}, {}, patchElements, Helpers::VertexFormat::Float);
+
+	m_terrainTexture = m_textures.Acquire("Data\\Textures\\ocean.jpg");
+	if (!m_terrainTexture || !BuildTerrain()) {
+		return false;
+	}
+
+	//==================================================================================================================================================================
+	Model newModel;
+	newModel.modelName = "aquaPig";
+
+	for (size_t part = 0; part < aquaPigMeshes.size(); part++) {
+		//upload the aqua pig parts in whatever order the workers finish them
+		Helpers::LoadedModel loaded{ modelLoader.CollectAny() };
+		if (!loaded.ok) {
+			return false;
+		}
+
+		const std::string& fileName = loaded.filename;
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* cubeVertices.size(), cubeVertices.data(), GL_STATIC_DRAW);
+		//no reports if it came from the mesh cache, it was optimised when the cache was written
+		for (Helpers::MeshOptimizeReport report : loaded.loader->GetOptimizeReports()) {
+			report.name = fileName;
+			m_optimizeReports.push_back(report);
+		}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//now we can loop through all of the mesh in the model:
+		for (const Helpers::Mesh& mesh : loaded.loader->GetMeshVector()) {
+			Mesh newMesh{ CreateMesh(mesh.vertices, mesh.normals, mesh.uvCoords, mesh.elements, m_vertexFormat, mesh.lods) };
+			newMesh.numSubmeshes = (GLuint)std::max<size_t>(1, mesh.submeshes.size());
+
+			//set data in mesh struct based on each mesh
+			if (fileName == "Data\\Models\\AquaPig\\hull.obj") {
+				newMesh.translation = glm::vec3(0, 0, 0);
+				newMesh.rotation = glm::vec3(-0.174533, 0, 0);
+				newMesh.name = "Data\\Models\\AquaPig\\hull.obj";
+			}
+			else if (fileName == "Data\\Models\\AquaPig\\wing_right.obj") {
+				newMesh.translation = glm::vec3(-2.231, 0.272, -2.663);
+				newMesh.rotation = glm::vec3(-0.174533, 0, 0);
+				newMesh.name = "Data\\Models\\AquaPig\\wing_right.obj";
+			}
+			else if (fileName == "Data\\Models\\AquaPig\\wing_left.obj") {
+				newMesh.translation = glm::vec3(2.231, 0.272, -2.663);
+				newMesh.rotation = glm::vec3(-0.174533, 0, 0);
+				newMesh.name = "Data\\Models\\AquaPig\\wing_left.obj";
+			}
+			else if (fileName == "Data\\Models\\AquaPig\\propeller.obj") {
+				newMesh.translation = glm::vec3(0, 0.695, -3.816);
+				newMesh.rotation = glm::vec3(glm::half_pi<float>() - 0.174533, 0, 0);
+				newMesh.name = "Data\\Models\\AquaPig\\propeller.obj";
+				newMesh.spins = true;
+			}
+			else if (fileName == "Data\\Models\\AquaPig\\gun_base.obj") {
+				newMesh.translation = glm::vec3(0, 0.569, -1.866);
+				newMesh.rotation = glm::vec3(-0.174533, 0, 0);
+				newMesh.name = "Data\\Models\\AquaPig\\gun_base.obj";
+			}
+			else if (fileName == "Data\\Models\\AquaPig\\gun.obj") {
+				newMesh.translation = glm::vec3(0, 2.026, -1.214);
+				newMesh.rotation = glm::vec3(-0.174533, 0, 0);
+				newMesh.name = "Data\\Models\\AquaPig\\gun.obj";
+			}
 
-	//colours
-	GLuint cubeColoursVBO;
-	glGenBuffers(1, &cubeColoursVBO);
+			//every part shares the one atlas, only the first request loads it
+			newMesh.tex = m_textures.Acquire("Data\\Models\\AquaPig\\aqua_pig_2K.png");
+			if (!newMesh.tex) {
+				return false;
+			}
 
-	glBindBuffer(GL_ARRAY_BUFFER, cubeColoursVBO);
+			newModel.meshVector.emplace_back(newMesh);
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* cubeColours.size(), cubeColours.data(), GL_STATIC_DRAW);
+		}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 
+	//world bounds for culling, before the models are copied into modelVector. The cube and the propeller rotate so
+	//get a sphere that covers every angle
+	for (Model* model : { &cube, &newModel })
+		for (Mesh& mesh : model->meshVector)
+			ComputeWorldBounds(mesh, model->kind == ModelKind::Cube || mesh.spins);
 
-	cubeMesh.numElements = cubeElements.size();
+	//push all models onto modelVector
+	modelVector.emplace_back(skyModel);
+	modelVector.emplace_back(cube);
+	m_benchmarkModel = (int)modelVector.size();
+	m_instancedPigs.model = (int)modelVector.size();
+	modelVector.emplace_back(newModel);
 
-	GLuint cubeElementsEBO;
-	glGenBuffers(1, &cubeElementsEBO);
+	//loading bound textures and buffers behind the state cache's back
+	m_state.Invalidate();
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeElementsEBO);
 
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)* cubeElements.size(), cubeElements.data(), GL_STATIC_DRAW);
+	return true;
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
 
-	//positions
-	glGenVertexArrays(1, &cubeMesh.vao);
+// Render the scene. Passed the delta time since last called.
+void Renderer::Render(const Helpers::Camera& camera, float deltaTime)
+{			
+	// Every state change below goes through the cache, which drops the ones that change nothing
+	m_state.ResetCounters();
 
-	glBindVertexArray(cubeMesh.vao);
+	// Configure pipeline settings, less or equal lets the sky pass at the far plane
+	m_state.SetCapability(GL_DEPTH_TEST, true);
+	m_state.SetCapability(GL_CULL_FACE, true);
+	m_state.SetCapability(GL_TEXTURE_CUBE_MAP_SEAMLESS, true);
+	m_state.DepthFunc(GL_LEQUAL);
 
-	glBindBuffer(GL_ARRAY_BUFFER, cubePositionsVBO);
+	// Wireframe mode controlled by ImGui
+	m_state.PolygonMode(m_wireframe ? GL_LINE : GL_FILL);
 
-	glEnableVertexAttribArray(0);
+	// Clear buffers from previous frame, the depth mask also masks the clear
+	m_state.DepthMask(GL_TRUE);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glVertexAttribPointer(
-		0,
-		3,
-		GL_FLOAT,
-		GL_FALSE,
-		0,
-		(void*)0
-	);
+	// Compute viewport and projection matrix
+	GLint viewportSize[4];
+	glGetIntegerv(GL_VIEWPORT, viewportSize);
+	const float aspect_ratio = viewportSize[2] / (float)viewportSize[3];
+	const float fovY{ glm::radians(45.0f) };
+	const float nearPlane{ 0.1f };
+	const float farPlane{ 1500.0f };
+	glm::mat4 projection_xform = glm::perspective(fovY, aspect_ratio, nearPlane, farPlane);
+
+	// Pixels covered by one world unit one unit in front of the camera, used for level of detail selection
+	const float pixelsPerUnitAtOne{ viewportSize[3] / (2.0f * std::tan(fovY * 0.5f)) };
+	m_numTrianglesDrawn = 0;
+	m_numDrawCalls = 0;
+
+	// Compute camera view matrix once, the sky drops the translation so it stays centred on the camera
+	const glm::mat4 view_xform = glm::lookAt(camera.GetPosition(), camera.GetPosition() + camera.GetLookVector(), camera.GetUpVector());
+	const glm::mat4 combined_xform = projection_xform * view_xform;
+	const glm::mat4 sky_combined_xform = projection_xform * glm::mat4(glm::mat3(view_xform));
+
+	// Animation is advanced once per frame
+	m_cubeAngle += 0.003f;
+	if (m_cubeAngle > glm::two_pi<float>())
+	{
+		m_cubeAngle = 0;
+		m_cubeRotateY = !m_cubeRotateY;
+	}
+	m_propellerAngle += 0.02f;
+	m_time += deltaTime;
+
+	// Time everything from gathering the draws to the last submit. The GPU time is read a frame late so it never stalls.
+	if (m_timerQueryIssued) {
+		GLuint64 gpuNs{ 0 };
+		glGetQueryObjectui64v(m_timerQuery, GL_QUERY_RESULT_NO_WAIT, &gpuNs);
+		if (gpuNs)
+			m_gpuSubmitMs = gpuNs / 1000000.0f;
+	}
+	else {
+		glGenQueries(1, &m_timerQuery);
+		m_timerQueryIssued = true;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, m_timerQuery);
+	const auto submitStart = std::chrono::high_resolution_clock::now();
+
+	// Gather every mesh into a draw item with its world bounds, then queue the visible ones with a sort key
+	m_drawItems.clear();
+	m_cullSpheres.Clear();
+	m_renderQueue.Clear();
+
+	auto addItem = [&](const DrawItem& item) {
+		// Meshes that did not fit in the arena have nothing to draw, as DrawInstanced and IndirectBatcher::Add skip
+		if (!item.mesh->geometry.valid)
+			return;
+
+		// The sky surrounds the camera so is never culled
+		const bool sky{ item.pass == RenderPass::Sky };
+		m_cullSpheres.Add(item.mesh->worldCentre + item.boundsOffset, sky ? std::numeric_limits<float>::max() : item.mesh->worldRadius);
+		m_drawItems.push_back(item);
+	};
 
-	//colours
+	auto queueItem = [&](size_t index) {
+		DrawItem& item = m_drawItems[index];
+		const Mesh& mesh = *item.mesh;
 
-	glBindBuffer(GL_ARRAY_BUFFER, cubeColoursVBO);
+		// Distance to the nearest point of the bounds, clamped so the camera being inside does not divide by zero
+		const glm::vec3 worldCentre{ item.modelXform * glm::vec4(mesh.boundsCentre, 1.0f) };
+		const float distance{ std::max(glm::distance(camera.GetPosition(), worldCentre) - mesh.boundsRadius, nearPlane) };
+		item.lod = SelectLod(mesh, distance, pixelsPerUnitAtOne);
 
-	glEnableVertexAttribArray(1);
+		const uint64_t key{ Helpers::MakeSortKey((unsigned int)item.pass, item.program->Id(), mesh.tex,
+			(unsigned int)mesh.geometry.format, distance / farPlane) };
+		m_renderQueue.Add(key, (uint32_t)index);
+	};
 
-	glVertexAttribPointer(
-		1,
-		3,
-		GL_FLOAT,
-		GL_FALSE,
-		0,
-		(void*)0
-	);
+	for (const Model& model : modelVector) {
+		//replaced by the cube map, drawn after everything else
+		if (model.kind == ModelKind::Sky && m_cubeMapSky)
+			continue;
 
-	//elements
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeElementsEBO);
+		//replaced by the quadtree terrain, drawn after the queue
+		if (model.kind == ModelKind::Terrain && m_quadtreeTerrain)
+			continue;
 
-	glBindVertexArray(0);
+		for (const Mesh& mesh : model.meshVector) {
+			DrawItem item;
+			item.mesh = &mesh;
 
-	cubeMesh.translation = glm::vec3(-10, 20, -170);
+			if (model.kind == ModelKind::Sky) {
+				item.pass = RenderPass::Sky;
+				item.program = &m_skyProgram;
+			}
+			else if (model.kind == ModelKind::Cube) {
+				item.program = &m_cubeProgram;
+				item.modelXform = glm::translate(glm::mat4(1), mesh.translation);
 
-	cube.meshVector.emplace_back(cubeMesh);
+				if (m_cubeRotateY) // Rotate around y axis		
+					item.modelXform = glm::rotate(item.modelXform, m_cubeAngle, glm::vec3{ 0 ,1,0 });
+				else // Rotate around x axis		
+					item.modelXform = glm::rotate(item.modelXform, m_cubeAngle, glm::vec3{ 1 ,0,0 });
+			}
+			else {
+				item.program = &m_program;
+				item.modelXform = MeshXform(mesh);
+			}
 
+			addItem(item);
+		}
+	}
 
-	//==================================================================================================================================================================
-	//make terrain
+	// Benchmark scene, a grid of copies of the aqua pig above the terrain
+	if (m_benchmarkModel >= 0) {
+		for (int gridZ = 0; gridZ < m_benchmarkGridSize; gridZ++) {
+			for (int gridX = 0; gridX < m_benchmarkGridSize; gridX++) {
+				const glm::vec3 offset{ (gridX - m_benchmarkGridSize / 2) * 12.0f, 40.0f, -gridZ * 12.0f };
+
+				for (const Mesh& mesh : modelVector[m_benchmarkModel].meshVector) {
+					DrawItem item;
+					item.mesh = &mesh;
+					item.program = &m_program;
+					item.modelXform = glm::translate(glm::mat4(1), offset) * MeshXform(mesh);
+					item.boundsOffset = offset;
+					addItem(item);
+				}
+			}
+		}
+	}
+
+	// Spheres four at a time, then the box of anything whose sphere got through
+	m_frustum.Extract(combined_xform);
+	if (m_frustumCulling)
+		m_frustum.TestSpheres(m_cullSpheres, m_visible);
+	else
+		m_visible.assign(m_drawItems.size(), 1);
+
+	m_numVisible = 0;
+	m_numCulled = 0;
+	for (size_t i = 0; i < m_drawItems.size(); i++) {
+		const DrawItem& item = m_drawItems[i];
+		bool visible{ m_visible[i] != 0 };
+		if (visible && m_frustumCulling && item.pass != RenderPass::Sky)
+			visible = m_frustum.TestBox(item.mesh->worldMin + item.boundsOffset, item.mesh->worldMax + item.boundsOffset);
+
+		if (!visible) {
+			m_numCulled++;
+			continue;
+		}
+
+		m_numVisible++;
+		queueItem(i);
+	}
+
+	m_renderQueue.Sort();
+
+	// Finished terrain tiles are uploaded, then nodes are culled while walking down each tile's tree
+	if (m_quadtreeTerrain) {
+		m_terrain.Update(camera.GetPosition(), m_terrainStreamRadius, (size_t)m_terrainUploadBudgetKB * 1024);
+		m_terrain.Select(camera.GetPosition(), m_terrainLodDistance, m_frustumCulling ? &m_frustum : nullptr);
+	}
+	m_terrainInstances.clear();
+	if (m_quadtreeTerrain)
+		m_terrain.Instances(m_terrainInstances);
+	const size_t terrainBlockBytes{ sizeof(Helpers::TerrainInstance) * Helpers::Terrain::kMaxInstancesPerDraw };
+	const size_t numTerrainDraws{ (m_terrainInstances.size() + Helpers::Terrain::kMaxInstancesPerDraw - 1) / Helpers::Terrain::kMaxInstancesPerDraw };
+
+	// Everything the shaders need this frame goes into the ring: the frame constants, then one block per draw in
+	// submit order plus one per instanced mesh, then the terrain's
+	const size_t drawConstantsStride{ m_uniformRing.AlignedSize(sizeof(DrawConstants)) };
+	const size_t numInstancedMeshes{ m_instancedPigs.model >= 0 ? modelVector[m_instancedPigs.model].meshVector.size() : 0 };
+	const size_t ringBytesNeeded{ m_uniformRing.AlignedSize(sizeof(FrameConstants)) + drawConstantsStride * (m_drawItems.size() + numInstancedMeshes)
+		+ m_uniformRing.AlignedSize(sizeof(Helpers::TerrainConstants)) + m_uniformRing.AlignedSize(terrainBlockBytes) * numTerrainDraws };
+
+	if (!m_uniformRing.BeginFrame(ringBytesNeeded)) {
+		glEndQuery(GL_TIME_ELAPSED);
+		return;
+	}
+
+	FrameConstants frameConstants;
+	frameConstants.viewXform = view_xform;
+	frameConstants.projectionXform = projection_xform;
+	frameConstants.combinedXform = combined_xform;
+	frameConstants.skyCombinedXform = sky_combined_xform;
+	frameConstants.cameraPosition = glm::vec4(camera.GetPosition(), 1.0f);
+	frameConstants.time = glm::vec4(m_time, deltaTime, 0, 0);
+	const size_t frameConstantsOffset{ m_uniformRing.Write(&frameConstants, sizeof(frameConstants)) };
+	m_state.BindBufferRange(GL_UNIFORM_BUFFER, 0, m_uniformRing.Buffer(), frameConstantsOffset, sizeof(FrameConstants));
+
+	//built in submit order then copied into the mapped memory in one go
+	m_drawConstantsStaging.resize(drawConstantsStride * m_drawItems.size());
+	for (size_t e = 0; e < m_renderQueue.Entries().size(); e++) {
+		const DrawItem& item = m_drawItems[m_renderQueue.Entries()[e].item];
+		DrawConstants& constants = *(DrawConstants*)(m_drawConstantsStaging.data() + e * drawConstantsStride);
+		constants.modelXform = item.modelXform;
+		constants.positionOffset = glm::vec4(item.mesh->positionOffset, 0);
+		constants.positionScale = glm::vec4(item.mesh->positionScale, item.mesh->vertexFormat == Helpers::VertexFormat::Quantized ? 1.0f : 0.0f);
+	}
+	const size_t drawConstantsOffset{ m_uniformRing.Write(m_drawConstantsStaging.data(), m_drawConstantsStaging.size()) };
+
+	// Submit in key order so the state cache only lets through what differs from the previous draw
+	m_indirectBatcher.Clear();
+
+	for (size_t e = 0; e < m_renderQueue.Entries().size(); e++) {
+		const DrawItem& item = m_drawItems[m_renderQueue.Entries()[e].item];
+		const Mesh& mesh = *item.mesh;
+		Helpers::ShaderProgram* program = item.program;
+
+		//textured meshes are all drawn at the end with a multi-draw per batch, still in key order
+		if (m_useMultiDrawIndirect && program == &m_program) {
+			m_indirectBatcher.Add(mesh.geometry, item.lod.firstElement, item.lod.numElements, mesh.tex, item.modelXform,
+				mesh.positionOffset, mesh.positionScale, mesh.vertexFormat == Helpers::VertexFormat::Quantized);
+			m_numTrianglesDrawn += item.lod.numElements / 3;
+			continue;
+		}
+
+		//the sky is drawn first without depth
+		const bool sky{ item.pass == RenderPass::Sky };
+		m_state.DepthMask(sky ? GL_FALSE : GL_TRUE);
+		m_state.SetCapability(GL_DEPTH_TEST, !sky);
+
+		m_state.UseProgram(program->Id());
+		program->Set("sampler_tex", 0);
+
+		m_state.BindTexture(0, GL_TEXTURE_2D, mesh.tex);
+
+		//one VAO per vertex format, the mesh is found by its offsets in the arena
+		const Helpers::GeometryAllocation& geometry = mesh.geometry;
+		m_state.BindVertexArray(m_geometryArena.Vao(geometry.format));
+
+		// Transform and dequantisation values were written to the ring above
+		BindDrawConstants(drawConstantsOffset + e * drawConstantsStride);
+
+		m_numTrianglesDrawn += item.lod.numElements / 3;
+		m_numDrawCalls++;
+
+		glDrawElementsBaseVertex(GL_TRIANGLES, item.lod.numElements, geometry.indexType,
+			(void*)(geometry.indexByteOffset + (size_t)Helpers::IndexSize(geometry.indexType) * item.lod.firstElement), geometry.baseVertex);
+	}
+
+	if (m_useMultiDrawIndirect) {
+		m_state.DepthMask(GL_TRUE);
+		m_state.SetCapability(GL_DEPTH_TEST, true);
+
+		m_state.UseProgram(m_indirectProgram.Id());
+		m_numDrawCalls += m_indirectBatcher.Submit(m_geometryArena, m_indirectProgram, m_state);
+	}
+
+	if (m_quadtreeTerrain)
+		DrawTerrain();
+
+	//static instances are only uploaded when the grid is rebuilt
+	if (m_instanceGridSize != m_builtInstanceGridSize) {
+		BuildInstanceGrid(m_instancedPigs, m_instanceGridSize);
+		m_builtInstanceGridSize = m_instanceGridSize;
+	}
+
+	if (m_animateInstances) {
+		for (size_t i = 0; i < m_instancedPigs.instances.NumInstances(); i++) {
+			Helpers::InstanceData instance{ m_instancedPigs.instances.Instances()[i] };
+			instance.modelXform[3].y = 15.0f + std::sin(m_propellerAngle + i * 0.1f);
+			m_instancedPigs.instances.Set(i, instance);
+		}
+	}
+
+	m_instanceBytesUploaded = m_instancedPigs.instances.Upload();
+	DrawInstanced(m_instancedPigs, camera.GetPosition(), nearPlane, pixelsPerUnitAtOne);
+
+	//last, so early depth testing skips every pixel the scene already covered
+	if (m_cubeMapSky)
+		DrawSkyCubeMap();
+
+	m_uniformRing.EndFrame();
+
+	m_submitMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - submitStart).count();
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+bool Renderer::LoadSkyCubeMap(int skySet)
+{
+	//no mip chain, the sky is never minified much
+	Helpers::TextureSettings settings;
+	settings.wrap = GL_CLAMP_TO_EDGE;
+	settings.mipmaps = false;
+
+	const GLuint cubeMap{ m_textures.AcquireCubeMap(kSkySets[skySet].faces, settings) };
+	if (!cubeMap) {
+		return false;
+	}
+
+	m_textures.Release(m_skyCubeMap);
+	m_skyCubeMap = cubeMap;
+	return true;
+}
+
+void Renderer::DrawSkyCubeMap()
+{
+	//tested against the scene but never written
+	m_state.DepthMask(GL_FALSE);
+	m_state.SetCapability(GL_DEPTH_TEST, true);
 
+	m_state.UseProgram(m_skyboxProgram.Id());
+	m_state.BindTexture(0, GL_TEXTURE_CUBE_MAP, m_skyCubeMap);
+	m_state.BindVertexArray(m_emptyVao);
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	m_numTrianglesDrawn++;
+	m_numDrawCalls++;
+}
+
+bool Renderer::BuildMeshTerrain()
+{
 	Model terrain;
 	terrain.modelName = "Terrain";
-
-	Mesh newMesh;
+	terrain.kind = ModelKind::Terrain;
 
 	//defines dimentions of terrain
 	int numCellsX{ 150 };
@@ -416,41 +1020,27 @@ bool Renderer::InitialiseGeometry()
 		}
 	}
 
-	newMesh.translation = glm::vec3(-65, -2, 70);
-
 	//==================================================================================================================================================================
-	//heightmap loading
-	Helpers::ImageLoader Imageloader;
-	if (!Imageloader.Load("Data\\Heightmaps\\Test.png")) {
+	//heightmap loading, resampled to the grid so the image can be any resolution without steps in the terrain
+	Helpers::Heightfield heightfield;
+	if (!heightfield.Load("Data\\Heightmaps\\Test.png")) {
 		return false;
 	}
 
-	float vertexXtoImage = (float)Imageloader.Width() / numVertsX;
-	float vertexZtoImage = (float)Imageloader.Height() / numVertsZ;
-
-	GLbyte* imageData = (GLbyte*)Imageloader.GetData();
-
-	//set height of positions to image data in the heightmap
-	for (int z = 0; z < numVertsZ; z++) {
-
-		int imageZ = vertexZtoImage * z;
-
-		for (int x = 0; x < numVertsX; x++) {
-			int imageX = vertexXtoImage * x;
+	//kept as a grid on their own for the normals
+	std::vector<float> heights(numVerts);
+	heightfield.Resample(numVertsX, numVertsZ, Helpers::HeightfieldFilter::Bicubic, Helpers::HeightfieldRegion{ 0, 0, numVertsX, numVertsZ },
+		heights.data());
 
-			size_t offset = ((size_t)imageX + (size_t)imageZ * Imageloader.Width()) * 4;
-			BYTE height = imageData[offset];
-			int myvec = (z * numVertsX) + x;
-
-			positions[myvec].y = ((float)height / 10) - 4;
-
-		}
+	//set height of positions from the 0 to 1 samples, 25.5 units from black to white
+	for (int n = 0; n < numVerts; n++) {
+		heights[n] = heights[n] * 25.5f - 4;
+		positions[n].y = heights[n];
 	}
 
 	//==================================================================================================================================================================
 
 	std::vector<glm::vec3> normals;
-	std::vector<glm::vec3> verticies;
 
 
 	std::vector<glm::vec2> texCoords;
@@ -498,421 +1088,263 @@ bool Renderer::InitialiseGeometry()
 	}
 
 
-	//set normals
-
+	//set normals, straight from the height grid rather than summed over the triangles. Rows run along -z.
 	normals.resize(numVerts);
-	verticies.resize(numVerts);
-
-	for (int e = 0; e < elements.size(); e += 3) {
-		verticies[0] = positions[elements[e]];
-		verticies[1] = positions[elements[(size_t)e + 1]];
-		verticies[2] = positions[elements[(size_t)e + 2]];
-
-		glm::vec3 edge1 = verticies[1] - verticies[0];
-		glm::vec3 edge2 = verticies[2] - verticies[0];
-
-		normals[elements[e]] += glm::cross(edge1, edge2);
-		normals[elements[(size_t)e + 1]] += glm::cross(edge1, edge2);
-		normals[elements[(size_t)e + 2]] += glm::cross(edge1, edge2);
-	}
-
-	for (int n = 0; n < normals.size(); n++) {
-		glm::normalize(normals[n]);
-	}
-
-
-	//VBOs
-	//positions
-	GLuint positionsVBO;
-	glGenBuffers(1, &positionsVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* positions.size(), positions.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	//normals
-	GLuint normalsVBO;
-	glGenBuffers(1, &normalsVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* normals.size(), normals.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	GLuint textCoordsVBO;
-	glGenBuffers(1, &textCoordsVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, textCoordsVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2)* texCoords.size(), texCoords.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	//elements
-	newMesh.numElements = elements.size();
-	GLuint elementsEBO;
-	glGenBuffers(1, &elementsEBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)* elements.size(), elements.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-	//VAOs
-	//positons
-	glGenVertexArrays(1, &newMesh.vao);
-	glBindVertexArray(newMesh.vao);
-	glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(
-		0,
-		3,
-		GL_FLOAT,
-		GL_FALSE,
-		0,
-		(void*)0
-	);
-
-	//normals
-	glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(
-		1,
-		3,
-		GL_FLOAT,
-		GL_FALSE,
-		0,
-		(void*)0
-	);
-
-	//texture
-	glBindBuffer(GL_ARRAY_BUFFER, textCoordsVBO);
-	glEnableVertexAttribArray(2);
-
-	glVertexAttribPointer(
-		2,
-		2,
-		GL_FLOAT,
-		GL_FALSE,
-		0,
-		(void*)0
-	);
-
-	//elements
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO);
-	glBindVertexArray(0);
-
-	//Texture loading
-	Helpers::ImageLoader Imageloader1;
-	if (!Imageloader1.Load("Data\\Textures\\ocean.jpg")) {
-		return false;
-	}
-
-	glGenTextures(1, &newMesh.tex);
-	glBindTexture(GL_TEXTURE_2D, newMesh.tex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, Imageloader1.Width(), Imageloader1.Height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, Imageloader1.GetData());
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	terrain.meshVector.push_back(newMesh);
-
-
-	//==================================================================================================================================================================
-	//list of all file names for meshes
-	std::vector<std::string> aquaPigMeshes = 
-	{ "Data\\Models\\AquaPig\\hull.obj",
-		"Data\\Models\\AquaPig\\wing_right.obj",
-		"Data\\Models\\AquaPig\\wing_left.obj",
-		"Data\\Models\\AquaPig\\propeller.obj",
-		"Data\\Models\\AquaPig\\gun_base.obj",
-		"Data\\Models\\AquaPig\\gun.obj" };
-
-	Model newModel;
-	newModel.modelName = "aquaPig";
-
-	for (std::string fileName : aquaPigMeshes) {
-		//load aqua pig
-		Helpers::ModelLoader loader;
-		if (!loader.LoadFromFile(fileName)) {
-			return false;
-		}
-
-
-		//now we can loop through all of the mesh in the model:
-		for (const Helpers::Mesh& mesh : loader.GetMeshVector()) {
-			std::vector<glm::vec3> vertices = mesh.vertices;
-			std::vector<glm::vec3> normals = mesh.normals;
-			std::vector<GLuint> elements = mesh.elements;
-			std::vector<glm::vec2> texCoords = mesh.uvCoords;
-
-			Mesh newMesh;
-
-			//VBOs
-			//positions
-			GLuint positionsVBO;
-			glGenBuffers(1, &positionsVBO);
-			glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-			//normals
-			GLuint normalsVBO;
-			glGenBuffers(1, &normalsVBO);
-			glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * normals.size(), normals.data(), GL_STATIC_DRAW);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-			GLuint textCoordsVBO;
-			glGenBuffers(1, &textCoordsVBO);
-			glBindBuffer(GL_ARRAY_BUFFER, textCoordsVBO);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * texCoords.size(), texCoords.data(), GL_STATIC_DRAW);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-			//elements
-			newMesh.numElements = elements.size();
-			GLuint elementsEBO;
-			glGenBuffers(1, &elementsEBO);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * elements.size(), elements.data(), GL_STATIC_DRAW);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-
-			//VAOs
-			//positons
-			glGenVertexArrays(1, &newMesh.vao);
-			glBindVertexArray(newMesh.vao);
-			glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
-			glEnableVertexAttribArray(0);
-
-			glVertexAttribPointer(
-				0,
-				3,
-				GL_FLOAT,
-				GL_FALSE,
-				0,
-				(void*)0
-			);
-
-			//normals
-			glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-			glEnableVertexAttribArray(1);
-
-			glVertexAttribPointer(
-				1,
-				3,
-				GL_FLOAT,
-				GL_FALSE,
-				0,
-				(void*)0
-			);
-
-			//texture
-			glBindBuffer(GL_ARRAY_BUFFER, textCoordsVBO);
-			glEnableVertexAttribArray(2);
-
-			glVertexAttribPointer(
-				2,
-				2,
-				GL_FLOAT,
-				GL_FALSE,
-				0,
-				(void*)0
-			);
-
-			//elements
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO);
-			glBindVertexArray(0);
-
-			//set data in mesh struct based on each mesh
-			if (fileName == "Data\\Models\\AquaPig\\hull.obj") {
-				newMesh.translation = glm::vec3(0, 0, 0);
-				newMesh.rotation = glm::vec3(-0.174533, 0, 0);
-				newMesh.name = "Data\\Models\\AquaPig\\hull.obj";
-			}
-			else if (fileName == "Data\\Models\\AquaPig\\wing_right.obj") {
-				newMesh.translation = glm::vec3(-2.231, 0.272, -2.663);
-				newMesh.rotation = glm::vec3(-0.174533, 0, 0);
-				newMesh.name = "Data\\Models\\AquaPig\\wing_right.obj";
-			}
-			else if (fileName == "Data\\Models\\AquaPig\\wing_left.obj") {
-				newMesh.translation = glm::vec3(2.231, 0.272, -2.663);
-				newMesh.rotation = glm::vec3(-0.174533, 0, 0);
-				newMesh.name = "Data\\Models\\AquaPig\\wing_left.obj";
-			}
-			else if (fileName == "Data\\Models\\AquaPig\\propeller.obj") {
-				newMesh.translation = glm::vec3(0, 0.695, -3.816);
-				newMesh.rotation = glm::vec3(glm::half_pi<float>() - 0.174533, 0, 0);
-				newMesh.name = "Data\\Models\\AquaPig\\propeller.obj";
-			}
-			else if (fileName == "Data\\Models\\AquaPig\\gun_base.obj") {
-				newMesh.translation = glm::vec3(0, 0.569, -1.866);
-				newMesh.rotation = glm::vec3(-0.174533, 0, 0);
-				newMesh.name = "Data\\Models\\AquaPig\\gun_base.obj";
+	Helpers::ThreadPool normalWorkers;
+	Helpers::HeightfieldNormals::Compute(heights.data(), numVertsX, numVertsZ, 3.0f, -3.0f, Helpers::HeightfieldNormals::All(numVertsX, numVertsZ),
+		normals.data(), &normalWorkers);
+
+
+	//split into chunks of at most 256x256 vertices so each one can use 16 bit indices
+	const int maxChunkCells{ 255 };
+	int chunkNumber{ 0 };
+
+	for (int chunkZ = 0; chunkZ < numCellsZ; chunkZ += maxChunkCells) {
+		for (int chunkX = 0; chunkX < numCellsX; chunkX += maxChunkCells) {
+			const int chunkCellsX{ std::min(maxChunkCells, numCellsX - chunkX) };
+			const int chunkCellsZ{ std::min(maxChunkCells, numCellsZ - chunkZ) };
+			const int chunkVertsX{ chunkCellsX + 1 };
+
+			//copy this chunk's vertices out of the full grid
+			std::vector<glm::vec3> chunkPositions;
+			std::vector<glm::vec3> chunkNormals;
+			std::vector<glm::vec2> chunkTexCoords;
+			for (int z = chunkZ; z <= chunkZ + chunkCellsZ; z++) {
+				for (int x = chunkX; x <= chunkX + chunkCellsX; x++) {
+					chunkPositions.push_back(positions[(size_t)z * numVertsX + x]);
+					chunkNormals.push_back(normals[(size_t)z * numVertsX + x]);
+					chunkTexCoords.push_back(texCoords[(size_t)z * numVertsX + x]);
+				}
 			}
-			else if (fileName == "Data\\Models\\AquaPig\\gun.obj") {
-				newMesh.translation = glm::vec3(0, 2.026, -1.214);
-				newMesh.rotation = glm::vec3(-0.174533, 0, 0);
-				newMesh.name = "Data\\Models\\AquaPig\\gun.obj";
+
+			//each cell wrote 6 elements in order, remap them to the chunk's vertices
+			std::vector<GLuint> chunkElements;
+			for (int cellZ = chunkZ; cellZ < chunkZ + chunkCellsZ; cellZ++) {
+				for (int cellX = chunkX; cellX < chunkX + chunkCellsX; cellX++) {
+					const size_t firstElement{ ((size_t)cellZ * numCellsX + cellX) * 6 };
+					for (size_t e = firstElement; e < firstElement + 6; e++) {
+						const int x = elements[e] % numVertsX;
+						const int z = elements[e] / numVertsX;
+						chunkElements.push_back((z - chunkZ) * chunkVertsX + (x - chunkX));
+					}
+				}
 			}
 
-			//Texture loading
-			Helpers::ImageLoader Imageloader;
-			if (!Imageloader.Load("Data\\Models\\AquaPig\\aqua_pig_2K.png")) {
+			//the grid is generated row by row which wastes most of the vertex cache
+			Helpers::MeshOptimizeReport terrainReport;
+			terrainReport.name = "Terrain chunk " + std::to_string(chunkNumber++);
+			const std::vector<GLuint> terrainRemap{ Helpers::OptimizeIndexLists({ &chunkElements }, chunkPositions, terrainReport) };
+			Helpers::RemapVertexStream(chunkPositions, terrainRemap);
+			Helpers::RemapVertexStream(chunkNormals, terrainRemap);
+			Helpers::RemapVertexStream(chunkTexCoords, terrainRemap);
+			m_optimizeReports.push_back(terrainReport);
+
+			Mesh newMesh{ CreateMesh(chunkPositions, chunkNormals, chunkTexCoords, chunkElements, m_vertexFormat) };
+			newMesh.translation = glm::vec3(-65, -2, 70);
+
+			//every chunk holds a reference to the one shared texture
+			newMesh.tex = m_textures.Acquire("Data\\Textures\\ocean.jpg");
+			if (!newMesh.tex) {
 				return false;
 			}
 
-			glGenTextures(1, &newMesh.tex);
-			glBindTexture(GL_TEXTURE_2D, newMesh.tex);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, Imageloader.Width(), Imageloader.Height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, Imageloader.GetData());
-			glGenerateMipmap(GL_TEXTURE_2D);
-
-			newModel.meshVector.emplace_back(newMesh);
-
+			terrain.meshVector.push_back(newMesh);
 		}
+	}
 
+
+	//what the per-vertex terrain costs, for comparison with the quadtree terrain in the GUI, and world bounds for culling
+	m_meshTerrainCells = numCellsX;
+	m_meshTerrainBytes = 0;
+	for (Mesh& mesh : terrain.meshVector) {
+		m_meshTerrainBytes += (size_t)mesh.numVertices * Helpers::VertexStride(mesh.vertexFormat) + mesh.geometry.indexBytes;
+		ComputeWorldBounds(mesh, false);
 	}
 
-	//push all models onto modelVector
-	modelVector.emplace_back(skyModel);
-	modelVector.emplace_back(cube);
 	modelVector.emplace_back(terrain);
-	modelVector.emplace_back(newModel);
-
+	m_meshTerrainBuilt = true;
 
+	//loading bound textures and buffers behind the state cache's back
+	m_state.Invalidate();
 	return true;
-
 }
 
-// Render the scene. Passed the delta time since last called.
-void Renderer::Render(const Helpers::Camera& camera, float deltaTime)
-{			
-	// Configure pipeline settings
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
-
-	// Wireframe mode controlled by ImGui
-	if (m_wireframe)
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	else
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-	// Clear buffers from previous frame
-	glClearColor(0.0f, 0.0f, 0.0f, 0.f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	// Compute viewport and projection matrix
-	GLint viewportSize[4];
-	glGetIntegerv(GL_VIEWPORT, viewportSize);
-	const float aspect_ratio = viewportSize[2] / (float)viewportSize[3];
-	glm::mat4 projection_xform = glm::perspective(glm::radians(45.0f), aspect_ratio, 0.1f, 1500.0f);
-
-
-	glm::mat4 model_xform = glm::mat4(1);
-
-	static float angle1 = 0;
-	static bool rotateY = true;
-
-	// Bind our VAO and render
-
-	static float angle = 0;
-
-	//render each mesh in each model
-	for (Model& model : modelVector) {
-		for (Mesh& mesh : model.meshVector) {
-
-			//use different render conditions based on each model
-			if (model.modelName == "skybox") {
-				
-				glDepthMask(GL_FALSE);
-				glDisable(GL_DEPTH_TEST);
-
-				// Compute camera view matrix and combine with projection matrix for passing to shader
-				glm::mat4 view_xform = glm::lookAt(camera.GetPosition(), camera.GetPosition() + camera.GetLookVector(), camera.GetUpVector());
-				glm::mat4 view_xform2 = glm::mat4(glm::mat3(view_xform));
-				glm::mat4 combined_xform = projection_xform * view_xform2;
-
-				// Use our program. Doing this enables the shaders we attached previously.
-				glUseProgram(m_skyProgram);
-
-				// Send the combined matrix to the shader in a uniform
-				GLuint combined_xform_id = glGetUniformLocation(m_skyProgram, "combined_xform");
-				glUniformMatrix4fv(combined_xform_id, 1, GL_FALSE, glm::value_ptr(combined_xform));
-
-
-			}
-			else if (model.modelName == "Cube") {
-				glDepthMask(GL_TRUE);
-				glEnable(GL_DEPTH_TEST);
-
-				// Compute camera view matrix and combine with projection matrix for passing to shader
-				glm::mat4 view_xform = glm::lookAt(camera.GetPosition(), camera.GetPosition() + camera.GetLookVector(), camera.GetUpVector());
-				glm::mat4 combined_xform = projection_xform * view_xform;
+bool Renderer::BuildTerrain()
+{
+	//same placement, spacing and heights as the mesh terrain, which is the 150 cell corner of it
+	Helpers::TerrainSettings settings;
+	settings.size = kTerrainSizes[m_terrainSizeIndex];
+	settings.filter = (Helpers::HeightfieldFilter)m_terrainFilter;
+	settings.origin = glm::vec3(-65, -2, 70);
 
-				// Use our program. Doing this enables the shaders we attached previously.
-				glUseProgram(m_cubeProgram);
+	return m_terrain.Build(kTerrainHeightmaps[m_terrainHeightmap], settings);
+}
 
-				// Send the combined matrix to the shader in a uniform
-				GLuint combined_xform_id = glGetUniformLocation(m_cubeProgram, "combined_xform");
-				glUniformMatrix4fv(combined_xform_id, 1, GL_FALSE, glm::value_ptr(combined_xform));
+void Renderer::DrawTerrain()
+{
+	const Helpers::GeometryAllocation& geometry = m_terrainPatch.geometry;
+	if (m_terrainInstances.empty() || !geometry.valid)
+		return;
+
+	m_state.DepthMask(GL_TRUE);
+	m_state.SetCapability(GL_DEPTH_TEST, true);
+
+	Helpers::ShaderProgram& program = m_terrainProgram;
+	m_state.UseProgram(program.Id());
+	program.Set("sampler_height", 0);
+	program.Set("sampler_tex", 1);
+	program.Set("sampler_overview", 2);
+	m_state.BindTexture(0, GL_TEXTURE_2D_ARRAY, m_terrain.HeightTexture());
+	m_state.BindTexture(1, GL_TEXTURE_2D, m_terrainTexture);
+	m_state.BindTexture(2, GL_TEXTURE_2D, m_terrain.OverviewTexture());
+
+	const Helpers::TerrainConstants constants{ m_terrain.Constants() };
+	m_state.BindBufferRange(GL_UNIFORM_BUFFER, 2, m_uniformRing.Buffer(), m_uniformRing.Write(&constants, sizeof(constants)), sizeof(constants));
+
+	//the block is bound whole so the last batch is padded out to full size in a copy
+	const size_t batchSize{ (size_t)Helpers::Terrain::kMaxInstancesPerDraw };
+	const size_t numInstances{ m_terrainInstances.size() };
+	const size_t blockBytes{ sizeof(Helpers::TerrainInstance) * batchSize };
+
+	m_state.BindVertexArray(m_geometryArena.Vao(geometry.format));
+	for (size_t first = 0; first < numInstances; first += batchSize) {
+		const GLsizei count{ (GLsizei)std::min(batchSize, numInstances - first) };
+		const Helpers::TerrainInstance* batch{ &m_terrainInstances[first] };
+		if ((size_t)count < batchSize) {
+			m_terrainLastBatch.resize(batchSize);
+			std::copy(batch, batch + count, m_terrainLastBatch.begin());
+			batch = m_terrainLastBatch.data();
+		}
+		m_state.BindBufferRange(GL_UNIFORM_BUFFER, 1, m_uniformRing.Buffer(), m_uniformRing.Write(batch, blockBytes), blockBytes);
 
-				model_xform = glm::translate(model_xform, mesh.translation);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, m_terrainPatch.numElements, geometry.indexType, (void*)geometry.indexByteOffset, count,
+			geometry.baseVertex);
 
-				if (rotateY) // Rotate around y axis		
-					model_xform = glm::rotate(model_xform, angle1, glm::vec3{ 0 ,1,0 });
-				else // Rotate around x axis		
-					model_xform = glm::rotate(model_xform, angle1, glm::vec3{ 1 ,0,0 });
+		m_numTrianglesDrawn += (size_t)m_terrainPatch.numElements / 3 * count;
+		m_numDrawCalls++;
+	}
+}
 
-				angle1 +=0.003f;
+void Renderer::BindDrawConstants(size_t offset)
+{
+	m_state.BindBufferRange(GL_UNIFORM_BUFFER, 1, m_uniformRing.Buffer(), offset, sizeof(DrawConstants));
+}
 
-				if (angle1 > glm::two_pi<float>())
-				{
-					angle1 = 0;
-					rotateY = !rotateY;
-				}
+void Renderer::BuildInstanceGrid(InstancedModel& instanced, int size)
+{
+	instanced.instances.Clear();
 
-			}
-			else if (model.modelName != "skybox" && model.modelName != "Cube") {
-				glDepthMask(GL_TRUE);
-				glEnable(GL_DEPTH_TEST);
+	//spread over the terrain, which is 450 units square
+	const float spacing{ size > 1 ? 440.0f / (size - 1) : 0.0f };
+	for (int z = 0; z < size; z++) {
+		for (int x = 0; x < size; x++) {
+			Helpers::InstanceData instance;
+			instance.modelXform = glm::translate(glm::mat4(1), glm::vec3(-60 + x * spacing, 15.0f, 65 - z * spacing));
+			instance.modelXform = glm::rotate(instance.modelXform, (x * 7 + z * 13) * 0.1f, glm::vec3{ 0, 1, 0 });
 
-				// Compute camera view matrix and combine with projection matrix for passing to shader
-				glm::mat4 view_xform = glm::lookAt(camera.GetPosition(), camera.GetPosition() + camera.GetLookVector(), camera.GetUpVector());
-				glm::mat4 combined_xform = projection_xform * view_xform;
+			//a little variation so the copies can be told apart
+			const int i{ z * size + x };
+			instance.tint = glm::vec4(0.7f + 0.3f * (i % 7) / 6.0f, 0.7f + 0.3f * (i % 5) / 4.0f, 0.7f + 0.3f * (i % 3) / 2.0f, 1.0f);
 
-				// Use our program. Doing this enables the shaders we attached previously.
-				glUseProgram(m_program);
+			instanced.instances.Add(instance);
+		}
+	}
+}
 
-				// Send the combined matrix to the shader in a uniform
-				GLuint combined_xform_id = glGetUniformLocation(m_program, "combined_xform");
-				glUniformMatrix4fv(combined_xform_id, 1, GL_FALSE, glm::value_ptr(combined_xform));
+void Renderer::DrawInstanced(InstancedModel& instanced, const glm::vec3& cameraPosition, float nearPlane, float pixelsPerUnitAtOne)
+{
+	const size_t numInstances{ instanced.instances.NumInstances() };
+	if (instanced.model < 0 || numInstances == 0)
+		return;
+
+	glm::vec3 instancesCentre;
+	float instancesRadius;
+	instanced.instances.Bounds(instancesCentre, instancesRadius);
+
+	m_state.DepthMask(GL_TRUE);
+	m_state.SetCapability(GL_DEPTH_TEST, true);
+
+	Helpers::ShaderProgram& program = m_instancedProgram;
+	m_state.UseProgram(program.Id());
+	program.Set("sampler_tex", 0);
+	m_state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanced.instances.Buffer());
+
+	for (const Mesh& mesh : modelVector[instanced.model].meshVector) {
+		if (!mesh.geometry.valid)
+			continue;
+
+		//each instance rotates the part about its own position, so the part can be anywhere within the length of its
+		//centre from there and the sphere around every instance has to allow for that
+		const glm::mat4 model_xform{ MeshXform(mesh) };
+		const glm::vec3 meshCentre{ model_xform * glm::vec4(mesh.boundsCentre, 1.0f) };
+		const float radius{ instancesRadius + glm::length(meshCentre) + mesh.boundsRadius };
+
+		//the nearest instance decides the level of detail for all of them
+		const float distance{ std::max(glm::distance(cameraPosition, instancesCentre) - radius, nearPlane) };
+		const MeshLodRange lod{ SelectLod(mesh, distance, pixelsPerUnitAtOne) };
+
+		//all or nothing, one sphere around every instance of this mesh
+		if (m_frustumCulling && !m_frustum.TestSphere(instancesCentre, radius)) {
+			m_numCulled += numInstances;
+			continue;
+		}
+		m_numVisible += numInstances;
 
-				model_xform = glm::translate(model_xform, mesh.translation);
-				model_xform = glm::rotate(model_xform, mesh.rotation.x, glm::vec3{ 1, 0, 0 });
-				model_xform = glm::rotate(model_xform, mesh.rotation.y, glm::vec3{ 0, 1, 0 });
-				model_xform = glm::rotate(model_xform, mesh.rotation.z, glm::vec3{ 0, 0, 1 });
+		DrawConstants constants;
+		constants.modelXform = model_xform;
+		constants.positionOffset = glm::vec4(mesh.positionOffset, 0);
+		constants.positionScale = glm::vec4(mesh.positionScale, mesh.vertexFormat == Helpers::VertexFormat::Quantized ? 1.0f : 0.0f);
+		BindDrawConstants(m_uniformRing.Write(&constants, sizeof(constants)));
 
-				if (mesh.name == "Data\\Models\\AquaPig\\propeller.obj") {
-					model_xform = glm::rotate(model_xform, angle, glm::vec3{ 0, 1, 0 });
-					angle += 0.02f;
-				}
-			}
+		m_state.BindTexture(0, GL_TEXTURE_2D, mesh.tex);
 
-			
+		const Helpers::GeometryAllocation& geometry = mesh.geometry;
+		m_state.BindVertexArray(m_geometryArena.Vao(geometry.format));
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.numElements, geometry.indexType,
+			(void*)(geometry.indexByteOffset + (size_t)Helpers::IndexSize(geometry.indexType) * lod.firstElement),
+			(GLsizei)numInstances, geometry.baseVertex);
 
-			GLuint model_xform_id = glGetUniformLocation(m_program, "model_xform");
-			glUniformMatrix4fv(model_xform_id, 1, GL_FALSE, glm::value_ptr(model_xform));
+		m_numTrianglesDrawn += lod.numElements / 3 * numInstances;
+		m_numDrawCalls++;
+	}
+}
 
-	
+void Renderer::ComputeWorldBounds(Mesh& mesh, bool rotatesInPlace) const
+{
+	if (rotatesInPlace) {
+		//any rotation about the pivot stays inside this sphere
+		mesh.worldCentre = mesh.translation;
+		mesh.worldRadius = glm::length(mesh.boundsCentre) + mesh.boundsRadius;
+		mesh.worldMin = mesh.worldCentre - glm::vec3(mesh.worldRadius);
+		mesh.worldMax = mesh.worldCentre + glm::vec3(mesh.worldRadius);
+		return;
+	}
 
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, mesh.tex);
-			glUniform1i(glGetUniformLocation(m_program, "sampler_tex"), 0);
+	//no scaling so the radius is unchanged
+	const glm::mat4 model_xform{ MeshXform(mesh) };
+	mesh.worldCentre = glm::vec3(model_xform * glm::vec4(mesh.boundsCentre, 1.0f));
+	mesh.worldRadius = mesh.boundsRadius;
+
+	//box around the transformed corners of the local box
+	for (int corner = 0; corner < 8; corner++) {
+		const glm::vec3 local{ corner & 1 ? mesh.boundsMax.x : mesh.boundsMin.x, corner & 2 ? mesh.boundsMax.y : mesh.boundsMin.y,
+			corner & 4 ? mesh.boundsMax.z : mesh.boundsMin.z };
+		const glm::vec3 world{ model_xform * glm::vec4(local, 1.0f) };
+		mesh.worldMin = corner ? glm::min(mesh.worldMin, world) : world;
+		mesh.worldMax = corner ? glm::max(mesh.worldMax, world) : world;
+	}
+}
 
-			model_xform = glm::mat4(1);	
-			glBindVertexArray(mesh.vao);
-			glDrawElements(GL_TRIANGLES, mesh.numElements, GL_UNSIGNED_INT, (void*)0);
-		}
+// Model transform of a textured mesh, including any animation
+glm::mat4 Renderer::MeshXform(const Mesh& mesh) const
+{
+	glm::mat4 model_xform = glm::translate(glm::mat4(1), mesh.translation);
+	model_xform = glm::rotate(model_xform, mesh.rotation.x, glm::vec3{ 1, 0, 0 });
+	model_xform = glm::rotate(model_xform, mesh.rotation.y, glm::vec3{ 0, 1, 0 });
+	model_xform = glm::rotate(model_xform, mesh.rotation.z, glm::vec3{ 0, 0, 1 });
 
-	}
+	if (mesh.spins)
+		model_xform = glm::rotate(model_xform, m_propellerAngle, glm::vec3{ 0, 1, 0 });
 
+	return model_xform;
 }
-
@@ -5,14 +5,79 @@
 #include "Helper.h"
 #include "Mesh.h"
 #include "Camera.h"
+#include "MeshCache.h"
+#include "VertexFormat.h"
+#include "MeshOptimizer.h"
+#include "GeometryArena.h"
+#include "ShaderProgram.h"
+#include "RenderQueue.h"
+#include "IndirectBatcher.h"
+#include "InstanceBuffer.h"
+#include "PersistentRingBuffer.h"
+#include "GLStateCache.h"
+#include "TextureManager.h"
+#include "Frustum.h"
+#include "Terrain.h"
+
+// A level of detail stored in the mesh element buffer after the full detail indices
+struct MeshLodRange {
+	GLuint firstElement{ 0 };
+	GLuint numElements{ 0 };
+
+	// Object space error of this level, compared against the projected pixel threshold
+	float error{ 0 };
+};
 
 struct Mesh {
-	GLuint vao;
 	GLuint numElements;
 	glm::vec3 translation = glm::vec3(0, 0, 0);
 	glm::vec3 rotation = glm::vec3(0, 0, 0);
 	std::string name;
-	GLuint tex;
+
+	// Owned by the renderer's texture manager, 0 if untextured
+	GLuint tex{ 0 };
+
+	// Vertex layout and the values the shader needs to dequantise positions
+	Helpers::VertexFormat vertexFormat{ Helpers::VertexFormat::Float };
+	glm::vec3 positionOffset{ 0 };
+	glm::vec3 positionScale{ 1 };
+	GLuint numVertices{ 0 };
+
+	// Meshes combined into this one at load time, each would otherwise be its own draw call
+	GLuint numSubmeshes{ 1 };
+
+	// Where the vertices and indices live in the shared geometry arena. The index type is the smallest that fits numVertices.
+	Helpers::GeometryAllocation geometry;
+
+	// Simplified versions of the mesh, coarsest last. Empty if none were generated.
+	std::vector<MeshLodRange> lods;
+
+	// Local space bounding sphere, used to find how far away the mesh is for level of detail selection
+	glm::vec3 boundsCentre{ 0 };
+	float boundsRadius{ 0 };
+
+	// Local space box
+	glm::vec3 boundsMin{ 0 };
+	glm::vec3 boundsMax{ 0 };
+
+	// World space sphere and box for frustum culling, worked out once the mesh is placed
+	glm::vec3 worldCentre{ 0 };
+	float worldRadius{ 0 };
+	glm::vec3 worldMin{ 0 };
+	glm::vec3 worldMax{ 0 };
+
+	// Spins around its local y axis every frame, e.g. the propeller
+	bool spins{ false };
+};
+
+// Decides the program, render pass and animation a model gets
+enum class ModelKind {
+	Sky,
+	Cube,
+	Textured,
+
+	// The original per-vertex terrain mesh, drawn only when the quadtree terrain is off
+	Terrain
 };
 
 struct Model {
@@ -20,15 +85,69 @@ struct Model {
 	GLuint sampler;
 	GLuint numCubeElements = 0;
 	std::string modelName;
+	ModelKind kind{ ModelKind::Textured };
+};
+
+// std140 layout of the FrameConstants uniform block shared by every shader, written once per frame
+struct FrameConstants {
+	glm::mat4 viewXform;
+	glm::mat4 projectionXform;
+	glm::mat4 combinedXform;
+
+	// Rotation only view for the sky so it stays centred on the camera
+	glm::mat4 skyCombinedXform;
+
+	glm::vec4 cameraPosition;
+
+	// x is seconds since start, y the frame's delta
+	glm::vec4 time;
+};
+
+// std140 layout of the DrawConstants uniform block, one per draw in the ring buffer
+struct DrawConstants {
+	glm::mat4 modelXform;
+	glm::vec4 positionOffset;
+
+	// w is 1 when normals are octahedral encoded
+	glm::vec4 positionScale;
+};
+
+// Copies of a loaded model drawn with one instanced draw per mesh
+struct InstancedModel {
+	// Index into the renderer's models, -1 if none
+	int model{ -1 };
+	Helpers::InstanceBuffer instances;
+};
+
+// Passes are drawn in this order, the sort key keeps them together
+enum class RenderPass : unsigned int {
+	Sky,
+	Opaque
+};
+
+// Everything needed to submit one mesh, built once per frame
+struct DrawItem {
+	const Mesh* mesh{ nullptr };
+	Helpers::ShaderProgram* program{ nullptr };
+	RenderPass pass{ RenderPass::Opaque };
+	glm::mat4 modelXform{ 1 };
+	MeshLodRange lod;
+
+	// Added to the mesh's world bounds, for copies of a mesh placed elsewhere
+	glm::vec3 boundsOffset{ 0 };
 };
 
 class Renderer
 {
 private:
 	// Program object - to host shaders
-	GLuint m_program{ 0 };
-	GLuint m_cubeProgram{ 0 };
-	GLuint m_skyProgram{ 0 };
+	Helpers::ShaderProgram m_program;
+	Helpers::ShaderProgram m_cubeProgram;
+	Helpers::ShaderProgram m_skyProgram;
+	Helpers::ShaderProgram m_indirectProgram;
+	Helpers::ShaderProgram m_instancedProgram;
+	Helpers::ShaderProgram m_skyboxProgram;
+	Helpers::ShaderProgram m_terrainProgram;
 
 	std::vector<Model> modelVector;
 
@@ -40,7 +159,147 @@ private:
 
 	bool m_wireframe{ false };
 
-	GLuint CreateProgram(std::string, std::string);
+	// All static vertex and index data is sub-allocated from here
+	Helpers::GeometryArena m_geometryArena;
+
+	// Layout used for loaded and generated textured geometry
+	Helpers::VertexFormat m_vertexFormat{ Helpers::VertexFormat::Quantized };
+
+	// Level of detail selection, a level is used when its error projects to no more than this many pixels
+	bool m_useLods{ true };
+	float m_lodPixelThreshold{ 1.0f };
+
+	// Triangles and draw calls submitted last frame
+	size_t m_numTrianglesDrawn{ 0 };
+	size_t m_numDrawCalls{ 0 };
+
+	// View frustum culling of every draw item against its precomputed world bounds
+	bool m_frustumCulling{ true };
+	Helpers::Frustum m_frustum;
+	Helpers::BoundingSpheres m_cullSpheres;
+	std::vector<unsigned char> m_visible;
+	size_t m_numVisible{ 0 };
+	size_t m_numCulled{ 0 };
+
+	// Shared, reference counted textures
+	Helpers::TextureManager m_textures;
+
+	// Sky drawn as one cube map triangle after the scene instead of six meshes before it
+	bool m_cubeMapSky{ true };
+	int m_skySet{ 0 };
+	GLuint m_skyCubeMap{ 0 };
+	GLuint m_emptyVao{ 0 };
+
+	// Quadtree terrain drawn by instancing one shared patch over a height texture, replaces the per-vertex mesh
+	// terrain when on. The size and heightmap can be changed at runtime, tiles are streamed in within stream radius
+	// tiles of the camera.
+	bool m_quadtreeTerrain{ true };
+	Helpers::Terrain m_terrain;
+	Mesh m_terrainPatch;
+	GLuint m_terrainTexture{ 0 };
+	int m_terrainSizeIndex{ 1 };
+	int m_terrainHeightmap{ 0 };
+	int m_terrainFilter{ (int)Helpers::HeightfieldFilter::Bicubic };
+	float m_terrainLodDistance{ 240.0f };
+	int m_terrainStreamRadius{ 2 };
+	int m_terrainUploadBudgetKB{ 1024 };
+	std::vector<Helpers::TerrainInstance> m_terrainInstances;
+	// The last, partly filled batch copied out and padded to a whole block, so m_terrainInstances keeps its real size
+	std::vector<Helpers::TerrainInstance> m_terrainLastBatch;
+
+	// Vertex and index bytes of the mesh terrain, to compare against the quadtree terrain's. The mesh terrain is
+	// built on first use.
+	bool m_meshTerrainBuilt{ false };
+	size_t m_meshTerrainBytes{ 0 };
+	int m_meshTerrainCells{ 0 };
+
+	// Every state change made while rendering goes through here
+	Helpers::GLStateCache m_state;
+
+	// This frame's draws, in the order they were gathered, and the queue that orders them
+	std::vector<DrawItem> m_drawItems;
+	Helpers::RenderQueue m_renderQueue;
+
+	// Multi-draw indirect path for textured meshes
+	bool m_useMultiDrawIndirect{ false };
+	Helpers::IndirectBatcher m_indirectBatcher;
+
+	// Benchmark scene, this many copies of the aqua pig along each side of a grid
+	int m_benchmarkGridSize{ 0 };
+	int m_benchmarkModel{ -1 };
+
+	// Instancing stress scene, a grid of aqua pigs over the terrain this many along each side
+	InstancedModel m_instancedPigs;
+	int m_instanceGridSize{ 0 };
+	int m_builtInstanceGridSize{ 0 };
+	bool m_animateInstances{ false };
+	size_t m_instanceBytesUploaded{ 0 };
+
+	// Frame and per-draw constants, persistently mapped with a region per frame in flight
+	Helpers::PersistentRingBuffer m_uniformRing;
+	std::vector<unsigned char> m_drawConstantsStaging;
+	float m_time{ 0 };
+
+	// Time to gather, sort and submit the frame's draws
+	float m_submitMs{ 0 };
+	float m_gpuSubmitMs{ 0 };
+	GLuint m_timerQuery{ 0 };
+	bool m_timerQueryIssued{ false };
+
+	// Animation
+	float m_cubeAngle{ 0 };
+	bool m_cubeRotateY{ true };
+	float m_propellerAngle{ 0 };
+
+	// Vertex cache figures for every mesh optimised at load time
+	std::vector<Helpers::MeshOptimizeReport> m_optimizeReports;
+
+	// Results of the last cold vs. warm model load benchmark
+	std::vector<Helpers::MeshCacheBenchmarkResult> m_cacheBenchmark;
+
+	// Returns an invalid program on error
+	Helpers::ShaderProgram CreateProgram(std::string, std::string);
+
+	// Upload mesh data into a vertex array object, any levels of detail share its vertices and element buffer
+	Mesh CreateMesh(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+		const std::vector<glm::vec2>& uvCoords, const std::vector<GLuint>& elements, Helpers::VertexFormat format,
+		const std::vector<Helpers::MeshLod>& lods = {});
+
+	// Return a model's geometry to the arena
+	void UnloadModel(Model& model);
+
+	// Lay out size x size instances over the terrain
+	void BuildInstanceGrid(InstancedModel& instanced, int size);
+
+	// One glDrawElementsInstancedBaseVertex per mesh of the model, level of detail is picked for the nearest instance
+	void DrawInstanced(InstancedModel& instanced, const glm::vec3& cameraPosition, float nearPlane, float pixelsPerUnitAtOne);
+
+	// Swap the sky cube map for one of the sets under Data\Models\Sky, keeps the current one on error
+	bool LoadSkyCubeMap(int skySet);
+
+	// Full screen triangle at the far plane
+	void DrawSkyCubeMap();
+
+	// Build the original 150 x 150 cell mesh terrain and add it to modelVector
+	bool BuildMeshTerrain();
+
+	// Start streaming the quadtree terrain at the chosen size and heightmap, keeps the current one if the size is invalid
+	bool BuildTerrain();
+
+	// One instanced draw of the patch per kMaxInstancesPerDraw quadrants of the selected nodes
+	void DrawTerrain();
+
+	// Binds a mesh's constants from the ring buffer as the DrawConstants block
+	void BindDrawConstants(size_t offset);
+
+	// Model transform of a textured mesh, including any animation
+	glm::mat4 MeshXform(const Mesh& mesh) const;
+
+	// World bounds from the mesh's placement. Meshes that rotate in place get a sphere around their pivot.
+	void ComputeWorldBounds(Mesh& mesh, bool rotatesInPlace) const;
+
+	// Element range to draw for a mesh given the distance from the camera to its bounds
+	MeshLodRange SelectLod(const Mesh& mesh, float distance, float pixelsPerUnitAtOne) const;
 public:
 	Renderer();
 	~Renderer();
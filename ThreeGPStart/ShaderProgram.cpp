@@ -0,0 +1,181 @@
+#include "ShaderProgram.h"
+
+namespace Helpers
+{
+	namespace
+	{
+		std::string ResourceName(GLuint program, GLenum programInterface, GLuint index, GLint nameLength)
+		{
+			std::string name(std::max(nameLength, 1), '\0');
+			glGetProgramResourceName(program, programInterface, index, (GLsizei)name.size(), nullptr, &name[0]);
+			name.resize(strlen(name.c_str()));
+			return name;
+		}
+
+		void ReflectBlocks(GLuint program, GLenum programInterface, std::unordered_map<std::string, ProgramBlock>& blocks)
+		{
+			GLint numBlocks{ 0 };
+			glGetProgramInterfaceiv(program, programInterface, GL_ACTIVE_RESOURCES, &numBlocks);
+
+			const GLenum properties[]{ GL_NAME_LENGTH, GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+			for (GLint b = 0; b < numBlocks; b++)
+			{
+				GLint values[3]{};
+				glGetProgramResourceiv(program, programInterface, b, 3, properties, 3, nullptr, values);
+
+				ProgramBlock block;
+				block.name = ResourceName(program, programInterface, b, values[0]);
+				block.index = (GLuint)b;
+				block.binding = values[1];
+				block.dataSize = values[2];
+				blocks[block.name] = block;
+			}
+		}
+	}
+
+	ShaderProgram::ShaderProgram(GLuint program) : m_program(program)
+	{
+		if (m_program)
+			Reflect();
+	}
+
+	ShaderProgram::~ShaderProgram()
+	{
+		glDeleteProgram(m_program);
+	}
+
+	ShaderProgram::ShaderProgram(ShaderProgram&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	ShaderProgram& ShaderProgram::operator=(ShaderProgram&& other) noexcept
+	{
+		if (this != &other)
+		{
+			glDeleteProgram(m_program);
+			m_program = other.m_program;
+			other.m_program = 0;
+
+			m_uniforms = std::move(other.m_uniforms);
+			m_uniformLookup = std::move(other.m_uniformLookup);
+			m_attributes = std::move(other.m_attributes);
+			m_uniformBlocks = std::move(other.m_uniformBlocks);
+			m_storageBlocks = std::move(other.m_storageBlocks);
+		}
+		return *this;
+	}
+
+	void ShaderProgram::Reflect()
+	{
+		// Uniforms in the default block, block members have no location and are set through their buffer
+		GLint numUniforms{ 0 };
+		glGetProgramInterfaceiv(m_program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &numUniforms);
+
+		const GLenum uniformProperties[]{ GL_NAME_LENGTH, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE, GL_BLOCK_INDEX };
+		for (GLint u = 0; u < numUniforms; u++)
+		{
+			GLint values[5]{};
+			glGetProgramResourceiv(m_program, GL_UNIFORM, u, 5, uniformProperties, 5, nullptr, values);
+			if (values[4] != -1)
+				continue;
+
+			ProgramUniform uniform;
+			uniform.name = ResourceName(m_program, GL_UNIFORM, u, values[0]);
+			uniform.type = (GLenum)values[1];
+			uniform.location = values[2];
+			uniform.arraySize = values[3];
+
+			// Arrays are reported as name[0]
+			const size_t bracket{ uniform.name.find('[') };
+			if (bracket != std::string::npos)
+				uniform.name.resize(bracket);
+
+			m_uniformLookup[uniform.name] = (int)m_uniforms.size();
+			m_uniforms.push_back(uniform);
+		}
+
+		GLint numInputs{ 0 };
+		glGetProgramInterfaceiv(m_program, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES, &numInputs);
+
+		const GLenum inputProperties[]{ GL_NAME_LENGTH, GL_LOCATION };
+		for (GLint i = 0; i < numInputs; i++)
+		{
+			GLint values[2]{};
+			glGetProgramResourceiv(m_program, GL_PROGRAM_INPUT, i, 2, inputProperties, 2, nullptr, values);
+			m_attributes[ResourceName(m_program, GL_PROGRAM_INPUT, i, values[0])] = values[1];
+		}
+
+		ReflectBlocks(m_program, GL_UNIFORM_BLOCK, m_uniformBlocks);
+		ReflectBlocks(m_program, GL_SHADER_STORAGE_BLOCK, m_storageBlocks);
+	}
+
+	int ShaderProgram::UniformHandle(const std::string& name) const
+	{
+		auto it = m_uniformLookup.find(name);
+		return it == m_uniformLookup.end() ? -1 : it->second;
+	}
+
+	bool ShaderProgram::Changed(ProgramUniform& uniform, const void* value, size_t numBytes)
+	{
+		if (uniform.hasValue && memcmp(uniform.lastValue, value, numBytes) == 0)
+			return false;
+
+		memcpy(uniform.lastValue, value, numBytes);
+		uniform.hasValue = true;
+		return true;
+	}
+
+	void ShaderProgram::Set(int handle, const glm::mat4& value)
+	{
+		if (handle < 0 || !Changed(m_uniforms[handle], glm::value_ptr(value), sizeof(value)))
+			return;
+		glUniformMatrix4fv(m_uniforms[handle].location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+
+	void ShaderProgram::Set(int handle, const glm::vec3& value)
+	{
+		if (handle < 0 || !Changed(m_uniforms[handle], glm::value_ptr(value), sizeof(value)))
+			return;
+		glUniform3fv(m_uniforms[handle].location, 1, glm::value_ptr(value));
+	}
+
+	void ShaderProgram::Set(int handle, const glm::vec4& value)
+	{
+		if (handle < 0 || !Changed(m_uniforms[handle], glm::value_ptr(value), sizeof(value)))
+			return;
+		glUniform4fv(m_uniforms[handle].location, 1, glm::value_ptr(value));
+	}
+
+	void ShaderProgram::Set(int handle, float value)
+	{
+		if (handle < 0 || !Changed(m_uniforms[handle], &value, sizeof(value)))
+			return;
+		glUniform1f(m_uniforms[handle].location, value);
+	}
+
+	void ShaderProgram::Set(int handle, int value)
+	{
+		if (handle < 0 || !Changed(m_uniforms[handle], &value, sizeof(value)))
+			return;
+		glUniform1i(m_uniforms[handle].location, value);
+	}
+
+	GLint ShaderProgram::AttributeLocation(const std::string& name) const
+	{
+		auto it = m_attributes.find(name);
+		return it == m_attributes.end() ? -1 : it->second;
+	}
+
+	const ProgramBlock* ShaderProgram::UniformBlock(const std::string& name) const
+	{
+		auto it = m_uniformBlocks.find(name);
+		return it == m_uniformBlocks.end() ? nullptr : &it->second;
+	}
+
+	const ProgramBlock* ShaderProgram::StorageBlock(const std::string& name) const
+	{
+		auto it = m_storageBlocks.find(name);
+		return it == m_storageBlocks.end() ? nullptr : &it->second;
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+// A linked program plus everything the driver reports about its interface, queried once at link time
+
+#include "ExternalLibraryHeaders.h"
+#include <unordered_map>
+
+namespace Helpers
+{
+	// An active uniform outside of any block
+	struct ProgramUniform
+	{
+		std::string name;
+		GLint location{ -1 };
+		GLenum type{ 0 };
+		GLint arraySize{ 1 };
+
+		// Last value uploaded through the program so repeated values can be skipped
+		unsigned char lastValue[sizeof(glm::mat4)]{};
+		bool hasValue{ false };
+	};
+
+	// An active uniform or shader storage block
+	struct ProgramBlock
+	{
+		std::string name;
+		GLuint index{ GL_INVALID_INDEX };
+		GLint binding{ 0 };
+		GLint dataSize{ 0 };
+	};
+
+	// Owns a linked program. Reflects all active uniforms, vertex inputs and blocks on construction and provides
+	// typed uniform setters that look the location up in that table and skip uploads of an unchanged value.
+	class ShaderProgram
+	{
+	private:
+		GLuint m_program{ 0 };
+
+		std::vector<ProgramUniform> m_uniforms;
+		std::unordered_map<std::string, int> m_uniformLookup;
+		std::unordered_map<std::string, GLint> m_attributes;
+		std::unordered_map<std::string, ProgramBlock> m_uniformBlocks;
+		std::unordered_map<std::string, ProgramBlock> m_storageBlocks;
+
+		void Reflect();
+
+		// Returns false if the value matches the last one uploaded, otherwise records it
+		bool Changed(ProgramUniform& uniform, const void* value, size_t numBytes);
+	public:
+		ShaderProgram() = default;
+
+		// Takes ownership of an already linked program
+		explicit ShaderProgram(GLuint program);
+		~ShaderProgram();
+
+		ShaderProgram(ShaderProgram&& other) noexcept;
+		ShaderProgram& operator=(ShaderProgram&& other) noexcept;
+		ShaderProgram(const ShaderProgram&) = delete;
+		ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+		bool Valid() const { return m_program != 0; }
+		GLuint Id() const { return m_program; }
+
+		void Use() const { glUseProgram(m_program); }
+
+		// Handle for the typed setters, -1 if the uniform is not active. Arrays are found by their base name.
+		int UniformHandle(const std::string& name) const;
+
+		// The program must be in use. Invalid handles are ignored like glUniform* does with location -1.
+		void Set(int handle, const glm::mat4& value);
+		void Set(int handle, const glm::vec3& value);
+		void Set(int handle, const glm::vec4& value);
+		void Set(int handle, float value);
+		void Set(int handle, int value);
+
+		// Convenience versions that find the handle first, still no driver query
+		template <typename T>
+		void Set(const std::string& name, const T& value) { Set(UniformHandle(name), value); }
+
+		// -1 if not an active vertex input
+		GLint AttributeLocation(const std::string& name) const;
+
+		// nullptr if not an active block
+		const ProgramBlock* UniformBlock(const std::string& name) const;
+		const ProgramBlock* StorageBlock(const std::string& name) const;
+
+		const std::vector<ProgramUniform>& Uniforms() const { return m_uniforms; }
+	};
+}
@@ -0,0 +1,579 @@
+#include "Terrain.h"
+#include "TerrainTileFile.h"
+
+namespace Helpers
+{
+	// Normals at a tile root's vertices read one vertex, kOverviewStep cells, past the tile's edges
+	static_assert(TerrainTileFile::kTileRing >= Terrain::kOverviewStep, "Tile ring too narrow for the normals");
+
+	size_t Terrain::TileData::Bytes() const
+	{
+		return heights.size() * sizeof(uint16_t);
+	}
+
+	Terrain::~Terrain()
+	{
+		glDeleteTextures(1, &m_heightTexture);
+		glDeleteTextures(1, &m_overviewTexture);
+	}
+
+	bool Terrain::Build(const std::string& heightmapPath, const TerrainSettings& settings)
+	{
+		if (settings.size < kTileCells || (settings.size & (settings.size - 1)) != 0)
+		{
+			std::cout << "Terrain size must be a power of two of at least " << kTileCells << ": " << settings.size << std::endl;
+			return false;
+		}
+
+		m_settings = settings;
+		m_generation++;
+		m_tileFileReady = false;
+		m_tilePath = TerrainTileFile::PathFor(heightmapPath, settings.size, settings.filter);
+
+		m_numTiles = settings.size / kTileCells;
+		m_numLevels = 1;
+		while ((kPatchCells << (m_numLevels - 1)) < kTileCells)
+			m_numLevels++;
+
+		// Anything still being read for the previous terrain is dropped when it arrives
+		m_tileSlots.assign((size_t)m_numTiles * m_numTiles, -1);
+		m_tileRequested.assign((size_t)m_numTiles * m_numTiles, 0);
+		m_slots.assign(kMaxResidentTiles, Slot());
+		m_uploads.clear();
+		m_numPending = 0;
+		m_numEvictions = 0;
+		m_selection.clear();
+		m_overviewReady = false;
+		m_overviewHeights.clear();
+
+		// The arrays only depend on the tile size so are kept for every terrain
+		if (!m_heightTexture)
+			CreateTextures();
+
+		// Decoding the image is the slow part and is skipped altogether if the tiles were written before
+		const unsigned int generation{ m_generation };
+		const std::string tilePath{ m_tilePath };
+		const int size{ settings.size };
+		const HeightfieldFilter filter{ settings.filter };
+		m_pool.Submit([this, heightmapPath, tilePath, size, filter, generation]() {
+			const uint64_t key{ TerrainTileFile::ComputeKey(heightmapPath, size, kTileCells, kOverviewStep, filter) };
+			if (!key)
+			{
+				std::cout << "Could not read heightmap: " << heightmapPath << std::endl;
+				return;
+			}
+
+			if (!TerrainTileFile::IsValid(tilePath, key)
+				&& !TerrainTileFile::Write(heightmapPath, tilePath, size, kTileCells, kOverviewStep, filter, key))
+				return;
+
+			// Tiles can still stream in without the overview, only distant terrain is missing
+			std::vector<uint16_t> overview;
+			std::vector<glm::vec2> overviewHeights;
+			if (!PrepareOverview(tilePath, size, overview, overviewHeights))
+				overview.clear();
+
+			// Builds can finish out of order, an older one must not hide a newer one
+			std::lock_guard<std::mutex> lock(m_completedMutex);
+			if (generation > m_tileFileGeneration)
+			{
+				m_tileFileGeneration = generation;
+				m_completedOverview = std::move(overview);
+				m_completedOverviewHeights = std::move(overviewHeights);
+			}
+		});
+
+		return true;
+	}
+
+	void Terrain::CreateTextures()
+	{
+		const int tileSamples{ TerrainTileFile::TileSamples(kTileCells) };
+
+		// Heights are only read by the vertex shader at the vertices so need no mips. 16 bits is plenty for samples
+		// that started as 8 or 16 bit image channels and is half the size of floats. Filtering is linear so morphing
+		// vertices slide along the coarser level's surface.
+		glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &m_heightTexture);
+		glTextureStorage3D(m_heightTexture, 1, GL_R16, tileSamples, tileSamples, kMaxResidentTiles);
+		glTextureParameteri(m_heightTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(m_heightTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(m_heightTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(m_heightTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		m_textureBytes = (size_t)tileSamples * tileSamples * sizeof(uint16_t) * kMaxResidentTiles;
+	}
+
+	void Terrain::PrepareTile(const std::vector<float>& samples, TileData& tile)
+	{
+		const int tileSamples{ TerrainTileFile::TileSamples(kTileCells) };
+
+		// Kept with the extra ring, the vertex shader reads past the tile's edges for normals
+		tile.heights.resize(samples.size());
+		for (size_t i = 0; i < samples.size(); i++)
+			tile.heights[i] = (uint16_t)std::lround(std::clamp(samples[i], 0.0f, 1.0f) * 65535.0f);
+
+		// Min and max sample of each leaf, including the shared edge samples, then each level from its four children
+		tile.nodeHeights.clear();
+		const int numLeaves{ kTileCells / kPatchCells };
+		std::vector<glm::vec2> leaves((size_t)numLeaves * numLeaves);
+		for (int nodeZ = 0; nodeZ < numLeaves; nodeZ++)
+		{
+			for (int nodeX = 0; nodeX < numLeaves; nodeX++)
+			{
+				glm::vec2 range{ std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+				for (int z = nodeZ * kPatchCells; z <= (nodeZ + 1) * kPatchCells; z++)
+				{
+					for (int x = nodeX * kPatchCells; x <= (nodeX + 1) * kPatchCells; x++)
+					{
+						const float height{ samples[(size_t)(z + TerrainTileFile::kTileRing) * tileSamples + x + TerrainTileFile::kTileRing] };
+						range.x = std::min(range.x, height);
+						range.y = std::max(range.y, height);
+					}
+				}
+				leaves[(size_t)nodeZ * numLeaves + nodeX] = range;
+			}
+		}
+		tile.nodeHeights.push_back(std::move(leaves));
+
+		for (int numNodes = numLeaves / 2; numNodes >= 1; numNodes /= 2)
+		{
+			const std::vector<glm::vec2>& children = tile.nodeHeights.back();
+			const int numChildren{ numNodes * 2 };
+			std::vector<glm::vec2> nodes((size_t)numNodes * numNodes);
+
+			for (int nodeZ = 0; nodeZ < numNodes; nodeZ++)
+			{
+				for (int nodeX = 0; nodeX < numNodes; nodeX++)
+				{
+					glm::vec2 range{ std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+					for (int child = 0; child < 4; child++)
+					{
+						const glm::vec2& childRange = children[(size_t)(nodeZ * 2 + (child >> 1)) * numChildren + nodeX * 2 + (child & 1)];
+						range.x = std::min(range.x, childRange.x);
+						range.y = std::max(range.y, childRange.y);
+					}
+					nodes[(size_t)nodeZ * numNodes + nodeX] = range;
+				}
+			}
+			tile.nodeHeights.push_back(std::move(nodes));
+		}
+	}
+
+	bool Terrain::PrepareOverview(const std::string& tilePath, int size, std::vector<uint16_t>& samples, std::vector<glm::vec2>& tileHeights) const
+	{
+		std::vector<float> overview;
+		if (!TerrainTileFile::ReadOverview(tilePath, size, kTileCells, kOverviewStep, overview))
+			return false;
+
+		samples.resize(overview.size());
+		for (size_t i = 0; i < overview.size(); i++)
+			samples[i] = (uint16_t)std::lround(std::clamp(overview[i], 0.0f, 1.0f) * 65535.0f);
+
+		// Each root covers kPatchCells + 1 overview samples along a side, after the extra ring
+		const int overviewSamples{ TerrainTileFile::OverviewSamples(size, kOverviewStep) };
+		const int numTiles{ size / kTileCells };
+		tileHeights.assign((size_t)numTiles * numTiles, glm::vec2(0));
+		for (int tileZ = 0; tileZ < numTiles; tileZ++)
+		{
+			for (int tileX = 0; tileX < numTiles; tileX++)
+			{
+				glm::vec2 range{ std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+				for (int z = tileZ * kPatchCells; z <= (tileZ + 1) * kPatchCells; z++)
+				{
+					for (int x = tileX * kPatchCells; x <= (tileX + 1) * kPatchCells; x++)
+					{
+						const float height{ overview[(size_t)(z + 1) * overviewSamples + x + 1] };
+						range.x = std::min(range.x, height);
+						range.y = std::max(range.y, height);
+					}
+				}
+				tileHeights[(size_t)tileZ * numTiles + tileX] = range;
+			}
+		}
+		return true;
+	}
+
+	void Terrain::UploadOverview(const std::vector<uint16_t>& samples)
+	{
+		const int overviewSamples{ TerrainTileFile::OverviewSamples(m_settings.size, kOverviewStep) };
+		if (m_overviewTexture && overviewSamples != m_overviewSamples)
+		{
+			glDeleteTextures(1, &m_overviewTexture);
+			m_overviewTexture = 0;
+		}
+
+		// Sized for the terrain so made again when the size changes
+		if (!m_overviewTexture)
+		{
+			glCreateTextures(GL_TEXTURE_2D, 1, &m_overviewTexture);
+			glTextureStorage2D(m_overviewTexture, 1, GL_R16, overviewSamples, overviewSamples);
+			glTextureParameteri(m_overviewTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTextureParameteri(m_overviewTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTextureParameteri(m_overviewTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTextureParameteri(m_overviewTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+			const int tileSamples{ TerrainTileFile::TileSamples(kTileCells) };
+			m_overviewSamples = overviewSamples;
+			m_textureBytes = ((size_t)tileSamples * tileSamples * kMaxResidentTiles + (size_t)overviewSamples * overviewSamples) * sizeof(uint16_t);
+		}
+
+		// Rows of an odd number of two byte texels are not 4 byte aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+		glTextureSubImage2D(m_overviewTexture, 0, 0, 0, overviewSamples, overviewSamples, GL_RED, GL_UNSIGNED_SHORT, samples.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		m_overviewReady = true;
+	}
+
+	void Terrain::RequestTile(int tileX, int tileZ)
+	{
+		m_tileRequested[(size_t)tileZ * m_numTiles + tileX] = 1;
+		m_numPending++;
+
+		const unsigned int generation{ m_generation };
+		const std::string tilePath{ m_tilePath };
+		const int size{ m_settings.size };
+		m_pool.Submit([this, tileX, tileZ, generation, tilePath, size]() {
+			TileData tile;
+			tile.tileX = tileX;
+			tile.tileZ = tileZ;
+			tile.generation = generation;
+
+			std::vector<float> samples;
+			tile.ok = TerrainTileFile::ReadTile(tilePath, size, kTileCells, tileX, tileZ, samples);
+			if (tile.ok)
+				PrepareTile(samples, tile);
+
+			std::lock_guard<std::mutex> lock(m_completedMutex);
+			m_completed.push_back(std::move(tile));
+		});
+	}
+
+	void Terrain::Update(const glm::vec3& cameraPosition, int radius, size_t byteBudget)
+	{
+		m_frame++;
+		m_bytesUploaded = 0;
+
+		std::vector<uint16_t> overview;
+		{
+			std::lock_guard<std::mutex> lock(m_completedMutex);
+			if (m_tileFileGeneration == m_generation && !m_tileFileReady)
+			{
+				m_tileFileReady = true;
+				overview.swap(m_completedOverview);
+				m_overviewHeights.swap(m_completedOverviewHeights);
+				m_completedOverviewHeights.clear();
+			}
+
+			// A tile that failed to read stays marked as requested so it is not asked for every frame
+			for (TileData& tile : m_completed)
+			{
+				if (tile.generation != m_generation)
+					continue;
+
+				m_numPending--;
+				if (tile.ok)
+					m_uploads.push_back(std::move(tile));
+			}
+			m_completed.clear();
+		}
+
+		if (!overview.empty())
+			UploadOverview(overview);
+
+		if (!m_tileFileReady)
+			return;
+
+		// Every tile of the ring has to fit with room to spare for recently left ones
+		while (radius > 0 && (radius * 2 + 1) * (radius * 2 + 1) > kMaxResidentTiles)
+			radius--;
+
+		// Tile under the camera, rows run along -z
+		const float tileWorldSize{ kTileCells * m_settings.spacing };
+		const int cameraTileX{ (int)std::floor((cameraPosition.x - m_settings.origin.x) / tileWorldSize) };
+		const int cameraTileZ{ (int)std::floor((m_settings.origin.z - cameraPosition.z) / tileWorldSize) };
+
+		// Resident tiles in the ring are kept, missing ones are asked for nearest first
+		std::vector<std::pair<int, int>> wanted;
+		for (int tileZ = std::max(cameraTileZ - radius, 0); tileZ <= std::min(cameraTileZ + radius, m_numTiles - 1); tileZ++)
+		{
+			for (int tileX = std::max(cameraTileX - radius, 0); tileX <= std::min(cameraTileX + radius, m_numTiles - 1); tileX++)
+			{
+				const int tile{ tileZ * m_numTiles + tileX };
+				if (m_tileSlots[tile] >= 0)
+					m_slots[m_tileSlots[tile]].lastUsedFrame = m_frame;
+				else if (!m_tileRequested[tile])
+					wanted.push_back({ (tileX - cameraTileX) * (tileX - cameraTileX) + (tileZ - cameraTileZ) * (tileZ - cameraTileZ), tile });
+			}
+		}
+
+		std::sort(wanted.begin(), wanted.end());
+		for (const std::pair<int, int>& tile : wanted)
+		{
+			if (m_numPending >= kMaxPendingTiles)
+				break;
+			RequestTile(tile.second % m_numTiles, tile.second / m_numTiles);
+		}
+
+		// Upload in the order they finished until the budget runs out. Tiles the camera has since moved away from are dropped.
+		while (!m_uploads.empty())
+		{
+			TileData& tile = m_uploads.front();
+			const int tileIndex{ tile.tileZ * m_numTiles + tile.tileX };
+			if (std::max(std::abs(tile.tileX - cameraTileX), std::abs(tile.tileZ - cameraTileZ)) > radius)
+			{
+				m_tileRequested[tileIndex] = 0;
+				m_uploads.pop_front();
+				continue;
+			}
+
+			const size_t bytes{ tile.Bytes() };
+			if (m_bytesUploaded > 0 && m_bytesUploaded + bytes > byteBudget)
+				break;
+
+			if (!UploadTile(tile))
+				break;
+
+			m_bytesUploaded += bytes;
+			m_uploads.pop_front();
+		}
+	}
+
+	bool Terrain::UploadTile(TileData& tile)
+	{
+		// A free slot, otherwise the one used longest ago that is not needed this frame
+		int slotIndex{ -1 };
+		for (int s = 0; s < (int)m_slots.size(); s++)
+		{
+			if (m_slots[s].tile < 0)
+			{
+				slotIndex = s;
+				break;
+			}
+			if (m_slots[s].lastUsedFrame < m_frame && (slotIndex < 0 || m_slots[s].lastUsedFrame < m_slots[slotIndex].lastUsedFrame))
+				slotIndex = s;
+		}
+
+		if (slotIndex < 0)
+			return false;
+
+		Slot& slot = m_slots[slotIndex];
+		if (slot.tile >= 0)
+		{
+			m_tileSlots[slot.tile] = -1;
+			m_tileRequested[slot.tile] = 0;
+			m_numEvictions++;
+		}
+
+		// Rows of an odd number of two byte texels are not 4 byte aligned
+		const int tileSamples{ TerrainTileFile::TileSamples(kTileCells) };
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+		glTextureSubImage3D(m_heightTexture, 0, 0, 0, slotIndex, tileSamples, tileSamples, 1, GL_RED, GL_UNSIGNED_SHORT, tile.heights.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		const int tileIndex{ tile.tileZ * m_numTiles + tile.tileX };
+		slot.tile = tileIndex;
+		slot.lastUsedFrame = m_frame;
+		slot.nodeHeights = std::move(tile.nodeHeights);
+		m_tileSlots[tileIndex] = slotIndex;
+		return true;
+	}
+
+	int Terrain::NumResidentTiles() const
+	{
+		int numResident{ 0 };
+		for (const Slot& slot : m_slots)
+			numResident += slot.tile >= 0 ? 1 : 0;
+		return numResident;
+	}
+
+	void Terrain::CreatePatch(std::vector<glm::vec3>& positions, std::vector<GLuint>& elements)
+	{
+		const int numCells{ kPatchCells / 2 };
+		const int numVerts{ numCells + 1 };
+
+		positions.clear();
+		for (int z = 0; z < numVerts; z++)
+			for (int x = 0; x < numVerts; x++)
+				positions.push_back(glm::vec3(x, 0, z));
+
+		// Every diagonal runs the same way so a fully morphed block of four cells leaves exactly the next level's cell
+		elements.clear();
+		for (int cellZ = 0; cellZ < numCells; cellZ++)
+		{
+			for (int cellX = 0; cellX < numCells; cellX++)
+			{
+				const GLuint startVertIndex = cellZ * numVerts + cellX;
+
+				elements.push_back(startVertIndex);
+				elements.push_back(startVertIndex + 1);
+				elements.push_back(startVertIndex + numVerts + 1);
+
+				elements.push_back(startVertIndex);
+				elements.push_back(startVertIndex + numVerts + 1);
+				elements.push_back(startVertIndex + numVerts);
+			}
+		}
+	}
+
+	void Terrain::NodeBounds(const Slot& slot, int level, int x, int z, glm::vec3& minExtents, glm::vec3& maxExtents) const
+	{
+		const int size{ kPatchCells << level };
+		const glm::vec2& range = slot.nodeHeights[level][(size_t)z * (kTileCells / size) + x];
+		const glm::vec3& origin = m_settings.origin;
+
+		// In cells from the terrain's origin
+		const int firstX{ (slot.tile % m_numTiles) * kTileCells + x * size };
+		const int firstZ{ (slot.tile / m_numTiles) * kTileCells + z * size };
+
+		minExtents = glm::vec3(origin.x + firstX * m_settings.spacing, origin.y + m_settings.heightOffset + range.x * m_settings.heightScale,
+			origin.z - (firstZ + size) * m_settings.spacing);
+		maxExtents = glm::vec3(origin.x + (firstX + size) * m_settings.spacing, origin.y + m_settings.heightOffset + range.y * m_settings.heightScale,
+			origin.z - firstZ * m_settings.spacing);
+	}
+
+	void Terrain::Select(const glm::vec3& cameraPosition, float lodDistance, const Frustum* frustum)
+	{
+		m_selection.clear();
+		m_numNodesVisited = 0;
+		m_numNodesCulled = 0;
+
+		m_lodRanges.resize(m_numLevels);
+		for (int level = 0; level < m_numLevels; level++)
+			m_lodRanges[level] = lodDistance * (float)(1 << level);
+
+		// Each resident tile is the root of its own tree, the rest are single nodes from the overview
+		for (int tile = 0; tile < (int)m_tileSlots.size(); tile++)
+		{
+			if (m_tileSlots[tile] >= 0)
+				SelectNode(m_tileSlots[tile], m_numLevels - 1, 0, 0, cameraPosition, frustum);
+			else if (m_overviewReady)
+				SelectOverviewRoot(tile, frustum);
+		}
+	}
+
+	void Terrain::SelectOverviewRoot(int tile, const Frustum* frustum)
+	{
+		m_numNodesVisited++;
+
+		TerrainNodeDraw draw;
+		draw.size = kTileCells;
+		draw.x = (tile % m_numTiles) * kTileCells;
+		draw.z = (tile / m_numTiles) * kTileCells;
+		draw.level = m_numLevels - 1;
+		draw.slot = -1;
+
+		const glm::vec2& range = m_overviewHeights[tile];
+		const glm::vec3& origin = m_settings.origin;
+		const glm::vec3 minExtents{ origin.x + draw.x * m_settings.spacing, origin.y + m_settings.heightOffset + range.x * m_settings.heightScale,
+			origin.z - (draw.z + draw.size) * m_settings.spacing };
+		const glm::vec3 maxExtents{ origin.x + (draw.x + draw.size) * m_settings.spacing,
+			origin.y + m_settings.heightOffset + range.y * m_settings.heightScale, origin.z - draw.z * m_settings.spacing };
+
+		if (frustum && !frustum->TestBox(minExtents, maxExtents))
+		{
+			m_numNodesCulled++;
+			return;
+		}
+		m_selection.push_back(draw);
+	}
+
+	bool Terrain::SelectNode(int slot, int level, int x, int z, const glm::vec3& cameraPosition, const Frustum* frustum)
+	{
+		glm::vec3 minExtents, maxExtents;
+		NodeBounds(m_slots[slot], level, x, z, minExtents, maxExtents);
+
+		// Distance to the nearest point of the box, tile roots cover everything however far away
+		auto inRange = [&](float range) {
+			return glm::distance(glm::clamp(cameraPosition, minExtents, maxExtents), cameraPosition) <= range;
+		};
+
+		if (level < m_numLevels - 1 && !inRange(m_lodRanges[level]))
+			return false;
+
+		m_numNodesVisited++;
+
+		// Nothing below an invisible node is visible either, but it is still handled so the parent does not draw it
+		if (frustum && !frustum->TestBox(minExtents, maxExtents))
+		{
+			m_numNodesCulled++;
+			return true;
+		}
+
+		const int tile{ m_slots[slot].tile };
+		TerrainNodeDraw draw;
+		draw.size = kPatchCells << level;
+		draw.x = (tile % m_numTiles) * kTileCells + x * draw.size;
+		draw.z = (tile / m_numTiles) * kTileCells + z * draw.size;
+		draw.level = level;
+		draw.slot = slot;
+
+		// Too far away for the next level down anywhere in the node
+		if (level == 0 || !inRange(m_lodRanges[level - 1]))
+		{
+			m_selection.push_back(draw);
+			return true;
+		}
+
+		// Children out of their own range leave their quarter to this node
+		draw.quadrants = 0;
+		for (int child = 0; child < 4; child++)
+		{
+			if (!SelectNode(slot, level - 1, x * 2 + (child & 1), z * 2 + (child >> 1), cameraPosition, frustum))
+				draw.quadrants |= 1u << child;
+		}
+
+		if (draw.quadrants)
+			m_selection.push_back(draw);
+		return true;
+	}
+
+	void Terrain::Instances(std::vector<TerrainInstance>& instances) const
+	{
+		instances.clear();
+		for (const TerrainNodeDraw& draw : m_selection)
+		{
+			TerrainInstance instance;
+			instance.node = glm::vec4(draw.x, draw.z, draw.size, draw.level);
+			if (draw.slot >= 0)
+			{
+				const int tile{ m_slots[draw.slot].tile };
+				instance.tile = glm::vec4((tile % m_numTiles) * kTileCells, (tile / m_numTiles) * kTileCells, draw.slot, 0);
+			}
+			else
+			{
+				instance.tile = glm::vec4(0, 0, -1, 0);
+			}
+
+			// Tile roots have no coarser level to morph into, every tile's root is the same level so they still meet
+			if (draw.level == m_numLevels - 1)
+			{
+				instance.morph = glm::vec4(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), 0, 0);
+			}
+			else
+			{
+				const float end{ m_lodRanges[draw.level] };
+				const float previous{ draw.level > 0 ? m_lodRanges[draw.level - 1] : 0.0f };
+				const float start{ previous + (end - previous) * kMorphStart };
+				instance.morph = glm::vec4(start, end, 1.0f / (end - start), 0);
+			}
+
+			for (int quadrant = 0; quadrant < 4; quadrant++)
+			{
+				if (draw.quadrants & (1u << quadrant))
+				{
+					instance.morph.w = (float)quadrant;
+					instances.push_back(instance);
+				}
+			}
+		}
+	}
+
+	TerrainConstants Terrain::Constants() const
+	{
+		TerrainConstants constants;
+		constants.origin = glm::vec4(m_settings.origin, m_settings.spacing);
+		constants.heightParams = glm::vec4(m_settings.heightScale, m_settings.heightOffset, 1.0f / TerrainTileFile::TileSamples(kTileCells),
+			1.0f / m_settings.textureRepeatCells);
+		constants.overview = glm::vec4(m_overviewSamples > 0 ? 1.0f / m_overviewSamples : 0.0f, kOverviewStep, 0, 0);
+		return constants;
+	}
+}
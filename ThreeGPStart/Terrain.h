@@ -0,0 +1,263 @@
+#pragma once
+// Quadtree terrain with continuous level of detail, one shared grid patch instanced across the terrain and displaced
+// on the GPU by 16 bit height textures that are streamed in tile by tile around the camera
+
+#include "ExternalLibraryHeaders.h"
+#include "Frustum.h"
+#include "Heightfield.h"
+#include "ThreadPool.h"
+
+namespace Helpers
+{
+	// How a terrain is built. Changing the size means building it again.
+	struct TerrainSettings
+	{
+		// Cells along each side, a power of two no smaller than a tile
+		int size{ 512 };
+
+		// World units between samples
+		float spacing{ 3.0f };
+
+		// World height = origin.y + heightOffset + heightScale * sample, samples are 0 to 1
+		float heightScale{ 25.5f };
+		float heightOffset{ -4.0f };
+
+		// World position of sample (0, 0). Columns run along +x and rows along -z.
+		glm::vec3 origin{ 0 };
+
+		// Cells covered by one repeat of the surface texture
+		float textureRepeatCells{ 150.0f };
+
+		// How the heightmap is resampled to size + 1 samples along each side, whatever the image's resolution
+		HeightfieldFilter filter{ HeightfieldFilter::Bicubic };
+	};
+
+	// std140 layout of the TerrainConstants block in terrain_vertex_shader.vert, written once per frame
+	struct TerrainConstants
+	{
+		// w is the spacing
+		glm::vec4 origin;
+
+		// Height scale, height offset, 1 / samples along a stored tile's side, 1 / texture repeat cells
+		glm::vec4 heightParams;
+
+		// 1 / samples along the overview's side, cells between overview samples
+		glm::vec4 overview;
+	};
+
+	// std140 layout of one element of the TerrainInstances block, one per drawn quadrant of a selected node
+	struct TerrainInstance
+	{
+		// First cell x, first cell z, size in cells, level
+		glm::vec4 node;
+
+		// Distance the morph to the next level starts and ends at, 1 / (end - start), quadrant of the node
+		glm::vec4 morph;
+
+		// First cell x and z of the node's tile, the tile's layer in the height array or -1 for the overview
+		glm::vec4 tile;
+	};
+
+	// A node chosen for drawing this frame. Quadrants not set are drawn by finer nodes.
+	struct TerrainNodeDraw
+	{
+		// In cells from the terrain's origin
+		int x{ 0 };
+		int z{ 0 };
+		int size{ 0 };
+		int level{ 0 };
+
+		// Resident tile slot holding the node's heights, -1 for a tile root drawn from the overview
+		int slot{ 0 };
+
+		// Bit q set draws quadrant q, 0xF is the whole node
+		unsigned int quadrants{ 0xF };
+	};
+
+	// The heightfield is split into tiles of kTileCells, each a quadtree whose leaves are kPatchCells square at full
+	// resolution. Each level up covers twice the area with the same number of vertices. Nodes are picked by distance
+	// CDLOD style: a level is used out to its range and its odd vertices morph towards the next level over the last
+	// third of that range, so there are no cracks or pops between levels. Any node outside the view frustum is skipped
+	// along with everything below it.
+	//
+	// There are no per vertex terrain buffers. Every drawn quadrant of a node is an instance of one flat grid patch,
+	// placed, displaced and lit in the vertex shader from an R16 height array. Each tile is stored with a ring of extra
+	// samples so normals can be worked out from neighbouring heights right up to its edges. Normals take differences
+	// a vertex apart, so coarse nodes are lit from the heights they are drawn with rather than from detail between
+	// their vertices that would flicker as they move.
+	//
+	// Only tiles near the camera are resident. The heightmap is resampled once into a tile file on a worker, then
+	// tiles in a ring around the camera are read and prepared on workers, uploaded into a fixed number of texture
+	// array layers within a per frame byte budget, and the least recently used tile is evicted to make room.
+	// Every other tile draws just its root from an always resident overview holding the samples a root's vertices
+	// land on, so distant terrain is never missing. Memory only grows with the overview, 0.5 MB at 4096 cells.
+	class Terrain
+	{
+	public:
+		// Cells along each side of the shared patch and of a leaf node
+		static constexpr int kPatchCells{ 32 };
+
+		// Cells along each side of a streamed tile, the root of its quadtree
+		static constexpr int kTileCells{ 256 };
+
+		// Texture array layers, must be more than the tiles in the largest ring
+		static constexpr int kMaxResidentTiles{ 64 };
+
+		// Tiles being read at once, more are asked for as these finish
+		static constexpr int kMaxPendingTiles{ 8 };
+
+		// Cells between overview samples, the spacing of a tile root's vertices
+		static constexpr int kOverviewStep{ kTileCells / kPatchCells };
+
+		// Length of the instance array in terrain_vertex_shader.vert, keeps the block within the 16 KB GL guarantees
+		static constexpr int kMaxInstancesPerDraw{ 256 };
+
+		// Fraction of a level's range after which it morphs into the next
+		static constexpr float kMorphStart{ 0.66f };
+	private:
+		// A tile read and prepared on a worker, waiting to be uploaded
+		struct TileData
+		{
+			int tileX{ 0 };
+			int tileZ{ 0 };
+			unsigned int generation{ 0 };
+			bool ok{ false };
+
+			// Samples including the extra ring as 16 bit unorm
+			std::vector<uint16_t> heights;
+
+			// Min and max sample in each node, a grid per level with the leaves first
+			std::vector<std::vector<glm::vec2>> nodeHeights;
+
+			size_t Bytes() const;
+		};
+
+		// One layer of the texture arrays
+		struct Slot
+		{
+			// Tile index, -1 if free
+			int tile{ -1 };
+			uint64_t lastUsedFrame{ 0 };
+			std::vector<std::vector<glm::vec2>> nodeHeights;
+		};
+
+		TerrainSettings m_settings;
+		std::string m_tilePath;
+		int m_numTiles{ 0 };
+		int m_numLevels{ 0 };
+
+		// Bumped by every build so work for an older one is thrown away
+		unsigned int m_generation{ 0 };
+		bool m_tileFileReady{ false };
+
+		// Per tile, the slot it is resident in or -1, and whether it has been asked for
+		std::vector<int> m_tileSlots;
+		std::vector<unsigned char> m_tileRequested;
+		std::vector<Slot> m_slots;
+		std::deque<TileData> m_uploads;
+		int m_numPending{ 0 };
+		uint64_t m_frame{ 0 };
+
+		// Distance each level is used out to, from the last Select
+		std::vector<float> m_lodRanges;
+
+		GLuint m_heightTexture{ 0 };
+		size_t m_textureBytes{ 0 };
+
+		// Every kOverviewStep'th sample of the whole terrain, and the min and max of each tile root's
+		GLuint m_overviewTexture{ 0 };
+		int m_overviewSamples{ 0 };
+		bool m_overviewReady{ false };
+		std::vector<glm::vec2> m_overviewHeights;
+
+		std::vector<TerrainNodeDraw> m_selection;
+		size_t m_numNodesVisited{ 0 };
+		size_t m_numNodesCulled{ 0 };
+		size_t m_bytesUploaded{ 0 };
+		size_t m_numEvictions{ 0 };
+
+		// Written by the workers
+		std::mutex m_completedMutex;
+		std::vector<TileData> m_completed;
+		unsigned int m_tileFileGeneration{ 0 };
+		std::vector<uint16_t> m_completedOverview;
+		std::vector<glm::vec2> m_completedOverviewHeights;
+
+		// Works out everything the GPU and the selection need from a tile's samples. Runs on a worker.
+		static void PrepareTile(const std::vector<float>& samples, TileData& tile);
+
+		void CreateTextures();
+		void RequestTile(int tileX, int tileZ);
+		void UploadOverview(const std::vector<uint16_t>& samples);
+
+		// Reads the overview once the tile file is ready. Runs on a worker.
+		bool PrepareOverview(const std::string& tilePath, int size, std::vector<uint16_t>& samples, std::vector<glm::vec2>& tileHeights) const;
+
+		// Returns false if every slot was used this frame
+		bool UploadTile(TileData& tile);
+
+		void NodeBounds(const Slot& slot, int level, int x, int z, glm::vec3& minExtents, glm::vec3& maxExtents) const;
+
+		// False if the node is beyond its level's range, then its parent draws the area instead.
+		// x and z are node coordinates within the tile at this level.
+		bool SelectNode(int slot, int level, int x, int z, const glm::vec3& cameraPosition, const Frustum* frustum);
+
+		// A tile that is not resident draws its root from the overview
+		void SelectOverviewRoot(int tile, const Frustum* frustum);
+
+		// Declared last so workers are joined before the members they use are destroyed
+		ThreadPool m_pool{ 2 };
+	public:
+		Terrain() = default;
+		~Terrain();
+
+		Terrain(const Terrain&) = delete;
+		Terrain& operator=(const Terrain&) = delete;
+
+		// Starts streaming a new terrain from the heightmap. Returns false if the settings are invalid. The image is
+		// read on a worker so errors loading it are reported from there, and nothing is drawn until tiles arrive.
+		bool Build(const std::string& heightmapPath, const TerrainSettings& settings);
+
+		// Grid covering one quadrant of a node, (kPatchCells / 2 + 1) squared vertices. Positions are in cells,
+		// x along columns and z along rows.
+		static void CreatePatch(std::vector<glm::vec3>& positions, std::vector<GLuint>& elements);
+
+		// Once a frame before Select. Asks for any tile within radius tiles of the camera's that is not resident, then
+		// uploads finished tiles until byteBudget is used, always at least one.
+		void Update(const glm::vec3& cameraPosition, int radius, size_t byteBudget);
+
+		// Choose this frame's nodes from the resident tiles. Level 0 is used out to lodDistance, each level after that
+		// twice as far. Pass no frustum to turn culling off.
+		void Select(const glm::vec3& cameraPosition, float lodDistance, const Frustum* frustum);
+
+		const std::vector<TerrainNodeDraw>& Selection() const { return m_selection; }
+		TerrainConstants Constants() const;
+
+		// One instance of the patch per quadrant drawn by the selection
+		void Instances(std::vector<TerrainInstance>& instances) const;
+
+		bool Valid() const { return m_heightTexture != 0; }
+		const TerrainSettings& Settings() const { return m_settings; }
+		int NumLevels() const { return m_numLevels; }
+
+		// GL_TEXTURE_2D_ARRAY with a layer per slot
+		GLuint HeightTexture() const { return m_heightTexture; }
+
+		// GL_TEXTURE_2D of the whole terrain at root resolution
+		GLuint OverviewTexture() const { return m_overviewTexture; }
+
+		// The height array, the same whatever the terrain size, and the overview
+		size_t TextureBytes() const { return m_textureBytes; }
+
+		// Streaming figures, bytes uploaded are for the last Update
+		int NumTiles() const { return m_numTiles * m_numTiles; }
+		int NumResidentTiles() const;
+		int NumPendingTiles() const { return m_numPending + (int)m_uploads.size(); }
+		size_t BytesUploaded() const { return m_bytesUploaded; }
+		size_t NumEvictions() const { return m_numEvictions; }
+
+		// From the last Select
+		size_t NumNodesVisited() const { return m_numNodesVisited; }
+		size_t NumNodesCulled() const { return m_numNodesCulled; }
+	};
+}
@@ -0,0 +1,210 @@
+#include "TerrainTileFile.h"
+#include <filesystem>
+#include <fstream>
+#include <thread>
+namespace fs = std::filesystem;
+
+namespace Helpers
+{
+	namespace
+	{
+		// Bump whenever the layout below changes so old files get rewritten
+		constexpr uint32_t kTileFileVersion{ 4 };
+		constexpr char kTileFileMagic[4]{ 'T', 'I', 'L', 'E' };
+
+		struct TileFileHeader
+		{
+			char magic[4];
+			uint32_t version;
+			uint64_t key;
+			int32_t size;
+			int32_t tileCells;
+			int32_t overviewStep;
+		};
+
+		// 64 bit FNV-1a, as the mesh cache
+		constexpr uint64_t kFnvOffset{ 14695981039346656037ull };
+		constexpr uint64_t kFnvPrime{ 1099511628211ull };
+
+		uint64_t Fnv1a(const char* data, size_t size, uint64_t hash = kFnvOffset)
+		{
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= (unsigned char)data[i];
+				hash *= kFnvPrime;
+			}
+			return hash;
+		}
+
+		bool ReadHeader(std::ifstream& in, TileFileHeader& header)
+		{
+			in.read((char*)&header, sizeof(header));
+			return in && memcmp(header.magic, kTileFileMagic, sizeof(kTileFileMagic)) == 0 && header.version == kTileFileVersion;
+		}
+	}
+
+	namespace TerrainTileFile
+	{
+		std::string PathFor(const std::string& heightmapPath, int size, HeightfieldFilter filter)
+		{
+			return heightmapPath + "." + std::to_string(size) + "." + HeightfieldFilterName(filter) + ".tiles";
+		}
+
+		uint64_t ComputeKey(const std::string& heightmapPath, int size, int tileCells, int overviewStep, HeightfieldFilter filter)
+		{
+			std::ifstream in(heightmapPath, std::ios::binary);
+			if (!in)
+				return 0;
+
+			uint64_t hash{ kFnvOffset };
+			std::vector<char> buffer(1 << 16);
+			while (in)
+			{
+				in.read(buffer.data(), buffer.size());
+				hash = Fnv1a(buffer.data(), (size_t)in.gcount(), hash);
+			}
+
+			hash = Fnv1a((const char*)&size, sizeof(size), hash);
+			hash = Fnv1a((const char*)&tileCells, sizeof(tileCells), hash);
+			hash = Fnv1a((const char*)&overviewStep, sizeof(overviewStep), hash);
+			hash = Fnv1a((const char*)&filter, sizeof(filter), hash);
+			hash = Fnv1a((const char*)&kTileFileVersion, sizeof(kTileFileVersion), hash);
+
+			// Reserve 0 for 'no key'
+			return hash ? hash : 1;
+		}
+
+		bool IsValid(const std::string& tilePath, uint64_t key)
+		{
+			std::ifstream in(tilePath, std::ios::binary);
+			TileFileHeader header{};
+			return in && ReadHeader(in, header) && header.key == key;
+		}
+
+		bool Write(const std::string& heightmapPath, const std::string& tilePath, int size, int tileCells, int overviewStep,
+			HeightfieldFilter filter, uint64_t key)
+		{
+			Heightfield heightfield;
+			if (!heightfield.Load(heightmapPath))
+				return false;
+
+			// Written under a temporary name so a half written file is never picked up. The name is unique to the thread
+			// as builds started in quick succession can be writing the same tiles on two workers at once.
+			std::ostringstream threadId;
+			threadId << std::this_thread::get_id();
+			const std::string tempPath{ tilePath + "." + threadId.str() + ".tmp" };
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out)
+			{
+				std::cout << "Could not write terrain tiles: " << tilePath << std::endl;
+				return false;
+			}
+
+			TileFileHeader header{};
+			memcpy(header.magic, kTileFileMagic, sizeof(kTileFileMagic));
+			header.version = kTileFileVersion;
+			header.key = key;
+			header.size = size;
+			header.tileCells = tileCells;
+			header.overviewStep = overviewStep;
+			out.write((const char*)&header, sizeof(header));
+
+			// The image can be any size, it is resampled to the terrain's
+			const int numSamples{ size + 1 };
+			const int numTiles{ size / tileCells };
+			const int tileSamples{ TileSamples(tileCells) };
+			std::vector<float> samples((size_t)tileSamples * tileSamples);
+
+			for (int tileZ = 0; tileZ < numTiles; tileZ++)
+			{
+				for (int tileX = 0; tileX < numTiles; tileX++)
+				{
+					// The extra ring starts kTileRing samples before the tile and repeats the edge outside the terrain
+					const int firstX{ tileX * tileCells - kTileRing };
+					const int firstZ{ tileZ * tileCells - kTileRing };
+					const HeightfieldRegion region{ firstX, firstZ, firstX + tileSamples, firstZ + tileSamples };
+					heightfield.Resample(numSamples, numSamples, filter, region, samples.data());
+
+					out.write((const char*)samples.data(), samples.size() * sizeof(float));
+				}
+			}
+
+			// Resampling to the coarser grid lands on the same image positions as every overviewStep'th sample
+			const int overviewSamples{ OverviewSamples(size, overviewStep) };
+			const int overviewGridSamples{ size / overviewStep + 1 };
+			samples.resize((size_t)overviewSamples * overviewSamples);
+			heightfield.Resample(overviewGridSamples, overviewGridSamples, filter, HeightfieldRegion{ -1, -1, overviewSamples - 1, overviewSamples - 1 },
+				samples.data());
+			out.write((const char*)samples.data(), samples.size() * sizeof(float));
+
+			out.close();
+			std::error_code error;
+			if (!out)
+			{
+				std::cout << "Could not write terrain tiles: " << tilePath << std::endl;
+				fs::remove(tempPath, error);
+				return false;
+			}
+
+			fs::rename(tempPath, tilePath, error);
+			if (error)
+			{
+				std::cout << "Could not write terrain tiles: " << tilePath << " " << error.message() << std::endl;
+				fs::remove(tempPath, error);
+				return false;
+			}
+			return true;
+		}
+
+		bool ReadTile(const std::string& tilePath, int size, int tileCells, int tileX, int tileZ, std::vector<float>& samples)
+		{
+			std::ifstream in(tilePath, std::ios::binary);
+			TileFileHeader header{};
+			if (!in || !ReadHeader(in, header) || header.size != size || header.tileCells != tileCells)
+			{
+				std::cout << "Invalid terrain tiles: " << tilePath << std::endl;
+				return false;
+			}
+
+			const int numTiles{ size / tileCells };
+			const int tileSamples{ TileSamples(tileCells) };
+			const size_t tileBytes{ (size_t)tileSamples * tileSamples * sizeof(float) };
+
+			samples.resize((size_t)tileSamples * tileSamples);
+			in.seekg(sizeof(TileFileHeader) + ((size_t)tileZ * numTiles + tileX) * tileBytes);
+			in.read((char*)samples.data(), tileBytes);
+			if (!in)
+			{
+				std::cout << "Could not read terrain tile " << tileX << ", " << tileZ << " from " << tilePath << std::endl;
+				return false;
+			}
+			return true;
+		}
+
+		bool ReadOverview(const std::string& tilePath, int size, int tileCells, int overviewStep, std::vector<float>& samples)
+		{
+			std::ifstream in(tilePath, std::ios::binary);
+			TileFileHeader header{};
+			if (!in || !ReadHeader(in, header) || header.size != size || header.tileCells != tileCells || header.overviewStep != overviewStep)
+			{
+				std::cout << "Invalid terrain tiles: " << tilePath << std::endl;
+				return false;
+			}
+
+			const int numTiles{ size / tileCells };
+			const int tileSamples{ TileSamples(tileCells) };
+			const size_t tileBytes{ (size_t)tileSamples * tileSamples * sizeof(float) };
+			const int overviewSamples{ OverviewSamples(size, overviewStep) };
+
+			samples.resize((size_t)overviewSamples * overviewSamples);
+			in.seekg(sizeof(TileFileHeader) + (size_t)numTiles * numTiles * tileBytes);
+			in.read((char*)samples.data(), samples.size() * sizeof(float));
+			if (!in)
+			{
+				std::cout << "Could not read the terrain overview from " << tilePath << std::endl;
+				return false;
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+// A heightmap resampled once into a file of square tiles so any one tile can be read without decoding the image,
+// followed by a coarse overview of the whole terrain
+
+#include "ExternalLibraryHeaders.h"
+#include "Heightfield.h"
+
+namespace Helpers
+{
+	// The file sits next to the heightmap and is keyed by a hash of the image plus the terrain size, tile size and
+	// filter, so a changed image or setting writes it again. Every tile stores its (tileCells + 1) squared samples plus a
+	// ring kTileRing samples wide around them, clamped at the edge of the terrain, so normals can be worked out without
+	// its neighbours. After the tiles comes every overviewStep'th sample of the whole terrain, with a ring of one.
+	// Samples are 0 to 1.
+	namespace TerrainTileFile
+	{
+		// Samples stored either side of a tile, as far as normals at the spacing of a tile root's vertices reach
+		constexpr int kTileRing{ 8 };
+
+		// Samples along each side of a stored tile, including the extra ring
+		inline int TileSamples(int tileCells) { return tileCells + 1 + 2 * kTileRing; }
+
+		// Samples along each side of the overview, including the extra ring
+		inline int OverviewSamples(int size, int overviewStep) { return size / overviewStep + 3; }
+
+		// Filename of the tiles for a heightmap resampled to size cells along each side
+		std::string PathFor(const std::string& heightmapPath, int size, HeightfieldFilter filter);
+
+		// Key used to validate a tile file, 0 if the heightmap cannot be read
+		uint64_t ComputeKey(const std::string& heightmapPath, int size, int tileCells, int overviewStep, HeightfieldFilter filter);
+
+		// True if the file exists and was written with this key
+		bool IsValid(const std::string& tilePath, uint64_t key);
+
+		// Decode the heightmap, resample it with filter to size + 1 samples along each side and write it out tile by
+		// tile. Decoding is slow so this is meant for a worker thread. Returns false on error.
+		bool Write(const std::string& heightmapPath, const std::string& tilePath, int size, int tileCells, int overviewStep,
+			HeightfieldFilter filter, uint64_t key);
+
+		// One tile's samples including the extra ring, row by row. Returns false on error.
+		bool ReadTile(const std::string& tilePath, int size, int tileCells, int tileX, int tileZ, std::vector<float>& samples);
+
+		// The overview's samples including the extra ring, row by row. Returns false on error.
+		bool ReadOverview(const std::string& tilePath, int size, int tileCells, int overviewStep, std::vector<float>& samples);
+	}
+}
@@ -0,0 +1,179 @@
+#include "TextureManager.h"
+#include "ImageLoader.h"
+#include <algorithm>
+
+namespace Helpers
+{
+	TextureManager::~TextureManager()
+	{
+		for (const auto& pair : m_textures)
+			glDeleteTextures(1, &pair.second.texture);
+	}
+
+	std::string TextureManager::MakeKey(const std::string& path, const TextureSettings& settings)
+	{
+		std::stringstream key;
+		key << path << '|' << settings.wrap << '|' << settings.minFilter << '|' << settings.magFilter << '|' << settings.mipmaps;
+		return key.str();
+	}
+
+	size_t TextureManager::MipChainBytes(int width, int height, int numLevels)
+	{
+		size_t bytes{ 0 };
+		for (int level = 0; level < numLevels; level++)
+			bytes += (size_t)std::max(width >> level, 1) * std::max(height >> level, 1) * 4;
+		return bytes;
+	}
+
+	GLuint TextureManager::Reuse(const std::string& key)
+	{
+		auto it = m_textures.find(key);
+		if (it == m_textures.end())
+			return 0;
+
+		it->second.refCount++;
+		it->second.requests++;
+		m_duplicatesAvoided++;
+		m_bytesSaved += it->second.bytes;
+		return it->second.texture;
+	}
+
+	GLuint TextureManager::Acquire(const std::string& path, const TextureSettings& settings)
+	{
+		const std::string key{ MakeKey(path, settings) };
+		if (GLuint texture = Reuse(key))
+			return texture;
+
+		ImageLoader image;
+		if (!image.Load(path))
+			return 0;
+
+		Entry entry;
+		entry.path = path;
+		entry.width = image.Width();
+		entry.height = image.Height();
+		entry.refCount = 1;
+		entry.requests = 1;
+
+		const int numLevels{ settings.mipmaps ? (int)std::floor(std::log2(std::max(entry.width, entry.height))) + 1 : 1 };
+		entry.bytes = MipChainBytes(entry.width, entry.height, numLevels);
+
+		// Immutable storage sized for the whole mip chain up front
+		glCreateTextures(GL_TEXTURE_2D, 1, &entry.texture);
+		glTextureStorage2D(entry.texture, numLevels, GL_RGBA8, entry.width, entry.height);
+		glTextureSubImage2D(entry.texture, 0, 0, 0, entry.width, entry.height, GL_RGBA, GL_UNSIGNED_BYTE, image.GetData());
+		glTextureParameteri(entry.texture, GL_TEXTURE_WRAP_S, settings.wrap);
+		glTextureParameteri(entry.texture, GL_TEXTURE_WRAP_T, settings.wrap);
+		glTextureParameteri(entry.texture, GL_TEXTURE_MIN_FILTER, settings.mipmaps ? settings.minFilter : GL_LINEAR);
+		glTextureParameteri(entry.texture, GL_TEXTURE_MAG_FILTER, settings.magFilter);
+		if (settings.mipmaps)
+			glGenerateTextureMipmap(entry.texture);
+
+		m_keyForTexture[entry.texture] = key;
+		m_textures[key] = entry;
+		return entry.texture;
+	}
+
+	GLuint TextureManager::AcquireCubeMap(const std::string (&faces)[6], const TextureSettings& settings)
+	{
+		std::string key{ "cube" };
+		for (const std::string& face : faces)
+			key += "|" + face;
+		key = MakeKey(key, settings);
+		if (GLuint texture = Reuse(key))
+			return texture;
+
+		Entry entry;
+		entry.path = faces[0] + " (cube map)";
+		entry.refCount = 1;
+		entry.requests = 1;
+
+		std::vector<GLubyte> flipped;
+		int numLevels{ 1 };
+		for (int f = 0; f < 6; f++)
+		{
+			ImageLoader image;
+			if (!image.Load(faces[f]))
+			{
+				glDeleteTextures(1, &entry.texture);
+				return 0;
+			}
+
+			// Storage is allocated from the first face, the rest must match
+			if (f == 0)
+			{
+				entry.width = image.Width();
+				entry.height = image.Height();
+				numLevels = settings.mipmaps ? (int)std::floor(std::log2(std::max(entry.width, entry.height))) + 1 : 1;
+				entry.bytes = MipChainBytes(entry.width, entry.height, numLevels) * 6;
+
+				glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &entry.texture);
+				glTextureStorage2D(entry.texture, numLevels, GL_RGBA8, entry.width, entry.height);
+			}
+			else if (image.Width() != entry.width || image.Height() != entry.height)
+			{
+				std::cout << "TextureManager: cube map face " << faces[f] << " is not " << entry.width << "x" << entry.height << std::endl;
+				glDeleteTextures(1, &entry.texture);
+				return 0;
+			}
+
+			// FreeImage rows are bottom up, cube map faces are addressed from the top
+			const size_t rowBytes{ (size_t)entry.width * 4 };
+			flipped.resize(rowBytes * entry.height);
+			for (int row = 0; row < entry.height; row++)
+				memcpy(&flipped[row * rowBytes], image.GetData() + (entry.height - 1 - row) * rowBytes, rowBytes);
+
+			glTextureSubImage3D(entry.texture, 0, 0, 0, f, entry.width, entry.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, flipped.data());
+		}
+
+		glTextureParameteri(entry.texture, GL_TEXTURE_WRAP_S, settings.wrap);
+		glTextureParameteri(entry.texture, GL_TEXTURE_WRAP_T, settings.wrap);
+		glTextureParameteri(entry.texture, GL_TEXTURE_WRAP_R, settings.wrap);
+		glTextureParameteri(entry.texture, GL_TEXTURE_MIN_FILTER, settings.mipmaps ? settings.minFilter : GL_LINEAR);
+		glTextureParameteri(entry.texture, GL_TEXTURE_MAG_FILTER, settings.magFilter);
+		if (settings.mipmaps)
+			glGenerateTextureMipmap(entry.texture);
+
+		m_keyForTexture[entry.texture] = key;
+		m_textures[key] = entry;
+		return entry.texture;
+	}
+
+	void TextureManager::Release(GLuint texture)
+	{
+		auto keyIt = m_keyForTexture.find(texture);
+		if (keyIt == m_keyForTexture.end())
+			return;
+
+		auto it = m_textures.find(keyIt->second);
+		if (--it->second.refCount > 0)
+			return;
+
+		glDeleteTextures(1, &texture);
+		m_textures.erase(it);
+		m_keyForTexture.erase(keyIt);
+	}
+
+	std::vector<TextureReportEntry> TextureManager::Report() const
+	{
+		std::vector<TextureReportEntry> report;
+		for (const auto& pair : m_textures)
+		{
+			const Entry& entry = pair.second;
+			report.push_back(TextureReportEntry{ entry.path, entry.width, entry.height, entry.bytes, entry.refCount, entry.requests });
+		}
+
+		// Biggest first
+		std::sort(report.begin(), report.end(),
+			[](const TextureReportEntry& a, const TextureReportEntry& b) { return a.bytes > b.bytes; });
+		return report;
+	}
+
+	size_t TextureManager::ResidentBytes() const
+	{
+		size_t bytes{ 0 };
+		for (const auto& pair : m_textures)
+			bytes += pair.second.bytes;
+		return bytes;
+	}
+}
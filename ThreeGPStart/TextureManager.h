@@ -0,0 +1,88 @@
+#pragma once
+// Loads each image once and shares the GL texture between everything that asks for it
+
+#include "ExternalLibraryHeaders.h"
+#include <unordered_map>
+
+namespace Helpers
+{
+	// Sampling and storage settings, part of the key so the same file with different settings is a different texture
+	struct TextureSettings
+	{
+		GLint wrap{ GL_REPEAT };
+		GLint minFilter{ GL_LINEAR_MIPMAP_LINEAR };
+		GLint magFilter{ GL_LINEAR };
+		bool mipmaps{ true };
+	};
+
+	// One resident texture for the report
+	struct TextureReportEntry
+	{
+		std::string path;
+		int width{ 0 };
+		int height{ 0 };
+
+		// Including the mip chain
+		size_t bytes{ 0 };
+
+		int refCount{ 0 };
+
+		// Every Acquire, the first one loaded it
+		size_t requests{ 0 };
+	};
+
+	// Textures are keyed by path plus settings and reference counted. Acquire loads on the first request and hands
+	// out the same handle after that, Release deletes the texture when the last reference goes.
+	// Textures are created with direct state access so no texture binding changes.
+	class TextureManager
+	{
+	private:
+		struct Entry
+		{
+			GLuint texture{ 0 };
+			std::string path;
+			int width{ 0 };
+			int height{ 0 };
+			size_t bytes{ 0 };
+			int refCount{ 0 };
+			size_t requests{ 0 };
+		};
+
+		std::unordered_map<std::string, Entry> m_textures;
+		std::unordered_map<GLuint, std::string> m_keyForTexture;
+
+		// Requests that found the texture already loaded
+		size_t m_duplicatesAvoided{ 0 };
+
+		// Bytes those duplicates would have taken
+		size_t m_bytesSaved{ 0 };
+
+		static std::string MakeKey(const std::string& path, const TextureSettings& settings);
+
+		// A repeat request for a key already loaded, returns 0 if it is not
+		GLuint Reuse(const std::string& key);
+
+		static size_t MipChainBytes(int width, int height, int numLevels);
+	public:
+		TextureManager() = default;
+		~TextureManager();
+
+		TextureManager(const TextureManager&) = delete;
+		TextureManager& operator=(const TextureManager&) = delete;
+
+		// Returns 0 on error
+		GLuint Acquire(const std::string& path, const TextureSettings& settings = TextureSettings());
+
+		// One GL_TEXTURE_CUBE_MAP from six square faces in +X, -X, +Y, -Y, +Z, -Z order. Returns 0 on error.
+		GLuint AcquireCubeMap(const std::string (&faces)[6], const TextureSettings& settings = TextureSettings());
+
+		// Unknown handles, including 0, are ignored
+		void Release(GLuint texture);
+
+		std::vector<TextureReportEntry> Report() const;
+		size_t NumResident() const { return m_textures.size(); }
+		size_t ResidentBytes() const;
+		size_t DuplicatesAvoided() const { return m_duplicatesAvoided; }
+		size_t BytesSaved() const { return m_bytesSaved; }
+	};
+}
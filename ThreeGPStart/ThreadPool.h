@@ -0,0 +1,38 @@
+#pragma once
+// Fixed set of worker threads that run queued jobs
+
+#include "ExternalLibraryHeaders.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Helpers
+{
+	// Jobs run in submission order on whichever worker is free. Jobs must not touch OpenGL
+	// as the context only belongs to the main thread. Queued jobs are finished before destruction.
+	class ThreadPool
+	{
+	private:
+		std::vector<std::thread> m_workers;
+		std::deque<std::function<void()>> m_jobs;
+		std::mutex m_mutex;
+		std::condition_variable m_jobAvailable;
+		bool m_stopping{ false };
+
+		void WorkerLoop();
+	public:
+		// 0 threads means one per hardware core
+		explicit ThreadPool(unsigned int numThreads = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Queue a job to run on a worker
+		void Submit(std::function<void()> job);
+
+		size_t NumThreads() const { return m_workers.size(); }
+	};
+}
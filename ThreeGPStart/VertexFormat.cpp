@@ -0,0 +1,199 @@
+#include "VertexFormat.h"
+#include <glm/gtc/packing.hpp>
+
+namespace Helpers
+{
+	namespace
+	{
+		struct FloatVertex
+		{
+			glm::vec3 position;
+			glm::vec3 normal;
+			glm::vec2 uv;
+		};
+		static_assert(sizeof(FloatVertex) == 32, "Unexpected FloatVertex size");
+
+		struct QuantizedVertex
+		{
+			uint16_t position[3];
+			uint16_t padding;
+			int16_t normal[2];
+			uint16_t uv[2];
+		};
+		static_assert(sizeof(QuantizedVertex) == 16, "Unexpected QuantizedVertex size");
+
+		// Maps the unit sphere onto an octahedron and unfolds it into the [-1,1] square
+		// Must match DecodeOctahedral in the vertex shaders
+		glm::vec2 EncodeOctahedral(glm::vec3 n)
+		{
+			const float sum{ std::abs(n.x) + std::abs(n.y) + std::abs(n.z) };
+			if (sum <= 0.0f)
+				return glm::vec2(0);
+
+			n /= sum;
+
+			glm::vec2 e(n.x, n.y);
+			if (n.z < 0.0f)
+			{
+				e.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+				e.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+			}
+			return e;
+		}
+
+		int16_t ToSnorm16(float value)
+		{
+			return (int16_t)std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+		}
+
+		uint16_t ToUnorm16(float value)
+		{
+			return (uint16_t)std::round(glm::clamp(value, 0.0f, 1.0f) * 65535.0f);
+		}
+	}
+
+	GLsizei VertexStride(VertexFormat format)
+	{
+		return format == VertexFormat::Quantized ? (GLsizei)sizeof(QuantizedVertex) : (GLsizei)sizeof(FloatVertex);
+	}
+
+	const char* VertexFormatName(VertexFormat format)
+	{
+		return format == VertexFormat::Quantized ? "Quantized" : "Float";
+	}
+
+	PackedVertices PackVertices(VertexFormat format, const std::vector<glm::vec3>& positions,
+		const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& uvCoords)
+	{
+		PackedVertices packed;
+		packed.format = format;
+		packed.numVertices = positions.size();
+		packed.data.resize(packed.numVertices * VertexStride(format));
+
+		const bool hasNormals{ normals.size() == positions.size() };
+		const bool hasUVs{ uvCoords.size() == positions.size() };
+
+		if (format == VertexFormat::Float)
+		{
+			FloatVertex* out = (FloatVertex*)packed.data.data();
+			for (size_t v = 0; v < packed.numVertices; v++)
+			{
+				out[v].position = positions[v];
+				out[v].normal = hasNormals ? normals[v] : glm::vec3(0);
+				out[v].uv = hasUVs ? uvCoords[v] : glm::vec2(0);
+			}
+			return packed;
+		}
+
+		// Positions are stored relative to the bounds so the full 16 bits cover the mesh
+		glm::vec3 minExtents{ 0 };
+		glm::vec3 maxExtents{ 0 };
+		if (!positions.empty())
+		{
+			minExtents = maxExtents = positions[0];
+			for (const glm::vec3& p : positions)
+			{
+				minExtents = glm::min(minExtents, p);
+				maxExtents = glm::max(maxExtents, p);
+			}
+		}
+
+		packed.positionOffset = minExtents;
+		packed.positionScale = maxExtents - minExtents;
+
+		// Avoid a divide by zero for flat meshes e.g. a skybox face
+		glm::vec3 invScale{ 0 };
+		for (int axis = 0; axis < 3; axis++)
+			invScale[axis] = packed.positionScale[axis] > 0.0f ? 1.0f / packed.positionScale[axis] : 0.0f;
+
+		QuantizedVertex* out = (QuantizedVertex*)packed.data.data();
+		for (size_t v = 0; v < packed.numVertices; v++)
+		{
+			const glm::vec3 unit{ (positions[v] - minExtents) * invScale };
+			out[v].position[0] = ToUnorm16(unit.x);
+			out[v].position[1] = ToUnorm16(unit.y);
+			out[v].position[2] = ToUnorm16(unit.z);
+			out[v].padding = 0;
+
+			const glm::vec2 octNormal{ hasNormals ? EncodeOctahedral(normals[v]) : glm::vec2(0) };
+			out[v].normal[0] = ToSnorm16(octNormal.x);
+			out[v].normal[1] = ToSnorm16(octNormal.y);
+
+			const glm::uint halfUV{ glm::packHalf2x16(hasUVs ? uvCoords[v] : glm::vec2(0)) };
+			out[v].uv[0] = (uint16_t)(halfUV & 0xFFFF);
+			out[v].uv[1] = (uint16_t)(halfUV >> 16);
+		}
+
+		return packed;
+	}
+
+	void SetupVertexAttributes(VertexFormat format)
+	{
+		const GLsizei stride{ VertexStride(format) };
+
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+
+		if (format == VertexFormat::Float)
+		{
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, position));
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, normal));
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, uv));
+		}
+		else
+		{
+			// Only 2 normal components are sent, the shader sees z as 0 and decodes the octahedral xy
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(QuantizedVertex, position));
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(QuantizedVertex, normal));
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(QuantizedVertex, uv));
+		}
+	}
+
+	GLenum IndexTypeFor(size_t numVertices)
+	{
+		if (numVertices <= 0x100)
+			return GL_UNSIGNED_BYTE;
+		if (numVertices <= 0x10000)
+			return GL_UNSIGNED_SHORT;
+		return GL_UNSIGNED_INT;
+	}
+
+	GLsizei IndexSize(GLenum indexType)
+	{
+		switch (indexType)
+		{
+		case GL_UNSIGNED_BYTE:
+			return 1;
+		case GL_UNSIGNED_SHORT:
+			return 2;
+		default:
+			return 4;
+		}
+	}
+
+	std::vector<unsigned char> PackIndices(GLenum indexType, const std::vector<GLuint>& elements)
+	{
+		std::vector<unsigned char> packed(elements.size() * IndexSize(indexType));
+
+		switch (indexType)
+		{
+		case GL_UNSIGNED_BYTE:
+			for (size_t i = 0; i < elements.size(); i++)
+				packed[i] = (uint8_t)elements[i];
+			break;
+		case GL_UNSIGNED_SHORT:
+		{
+			uint16_t* out = (uint16_t*)packed.data();
+			for (size_t i = 0; i < elements.size(); i++)
+				out[i] = (uint16_t)elements[i];
+			break;
+		}
+		default:
+			memcpy(packed.data(), elements.data(), packed.size());
+			break;
+		}
+
+		return packed;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+// Packing of mesh data into a single interleaved vertex stream ready for the GPU
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Layouts a mesh can be uploaded in. Attribute locations are always
+	// 0 = position, 1 = normal, 2 = texture coordinate
+	enum class VertexFormat
+	{
+		// vec3 position, vec3 normal, vec2 uv. 32 bytes per vertex
+		Float,
+
+		// 16 bit unorm position relative to the mesh bounds, octahedral 16 bit snorm normal,
+		// half float uv. 16 bytes per vertex
+		Quantized
+	};
+
+	// Bytes used by one vertex in the format
+	GLsizei VertexStride(VertexFormat format);
+
+	// Human readable name for the GUI
+	const char* VertexFormatName(VertexFormat format);
+
+	// Interleaved vertex data along with what the shader needs to undo any quantisation
+	struct PackedVertices
+	{
+		VertexFormat format{ VertexFormat::Float };
+		std::vector<unsigned char> data;
+		size_t numVertices{ 0 };
+
+		// Object space position = positionOffset + positionScale * stored position
+		glm::vec3 positionOffset{ 0 };
+		glm::vec3 positionScale{ 1 };
+	};
+
+	// Interleave and optionally quantise. Normals and uvs may be empty in which case zeros are stored.
+	PackedVertices PackVertices(VertexFormat format, const std::vector<glm::vec3>& positions,
+		const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& uvCoords);
+
+	// Describe the format to the currently bound vertex array object, sourcing from the currently bound GL_ARRAY_BUFFER
+	void SetupVertexAttributes(VertexFormat format);
+
+	// Smallest of GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT and GL_UNSIGNED_INT that can index numVertices
+	GLenum IndexTypeFor(size_t numVertices);
+
+	// Bytes used by one index of the type
+	GLsizei IndexSize(GLenum indexType);
+
+	// Narrow element data to the index type ready for upload. Every index must fit in the type.
+	std::vector<unsigned char> PackIndices(GLenum indexType, const std::vector<GLuint>& elements);
+}